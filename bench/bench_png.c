@@ -0,0 +1,120 @@
+/**
+ * @file bench_png.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Benchmark of the banded PNG encoder and the raster dumps against gdImagePng, time and size.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "view.h"
+#include "model.h"
+#include "encoder.h"
+#include "raster.h"
+#include "utils.h"
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Minimum time spent measuring each encoder.
+ */
+#define BENCH_MIN_SECONDS 0.5
+
+/**
+ * @brief An encoder configuration: libgd, a raster encoder, or the PNG encoder with options.
+ */
+typedef struct BenchEncoder
+{
+    const char *name;
+    PngOptions options;
+    int libgd;
+    int (*raster)(OutputBuffer *buffer, gdImagePtr img);
+} BenchEncoder;
+
+/**
+ * @brief Encodes an image until BENCH_MIN_SECONDS have elapsed.
+ *
+ * @return The mean time of one encoding in seconds; the size of the PNG is left in *size.
+ */
+static double measure(const BenchEncoder *encoder, gdImagePtr img, OutputBuffer *buffer, size_t *size)
+{
+    int iterations = 0;
+    double start = monotonic_seconds(), elapsed;
+    do
+    {
+        if (encoder->libgd)
+            output_buffer_encode_png(buffer, img);
+        else if (encoder->raster)
+            encoder->raster(buffer, img);
+        else
+            png_encode_image(buffer, img, &encoder->options);
+        iterations++;
+        elapsed = monotonic_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    *size = buffer->length;
+    return elapsed / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    const char *default_sizes[] = {"2400x1600", "9600x6400"};
+    int sizes_count = argc > 1 ? argc - 1 : 2;
+    const BenchEncoder encoders[] = {
+        {.name = "gdImagePng", .libgd = 1},
+        {.name = "level 6", .options = {Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, 1}},
+        {.name = "level 1", .options = {1, Z_DEFAULT_STRATEGY, 1}},
+        {.name = "rle", .options = {Z_DEFAULT_COMPRESSION, Z_RLE, 1}},
+        {.name = "level 6, 4 threads", .options = {Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, 4}},
+        {.name = "rle, 4 threads", .options = {Z_DEFAULT_COMPRESSION, Z_RLE, 4}},
+        {.name = "rle, all threads", .options = {Z_DEFAULT_COMPRESSION, Z_RLE, 0}},
+        {.name = "qoi", .raster = qoi_encode},
+        {.name = "ppm", .raster = ppm_encode},
+        {.name = "rgba", .raster = rgba_encode},
+        {.name = "indexed", .raster = indexed_encode},
+    };
+    int encoders_count = sizeof(encoders) / sizeof(encoders[0]);
+
+    // A typical chart: a few labelled segments and a title
+    char *labels[] = {"Nord", "Sud", "Est", "Ouest", "Centre"};
+    PieChartSegment segments[5];
+    uint64_t state = derive_color_seed(42, 0);
+    for (int i = 0; i < 5; i++)
+    {
+        segments[i].percentage = 20;
+        segments[i].label = labels[i];
+    }
+    assign_segment_colors(segments, 5, &state);
+
+    OutputBuffer buffer;
+    output_buffer_init(&buffer);
+    printf("%-10s %-9s %-20s %10s %12s %9s\n", "size", "canvas", "encoder", "ms", "bytes", "speedup");
+    for (int s = 0; s < sizes_count; s++)
+    {
+        int width, height;
+        if (sscanf(argc > 1 ? argv[s + 1] : default_sizes[s], "%dx%d", &width, &height) != 2)
+            return 1;
+        for (int truecolor = 0; truecolor <= 1; truecolor++)
+        {
+            gdImagePtr img = truecolor ? gdImageCreateTrueColor(width, height) : gdImageCreate(width, height);
+            if (img == NULL || draw_pie_chart(img, segments, 5, "Ventes"))
+                return 1;
+
+            double reference = 0;
+            for (int e = 0; e < encoders_count; e++)
+            {
+                if (encoders[e].raster == indexed_encode && truecolor)
+                    continue; // Palette canvases only
+                size_t size;
+                double seconds = measure(&encoders[e], img, &buffer, &size);
+                reference = e == 0 ? seconds : reference;
+                printf("%4dx%-5d %-9s %-20s %10.2f %12zu %8.2fx\n", width, height, truecolor ? "antialias" : "palette",
+                       encoders[e].name, seconds * 1e3, size, reference / seconds);
+            }
+            gdImageDestroy(img);
+        }
+    }
+    output_buffer_free(&buffer);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file bench_raster.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Benchmark of the scanline pie rasterizer against the libgd drawing path.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "view.h"
+#include "model.h"
+#include "scanline.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * @brief Minimum time spent measuring each path.
+ */
+#define BENCH_MIN_SECONDS 0.5
+
+/**
+ * @brief Largest chart drawn with libgd: its time grows with the square of the segments,
+ * 10000 segments already take minutes.
+ */
+#define BENCH_LIBGD_MAX_SEGMENTS 10000
+
+/**
+ * @brief Draws the segments of a pie chart with libgd, one filled arc, outline and
+ * separation lines per segment: the program's drawing before the scanline rasterizer.
+ */
+static void draw_pie_segments(gdImagePtr img, const PieChartSegment *segments, int length, int x, int y,
+                              double start_angle, int radius, int black)
+{
+    for (int i = 0; i < length; i++)
+    {
+        double end_angle = start_angle + segments[i].percentage * 3.6; // Multiply by 3.6 to convert to degrees
+
+        // Use the color chosen for this segment by the model
+        PieChartColor color = segments[i].color;
+
+        // Allocate the color in the image
+        int img_color = gdImageColorAllocate(img, color.r, color.g, color.b);
+
+        // Draw the pie chart segment
+        gdImageFilledArc(img, x, y, 2 * radius, 2 * radius, start_angle, end_angle, img_color, gdPie);
+
+        // Draw a black border around the segment
+        gdImageArc(img, x, y, 2 * radius, 2 * radius, start_angle, end_angle, black);
+
+        // Calculate the coordinates of the start and end of the separation lines
+        double median = (end_angle + start_angle) / 2.0 * M_PI / 180.0;
+        int x_start, y_start, x_end, y_end;
+        calculate_coordinates(x, y, radius, start_angle, &x_start, &y_start);
+        calculate_coordinates(x, y, radius, end_angle, &x_end, &y_end);
+
+        // Calculate the coordinates of the start of the median, at the edge of the circle
+        int x_med_start = x + radius * cos(median);
+        int y_med_start = y + radius * sin(median);
+
+        // Calculate the coordinates of the end of the median, 10% beyond the edge of the circle
+        int x_med_end = x + 1.05 * radius * cos(median);
+        int y_med_end = y + 1.05 * radius * sin(median);
+
+        // Draw the median
+        gdImageLine(img, x_med_start, y_med_start, x_med_end, y_med_end, black);
+
+        // Draw the separation lines
+        gdImageLine(img, x, y, x_start, y_start, black);
+        gdImageLine(img, x, y, x_end, y_end, black);
+
+        start_angle = end_angle;
+    }
+}
+
+/**
+ * @brief Draws the pie the way the program did before the scanline rasterizer.
+ */
+static void draw_with_libgd(gdImagePtr img, const PieChartSegment *segments, int count)
+{
+    int white = gdImageColorAllocate(img, 255, 255, 255);
+    gdImageFill(img, 0, 0, white);
+    int black = gdImageColorAllocate(img, 0, 0, 0);
+    draw_pie_segments(img, segments, count, WIDTH / 2, HEIGHT / 2, 0, MIN(WIDTH, HEIGHT) / 3, black);
+}
+
+/**
+ * @brief Rasterizes the pie with the painter of draw_display_list().
+ */
+static void rasterize_pie(gdImagePtr img, const PieChartSegment *segments, int length, int x, int y, int radius,
+                          int background, int black, bool antialias)
+{
+    PieGeometry geometry;
+    if (pie_geometry_init(&geometry, segments, length, x, y, radius))
+    {
+        fprintf(stderr, "Not enough memory for the geometry of %d segments\n", length);
+        exit(1);
+    }
+    for (int i = 0; i < length; i++)
+        geometry.inks[i] = allocate_ink(img, segments[i].color);
+    paint_pie_geometry(img, &geometry, background, black, antialias);
+    pie_geometry_free(&geometry);
+}
+
+static void draw_with_scanlines(gdImagePtr img, const PieChartSegment *segments, int count)
+{
+    int white = gdImageColorAllocate(img, 255, 255, 255);
+    int black = gdImageColorAllocate(img, 0, 0, 0);
+    rasterize_pie(img, segments, count, WIDTH / 2, HEIGHT / 2, MIN(WIDTH, HEIGHT) / 3, white, black, false);
+}
+
+static void draw_antialiased(gdImagePtr img, const PieChartSegment *segments, int count)
+{
+    int white = gdImageColorAllocate(img, 255, 255, 255);
+    int black = gdImageColorAllocate(img, 0, 0, 0);
+    rasterize_pie(img, segments, count, WIDTH / 2, HEIGHT / 2, MIN(WIDTH, HEIGHT) / 3, white, black, true);
+}
+
+/**
+ * @brief Runs a drawing path until BENCH_MIN_SECONDS have elapsed.
+ *
+ * @return The mean time of one chart in seconds; the last chart is left in *result.
+ */
+static double measure(void (*draw)(gdImagePtr, const PieChartSegment *, int), const PieChartSegment *segments,
+                      int count, int truecolor, gdImagePtr *result)
+{
+    int iterations = 0;
+    double start = monotonic_seconds(), elapsed;
+    do
+    {
+        if (*result)
+            gdImageDestroy(*result);
+        *result = truecolor ? gdImageCreateTrueColor(WIDTH, HEIGHT) : gdImageCreate(WIDTH, HEIGHT);
+        draw(*result, segments, count);
+        iterations++;
+        elapsed = monotonic_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return elapsed / iterations;
+}
+
+/**
+ * @brief Share of the pixels whose color differs between two images.
+ */
+static double differing_pixels(gdImagePtr first, gdImagePtr second)
+{
+    long differing = 0;
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        for (int x = 0; x < WIDTH; x++)
+        {
+            int a = gdImageGetPixel(first, x, y), b = gdImageGetPixel(second, x, y);
+            if (gdImageRed(first, a) != gdImageRed(second, b) || gdImageGreen(first, a) != gdImageGreen(second, b) ||
+                gdImageBlue(first, a) != gdImageBlue(second, b))
+                differing++;
+        }
+    }
+    return 100.0 * differing / ((double)WIDTH * HEIGHT);
+}
+
+int main(int argc, char **argv)
+{
+    int default_counts[] = {10, 1000, 100000};
+    int counts_count = argc > 1 ? argc - 1 : 3;
+
+    printf("%10s %12s %12s %9s %10s %14s %9s %9s\n", "segments", "libgd ms", "scanline ms", "speedup", "differing",
+           "truecolor ms", "aa ms", "aa ratio");
+    for (int c = 0; c < counts_count; c++)
+    {
+        int count = argc > 1 ? atoi(argv[c + 1]) : default_counts[c];
+        PieChartSegment *segments = calloc(count, sizeof(PieChartSegment));
+        if (count <= 0 || segments == NULL)
+            return 1;
+        uint64_t state = derive_color_seed(42, 0);
+        for (int i = 0; i < count; i++)
+            segments[i].percentage = 100.0 / count;
+        assign_segment_colors(segments, count, &state);
+
+        // A palette cannot hold the colors of large charts
+        int truecolor = count > 250;
+        gdImagePtr reference = NULL, rasterized = NULL;
+        double scanline = measure(draw_with_scanlines, segments, count, truecolor, &rasterized);
+        if (count <= BENCH_LIBGD_MAX_SEGMENTS)
+        {
+            double libgd = measure(draw_with_libgd, segments, count, truecolor, &reference);
+            printf("%10d %12.3f %12.3f %8.1fx %9.3f%%", count, libgd * 1e3, scanline * 1e3, libgd / scanline,
+                   differing_pixels(reference, rasterized));
+            gdImageDestroy(reference);
+        }
+        else
+            printf("%10d %12s %12.3f %9s %10s", count, "-", scanline * 1e3, "-", "-");
+
+        // Anti-aliasing needs a truecolor canvas: compared with aliased rendering on the same canvas
+        gdImagePtr aliased = NULL, smooth = NULL;
+        double plain = measure(draw_with_scanlines, segments, count, 1, &aliased);
+        double antialiased = measure(draw_antialiased, segments, count, 1, &smooth);
+        printf(" %14.3f %9.3f %8.2fx\n", plain * 1e3, antialiased * 1e3, antialiased / plain);
+        gdImageDestroy(aliased);
+        gdImageDestroy(smooth);
+
+        gdImageDestroy(rasterized);
+        free(segments);
+    }
+    return 0;
+}
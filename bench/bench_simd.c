@@ -0,0 +1,160 @@
+/**
+ * @file bench_simd.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Microbenchmark of the span fill and coverage blending kernels.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "simd.h"
+#include "view.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Minimum time spent measuring each kernel.
+ */
+#define BENCH_MIN_SECONDS 0.5
+
+/**
+ * @brief Rows of one pass: a band that stays in cache, the measure is the kernel and
+ * not the memory bandwidth.
+ */
+#define BENCH_ROWS 16
+
+/**
+ * @brief The spans of one pass: BENCH_ROWS rows of a canvas.
+ */
+#define BENCH_PIXELS ((size_t)WIDTH * BENCH_ROWS)
+
+/**
+ * @brief The color filled or blended.
+ */
+#define BENCH_COLOR 0x00336699
+
+/**
+ * @brief Coverage patterns the blend kernel is measured on.
+ */
+typedef enum Pattern
+{
+    PATTERN_TEXT, ///< Runs of empty, full and partial coverage, like a text mask.
+    PATTERN_EDGE, ///< Only partial coverage, like anti-aliased edges.
+    PATTERNS
+} Pattern;
+
+static const char *pattern_names[PATTERNS] = {"blend text", "blend edge"};
+
+/**
+ * @brief Deterministic pseudo-random numbers (splitmix64) for the test data.
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void make_coverage(unsigned char *coverage, size_t count, Pattern pattern, uint64_t *state)
+{
+    for (size_t i = 0; i < count;)
+    {
+        size_t run = 1 + next_random(state) % 12;
+        int kind = pattern == PATTERN_EDGE ? 2 : next_random(state) % 3;
+        for (size_t end = MIN(i + run, count); i < end; i++)
+            coverage[i] = kind == 0 ? 0 : kind == 1 ? 255 : 1 + next_random(state) % 254;
+    }
+}
+
+/**
+ * @brief Runs one kernel over the band, row by row.
+ */
+static void run_pass(const SimdKernels *kernels, int blend, uint32_t *pixels, const unsigned char *coverage)
+{
+    for (size_t row = 0; row < BENCH_ROWS; row++)
+    {
+        if (blend)
+            kernels->blend_span(pixels + row * WIDTH, coverage + row * WIDTH, BENCH_COLOR, WIDTH);
+        else
+            kernels->fill_span(pixels + row * WIDTH, BENCH_COLOR, WIDTH);
+    }
+}
+
+/**
+ * @brief Runs passes of one kernel until BENCH_MIN_SECONDS have elapsed.
+ *
+ * Blending again over blended pixels costs the same, the band is not restored between passes.
+ *
+ * @return The throughput in millions of pixels per second.
+ */
+static double measure(const SimdKernels *kernels, int blend, uint32_t *pixels, const unsigned char *coverage)
+{
+    long passes = 0;
+    double start = monotonic_seconds(), elapsed;
+    do
+    {
+        run_pass(kernels, blend, pixels, coverage);
+        passes++;
+        elapsed = monotonic_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    return passes * (double)BENCH_PIXELS / elapsed / 1e6;
+}
+
+int main(void)
+{
+    uint32_t *pixels = malloc(BENCH_PIXELS * sizeof(uint32_t));
+    uint32_t *initial = malloc(BENCH_PIXELS * sizeof(uint32_t));
+    uint32_t *expected = malloc(BENCH_PIXELS * sizeof(uint32_t));
+    unsigned char *coverage = malloc(BENCH_PIXELS);
+    if (!pixels || !initial || !expected || !coverage)
+        return 1;
+
+    uint64_t state = 42;
+    for (size_t i = 0; i < BENCH_PIXELS; i++)
+        initial[i] = next_random(&state) & 0x7FFFFFFF; // 7 bits alpha like libgd
+
+    printf("%-12s %-8s %14s %9s %6s\n", "kernel", "level", "Mpixels/s", "speedup", "exact");
+    for (int kernel = 0; kernel <= PATTERNS; kernel++)
+    {
+        int blend = kernel > 0;
+        if (blend)
+        {
+            make_coverage(coverage, BENCH_PIXELS, kernel - 1, &state);
+
+            // Reference output of the scalar kernel
+            memcpy(expected, initial, BENCH_PIXELS * sizeof(uint32_t));
+            simd_kernels_for(SIMD_SCALAR)->blend_span(expected, coverage, BENCH_COLOR, BENCH_PIXELS);
+        }
+
+        double scalar = 0;
+        for (SimdLevel level = SIMD_SCALAR; level < SIMD_LEVELS; level++)
+        {
+            const SimdKernels *kernels = simd_kernels_for(level);
+            if (kernels == NULL)
+                continue;
+            memcpy(pixels, initial, BENCH_PIXELS * sizeof(uint32_t));
+            double throughput = measure(kernels, blend, pixels, coverage);
+            if (level == SIMD_SCALAR)
+                scalar = throughput;
+
+            // One pass from the initial pixels gives the same result at every level
+            memcpy(pixels, initial, BENCH_PIXELS * sizeof(uint32_t));
+            run_pass(kernels, blend, pixels, coverage);
+            int exact = 1;
+            for (size_t i = 0; i < BENCH_PIXELS && exact; i++)
+                exact = pixels[i] == (blend ? expected[i] : BENCH_COLOR);
+            printf("%-12s %-8s %14.1f %8.2fx %6s\n", blend ? pattern_names[kernel - 1] : "fill", kernels->name,
+                   throughput, throughput / scalar, exact ? "yes" : "NO");
+        }
+    }
+
+    free(pixels);
+    free(initial);
+    free(expected);
+    free(coverage);
+    return 0;
+}
@@ -0,0 +1,459 @@
+/**
+ * @file piechart_bench.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Per-stage microbenchmarks of the chart pipeline, reported as JSON.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "controller.h"
+#include "view.h"
+#include "model.h"
+#include "output.h"
+#include "scanline.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Minimum time spent measuring each stage, unless --min-time is given.
+ */
+#define BENCH_MIN_SECONDS 0.2
+
+/**
+ * @brief Minimum number of samples of a stage, however slow.
+ */
+#define BENCH_MIN_SAMPLES 5
+
+/**
+ * @brief Maximum number of samples of a stage.
+ */
+#define BENCH_MAX_SAMPLES 100000
+
+/**
+ * @brief Shortest sample: fast stages are repeated within a sample until it lasts this long.
+ */
+#define BENCH_MIN_SAMPLE_SECONDS 20e-6
+
+/**
+ * @brief Maximum number of segment counts and canvas sizes on the command line.
+ */
+#define BENCH_MAX_PARAMETERS 16
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+/*
+ * The allocator is interposed to count the allocations, those of libgd and FreeType
+ * included: every call goes on to the glibc allocator.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+static long allocations;
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+
+#define COUNTING_ALLOCATIONS 1
+#define ALLOCATIONS() __atomic_load_n(&allocations, __ATOMIC_RELAXED)
+#else
+#define COUNTING_ALLOCATIONS 0
+#define ALLOCATIONS() 0L
+#endif
+
+/**
+ * @brief A synthetic chart and everything the stages work on.
+ */
+typedef struct Workload
+{
+    int count;               ///< Number of segments.
+    int width, height;       ///< Canvas size, 0 for the stages that do not draw.
+    char **values;           ///< The percentages as command line arguments.
+    char **labels;           ///< The labels, NULL without labels.
+    char **argv;             ///< Command line of the chart: program, values, labels and title.
+    int argc;
+    char **command;          ///< Full command line of handle_input(), copied before each call.
+    char **scratch;          ///< Copy of command, compacted by handle_input().
+    int command_count;
+    PieChartSegment *segments; ///< The parsed and colored segments.
+    Arena arena;             ///< Receives the segments of parse_segments, reset after each call like a chart.
+    uint64_t color_state;
+    ChartLayout layout;
+    DisplayList list;        ///< The primitives of the whole chart, drawn by draw_display_list.
+    DisplayList scratch_list; ///< Rebuilt by each display stage with its part of the chart.
+    gdImagePtr canvas;
+    OutputBuffer output;
+    ControllerData data;
+    volatile long sink;      ///< Keeps the results of the pure stages alive.
+} Workload;
+
+/**
+ * @brief A stage of the pipeline, run once per call.
+ */
+typedef struct BenchStage
+{
+    const char *name;
+    int canvas;              ///< Depends on the canvas size.
+    void (*run)(Workload *workload);
+} BenchStage;
+
+static void run_is_number(Workload *workload)
+{
+    long numbers = 0;
+    for (int i = 0; i < workload->count; i++)
+        numbers += is_number(workload->values[i]);
+    workload->sink = numbers;
+}
+
+/**
+ * @brief Parses the segments of the command line, then releases them: both belong to the stage.
+ */
+static void run_parse_segments(Workload *workload)
+{
+    int length;
+    parse_segments(workload->argv, &length, workload->argc, false, &workload->arena);
+    arena_reset(&workload->arena);
+    workload->sink = length;
+}
+
+static void run_generate_random_color(Workload *workload)
+{
+    long sum = 0;
+    for (int i = 0; i < workload->count; i++)
+        sum += generate_random_color(&workload->color_state).r;
+    workload->sink = sum;
+}
+
+static void run_display_pie_segments(Workload *workload)
+{
+    PieChartColor white = {255, 255, 255}, black = {0, 0, 0};
+    ChartLayout *layout = &workload->layout;
+    display_list_reset(&workload->scratch_list, workload->width, workload->height, white);
+    display_pie_segments(&workload->scratch_list, workload->segments, workload->count, layout->cx, layout->cy,
+                         layout->radius, black);
+}
+
+static void run_display_labels(Workload *workload)
+{
+    PieChartColor white = {255, 255, 255}, black = {0, 0, 0};
+    ChartLayout *layout = &workload->layout;
+    display_list_reset(&workload->scratch_list, workload->width, workload->height, white);
+    display_labels(&workload->scratch_list, workload->segments, workload->count, layout->cx, layout->cy,
+                   layout->radius, black);
+}
+
+static void run_display_title(Workload *workload)
+{
+    PieChartColor white = {255, 255, 255}, black = {0, 0, 0};
+    ChartLayout *layout = &workload->layout;
+    display_list_reset(&workload->scratch_list, workload->width, workload->height, white);
+    display_title(&workload->scratch_list, "Benchmark", layout->title_size, layout->title_x, layout->title_y, black);
+}
+
+/**
+ * @brief Rasterizes the whole chart from its display list, like a renderer does for each chart.
+ */
+static void run_draw_display_list(Workload *workload)
+{
+    PieGeometry geometry;
+    if (pie_geometry_init(&geometry, workload->segments, workload->count, 0, 0, 0))
+        return;
+    draw_display_list(workload->canvas, &workload->list, &geometry);
+    pie_geometry_free(&geometry);
+}
+
+static void run_gd_image_png(Workload *workload)
+{
+    output_buffer_encode_png(&workload->output, workload->canvas);
+}
+
+/**
+ * @brief The whole command line path: options, parsing, colors, drawing, encoding and writing to /dev/null.
+ */
+static void run_handle_input(Workload *workload)
+{
+    memcpy(workload->scratch, workload->command, (workload->command_count + 1) * sizeof(char *));
+    handle_input(workload->command_count, workload->scratch, &workload->data);
+    controller_reset(&workload->data);
+}
+
+/**
+ * @brief Builds the command line of a chart of count segments with labels of label_length characters.
+ */
+static int workload_init(Workload *workload, int count, int label_length)
+{
+    memset(workload, 0, sizeof(*workload));
+    workload->count = count;
+    workload->color_state = derive_color_seed(42, 0);
+    display_list_init(&workload->list);
+    display_list_init(&workload->scratch_list);
+    output_buffer_init(&workload->output);
+    arena_init(&workload->arena);
+
+    // Program, values, labels, -T title, then -o /dev/null --size WIDTHxHEIGHT for handle_input()
+    int labels = label_length > 0 ? count : 0;
+    workload->argc = 1 + count + labels + 2;
+    workload->command_count = workload->argc + 4;
+    workload->command = calloc(workload->command_count + 1, sizeof(char *));
+    workload->scratch = calloc(workload->command_count + 1, sizeof(char *));
+    workload->argv = workload->command;
+    workload->values = workload->argv + 1;
+    workload->labels = labels ? workload->values + count : NULL;
+    workload->segments = calloc(count, sizeof(PieChartSegment));
+    char *strings = malloc((size_t)count * (16 + label_length + 1));
+    if (!workload->command || !workload->scratch || !workload->segments || !strings)
+        return 1;
+
+    workload->argv[0] = "PieChart";
+    char value[16];
+    snprintf(value, sizeof(value), "%.6g", 100.0 / count);
+    for (int i = 0; i < count; i++)
+    {
+        // The strings of a chart live in one block, freed with the first value
+        char *string = strings + (size_t)i * (16 + label_length + 1);
+        strcpy(string, value);
+        workload->values[i] = string;
+        if (labels)
+        {
+            char *label = string + 16;
+            for (int k = 0; k < label_length; k++)
+                label[k] = 'a' + (i + k) % 26;
+            label[label_length] = '\0';
+            workload->labels[i] = label;
+        }
+        workload->segments[i].percentage = 100.0 / count;
+        workload->segments[i].label = labels ? workload->labels[i] : "";
+    }
+    workload->argv[workload->argc - 2] = "-T";
+    workload->argv[workload->argc - 1] = "Benchmark";
+    assign_segment_colors(workload->segments, count, &workload->color_state);
+    controller_init(&workload->data);
+    return workload->data.renderer == NULL;
+}
+
+/**
+ * @brief Sets the canvas size of the drawing stages, the chart already laid out on it.
+ */
+static int workload_set_size(Workload *workload, int width, int height)
+{
+    static char size[32];
+    snprintf(size, sizeof(size), "%dx%d", width, height);
+    workload->command[workload->argc] = "-o";
+    workload->command[workload->argc + 1] = "/dev/null";
+    workload->command[workload->argc + 2] = "--size";
+    workload->command[workload->argc + 3] = size;
+    workload->command[workload->command_count] = NULL;
+
+    workload->width = width;
+    workload->height = height;
+    chart_layout_init(&workload->layout, width, height);
+    if (workload->canvas)
+        gdImageDestroy(workload->canvas);
+    workload->canvas = gdImageCreate(width, height);
+    return workload->canvas == NULL ||
+           display_pie_chart(&workload->list, workload->segments, workload->count, "Benchmark", width, height);
+}
+
+static void workload_free(Workload *workload)
+{
+    if (workload->canvas)
+        gdImageDestroy(workload->canvas);
+    controller_cleanup(&workload->data);
+    display_list_free(&workload->list);
+    display_list_free(&workload->scratch_list);
+    output_buffer_free(&workload->output);
+    arena_free(&workload->arena);
+    if (workload->values)
+        free(workload->values[0]);
+    free(workload->command);
+    free(workload->scratch);
+    free(workload->segments);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Runs a stage for min_seconds and prints its JSON result.
+ *
+ * The calls per sample are doubled until a sample lasts BENCH_MIN_SAMPLE_SECONDS, which
+ * also warms up the caches, the font and the buffers before anything is counted.
+ */
+static void measure(const BenchStage *stage, Workload *workload, int label_length, double min_seconds,
+                    double *samples, int *first)
+{
+    long calls = 1;
+    for (;;)
+    {
+        double start = monotonic_seconds();
+        for (long i = 0; i < calls; i++)
+            stage->run(workload);
+        if (monotonic_seconds() - start >= BENCH_MIN_SAMPLE_SECONDS)
+            break;
+        calls *= 2;
+    }
+
+    int count = 0;
+    long allocated = ALLOCATIONS();
+    double begin = monotonic_seconds(), elapsed;
+    do
+    {
+        double start = monotonic_seconds();
+        for (long i = 0; i < calls; i++)
+            stage->run(workload);
+        samples[count++] = (monotonic_seconds() - start) / calls;
+        elapsed = monotonic_seconds() - begin;
+    } while (count < BENCH_MAX_SAMPLES && (elapsed < min_seconds || count < BENCH_MIN_SAMPLES));
+    allocated = ALLOCATIONS() - allocated;
+
+    qsort(samples, count, sizeof(double), compare_doubles);
+    int p99 = (count * 99 + 99) / 100 - 1;
+    printf("%s    {\"stage\": \"%s\", \"segments\": %d, \"label_length\": %d, ", *first ? "" : ",\n", stage->name,
+           workload->count, label_length);
+    if (stage->canvas)
+        printf("\"width\": %d, \"height\": %d, ", workload->width, workload->height);
+    else
+        printf("\"width\": null, \"height\": null, ");
+    printf("\"iterations\": %ld, \"min_ns\": %.1f, \"median_ns\": %.1f, \"p99_ns\": %.1f, ", count * calls,
+           samples[0] * 1e9, samples[count / 2] * 1e9, samples[p99] * 1e9);
+    if (COUNTING_ALLOCATIONS)
+        printf("\"allocations\": %.2f}", (double)allocated / (count * calls));
+    else
+        printf("\"allocations\": null}");
+    fflush(stdout);
+    *first = 0;
+}
+
+/**
+ * @brief Reads a comma separated list of integers, or of WIDTHxHEIGHT sizes when heights is not NULL.
+ */
+static int parse_list(const char *value, int *numbers, int *heights)
+{
+    int count = 0;
+    while (*value && count < BENCH_MAX_PARAMETERS)
+    {
+        char *end;
+        numbers[count] = strtol(value, &end, 10);
+        if (heights)
+        {
+            if (*end != 'x')
+                return 0;
+            heights[count] = strtol(end + 1, &end, 10);
+        }
+        if (end == value || (*end != ',' && *end != '\0'))
+            return 0;
+        count++;
+        value = *end ? end + 1 : end;
+    }
+    return *value ? 0 : count;
+}
+
+int main(int argc, char **argv)
+{
+    static const BenchStage stages[] = {
+        {"is_number", 0, run_is_number},
+        {"parse_segments", 0, run_parse_segments},
+        {"generate_random_color", 0, run_generate_random_color},
+        {"display_pie_segments", 1, run_display_pie_segments},
+        {"display_labels", 1, run_display_labels},
+        {"display_title", 1, run_display_title},
+        {"draw_display_list", 1, run_draw_display_list},
+        {"gdImagePng", 1, run_gd_image_png},
+        {"handle_input", 1, run_handle_input},
+    };
+    int stages_count = sizeof(stages) / sizeof(stages[0]);
+
+    int counts[BENCH_MAX_PARAMETERS] = {2, 10, 100, 1000, 10000, 100000}, counts_count = 6;
+    int widths[BENCH_MAX_PARAMETERS] = {600, 2400}, heights[BENCH_MAX_PARAMETERS] = {400, 1600}, sizes_count = 2;
+    int label_length = 8;
+    double min_seconds = BENCH_MIN_SECONDS;
+    const char *only = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = i + 1 < argc ? argv[i + 1] : "";
+        if (strcmp(argv[i], "--segments") == 0 && (counts_count = parse_list(value, counts, NULL)))
+            i++;
+        else if (strcmp(argv[i], "--sizes") == 0 && (sizes_count = parse_list(value, widths, heights)))
+            i++;
+        else if (strcmp(argv[i], "--label-length") == 0 && is_number((char *)value))
+            label_length = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--min-time") == 0 && is_number((char *)value))
+            min_seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--stage") == 0 && *value)
+            only = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--segments N,...] [--sizes WIDTHxHEIGHT,...] [--label-length N] "
+                            "[--min-time SECONDS] [--stage NAME]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < counts_count; i++)
+    {
+        if (counts[i] < 1)
+            return 1;
+    }
+
+    double *samples = malloc(BENCH_MAX_SAMPLES * sizeof(double));
+    if (samples == NULL)
+        return 1;
+
+    int first = 1;
+    printf("{\n  \"benchmark\": \"piechart_bench\",\n  \"min_seconds\": %g,\n  \"allocations_counted\": %s,\n"
+           "  \"results\": [\n", min_seconds, COUNTING_ALLOCATIONS ? "true" : "false");
+    for (int c = 0; c < counts_count; c++)
+    {
+        Workload workload;
+        if (workload_init(&workload, counts[c], label_length))
+        {
+            fprintf(stderr, "Cannot build the workload of %d segments\n", counts[c]);
+            return 1;
+        }
+
+        // The stages that do not draw once per chart, the others once per canvas size
+        for (int s = 0; s < sizes_count; s++)
+        {
+            if (workload_set_size(&workload, widths[s], heights[s]))
+            {
+                fprintf(stderr, "Cannot draw %d segments at %dx%d\n", counts[c], widths[s], heights[s]);
+                return 1;
+            }
+            for (int i = 0; i < stages_count; i++)
+            {
+                if ((stages[i].canvas || s == 0) && (only == NULL || strcmp(only, stages[i].name) == 0))
+                    measure(&stages[i], &workload, label_length, min_seconds, samples, &first);
+            }
+        }
+        workload_free(&workload);
+    }
+    printf("\n  ]\n}\n");
+    free(samples);
+    return 0;
+}
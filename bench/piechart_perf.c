@@ -0,0 +1,547 @@
+/**
+ * @file piechart_perf.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Performance regression gate: golden charts checked against committed baselines.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "controller.h"
+#include "utils.h"
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * @brief Default number of timed runs of a chart, the median one is kept.
+ */
+#define PERF_RUNS 7
+
+/**
+ * @brief Default tolerated ratio of the cost of a chart to its baseline.
+ */
+#define PERF_TIME_TOLERANCE 1.75
+
+/**
+ * @brief Slowdown always tolerated, whatever the ratio: the jitter of a chart of a few microseconds.
+ */
+#define PERF_TIME_SLACK_MS 1.0
+
+/**
+ * @brief Default tolerated ratio of the peak resident memory of a chart to its baseline.
+ */
+#define PERF_RSS_TOLERANCE 1.3
+
+/**
+ * @brief Longest line of the golden file, the arguments of a chart included.
+ */
+#define PERF_MAX_LINE 65536
+
+/**
+ * @brief Maximum number of arguments of a golden chart.
+ */
+#define PERF_MAX_ARGS 4096
+
+/**
+ * @brief Bytes of the buffer of the calibration kernel.
+ */
+#define CALIBRATION_BYTES (4 * 1024 * 1024)
+
+/**
+ * @brief A golden chart: its arguments and its baseline, "-" for a field not measured yet.
+ */
+typedef struct PerfWorkload
+{
+    char *name;
+    char *cost;   ///< Time of a chart divided by the time of the calibration kernel.
+    char *rss;    ///< Peak resident memory in KB.
+    char *hash;   ///< FNV-1a of the pixels of the chart (of its bytes besides PNG), 16 hex digits.
+    char *args[PERF_MAX_ARGS];
+    int args_count;
+} PerfWorkload;
+
+/**
+ * @brief What the child process measured for a chart.
+ */
+typedef struct PerfResult
+{
+    double cost;
+    double milliseconds;
+    long rss;
+    uint64_t hash;
+} PerfResult;
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+static uint32_t load_be32(const unsigned char *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+/**
+ * @brief Hashes the RGB pixels of a PNG: the same image hashes the same whatever the encoder and its settings.
+ *
+ * Only what the program writes is decoded: 8-bit RGB or palette of 1 to 8 bits, not interlaced.
+ *
+ * @return 0 on success, 1 if the PNG is invalid or of another kind.
+ */
+static int hash_png_pixels(const unsigned char *png, size_t length, uint64_t *hash)
+{
+    unsigned char palette[3 * 256] = {0};
+    unsigned width = 0, height = 0, depth = 0, color_type = 0;
+    unsigned char *compressed = NULL;
+    size_t compressed_length = 0;
+    int failed = length < 8 || memcmp(png, "\x89PNG\r\n\x1a\n", 8) != 0;
+    for (size_t offset = 8; !failed && offset + 12 <= length;)
+    {
+        uint32_t size = load_be32(png + offset);
+        const unsigned char *type = png + offset + 4, *data = png + offset + 8;
+        if (size > length - offset - 12)
+            break;
+        if (memcmp(type, "IHDR", 4) == 0 && size >= 13)
+        {
+            width = load_be32(data);
+            height = load_be32(data + 4);
+            depth = data[8];
+            color_type = data[9];
+            failed = data[12] != 0 || !((color_type == 2 && depth == 8) || (color_type == 3 && depth <= 8));
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+            memcpy(palette, data, size < sizeof(palette) ? size : sizeof(palette));
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            unsigned char *grown = realloc(compressed, compressed_length + size);
+            failed = grown == NULL;
+            if (grown)
+            {
+                memcpy(grown + compressed_length, data, size);
+                compressed = grown;
+                compressed_length += size;
+            }
+        }
+        offset += 12 + (size_t)size;
+    }
+
+    size_t bpp = color_type == 2 ? 3 : 1, row_bytes = color_type == 2 ? 3 * (size_t)width : (width * depth + 7) / 8;
+    uLongf raw_length = (row_bytes + 1) * height;
+    unsigned char *raw = failed || width == 0 ? NULL : malloc(raw_length);
+    unsigned char *previous = raw ? calloc(row_bytes, 1) : NULL, *pixels = raw ? malloc(3 * (size_t)width) : NULL;
+    failed = failed || !pixels || !previous ||
+             uncompress(raw, &raw_length, compressed, compressed_length) != Z_OK ||
+             raw_length != (row_bytes + 1) * height;
+
+    *hash = 0xcbf29ce484222325ULL;
+    for (unsigned y = 0; y < height && !failed; y++)
+    {
+        unsigned char filter = raw[y * (row_bytes + 1)], *row = raw + y * (row_bytes + 1) + 1;
+        for (size_t i = 0; i < row_bytes; i++)
+        {
+            int left = i >= bpp ? row[i - bpp] : 0, up = previous[i], corner = i >= bpp ? previous[i - bpp] : 0;
+            int estimate = left + up - corner;
+            int to_left = abs(estimate - left), to_up = abs(estimate - up), to_corner = abs(estimate - corner);
+            switch (filter)
+            {
+            case 1:
+                row[i] += left;
+                break;
+            case 2:
+                row[i] += up;
+                break;
+            case 3:
+                row[i] += (left + up) / 2;
+                break;
+            case 4:
+                row[i] += to_left <= to_up && to_left <= to_corner ? left : to_up <= to_corner ? up : corner;
+                break;
+            }
+        }
+        failed = filter > 4;
+        memcpy(previous, row, row_bytes);
+
+        for (unsigned x = 0; x < width; x++)
+        {
+            if (color_type == 2)
+                memcpy(pixels + 3 * x, row + 3 * x, 3);
+            else
+            {
+                unsigned shift = 8 - depth * (x % (8 / depth) + 1);
+                memcpy(pixels + 3 * x, palette + 3 * ((row[x * depth / 8] >> shift) & ((1 << depth) - 1)), 3);
+            }
+        }
+        *hash = fnv1a(*hash, pixels, 3 * (size_t)width);
+    }
+    free(compressed);
+    free(raw);
+    free(previous);
+    free(pixels);
+    return failed;
+}
+
+/**
+ * @brief Hashes an output file: the pixels of a PNG, the bytes of any other format.
+ */
+static int hash_output(const char *path, uint64_t *hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 1;
+    unsigned char *bytes = NULL;
+    size_t length = 0, capacity = 0, read;
+    int failed = 0;
+    do
+    {
+        if (length == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 1 << 20;
+            unsigned char *grown = realloc(bytes, capacity);
+            if (grown == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            bytes = grown;
+        }
+        read = fread(bytes + length, 1, capacity - length, file);
+        length += read;
+    } while (read > 0);
+    fclose(file);
+
+    if (!failed)
+    {
+        if (length >= 8 && memcmp(bytes, "\x89PNG", 4) == 0)
+            failed = hash_png_pixels(bytes, length, hash);
+        else
+            *hash = fnv1a(0xcbf29ce484222325ULL, bytes, length);
+    }
+    free(bytes);
+    return failed;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Median of timed runs, which it sorts: steadier than the fastest run, which a
+ * lucky run can make unreachable, and than the mean, which one preempted run can skew.
+ */
+static double median(double *times, int count)
+{
+    qsort(times, count, sizeof(double), compare_doubles);
+    return count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+}
+
+/**
+ * @brief Time of a fixed amount of memory and integer work: charts are timed in units of it.
+ *
+ * Dividing by it removes most of the difference between machines, and between a quiet
+ * and a busy run of the same machine.
+ */
+static double calibrate(void)
+{
+    unsigned char *buffer = malloc(CALIBRATION_BYTES);
+    if (buffer == NULL)
+        return 0;
+    double times[PERF_RUNS];
+    volatile uint64_t sink = 0;
+    for (int run = 0; run < PERF_RUNS; run++)
+    {
+        double start = monotonic_seconds();
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (int pass = 0; pass < 4; pass++)
+        {
+            for (size_t i = 0; i < CALIBRATION_BYTES; i++)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                buffer[i] = (unsigned char)state;
+            }
+            sink = fnv1a(sink, buffer, CALIBRATION_BYTES);
+        }
+        times[run] = monotonic_seconds() - start;
+    }
+    free(buffer);
+    return median(times, PERF_RUNS);
+}
+
+/**
+ * @brief Renders a chart through handle_input(), like the program does for its command line.
+ */
+static int run_chart(const PerfWorkload *workload, const char *output)
+{
+    char *argv[PERF_MAX_ARGS + 4];
+    int argc = 0;
+    argv[argc++] = "PieChart";
+    for (int i = 0; i < workload->args_count; i++)
+        argv[argc++] = workload->args[i];
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)output;
+    argv[argc] = NULL;
+
+    ControllerData data;
+    controller_init(&data);
+    int result = handle_input(argc, argv, &data);
+    controller_cleanup(&data);
+    return result;
+}
+
+/**
+ * @brief Measures a chart in the calling process, meant to be a child of its own.
+ */
+static int measure_chart(const PerfWorkload *workload, int runs, PerfResult *result)
+{
+    char path[] = "/tmp/piechart-perf-XXXXXX";
+    int descriptor = mkstemp(path);
+    if (descriptor < 0)
+        return 1;
+    close(descriptor);
+
+    // The first run loads the font and sizes the buffers, and writes the output that is hashed
+    int failed = run_chart(workload, path) || hash_output(path, &result->hash);
+    unlink(path);
+
+    double *times = malloc(runs * sizeof(double));
+    failed = failed || times == NULL;
+    for (int run = 0; run < runs && !failed; run++)
+    {
+        double start = monotonic_seconds();
+        failed = run_chart(workload, "/dev/null");
+        times[run] = monotonic_seconds() - start;
+    }
+    double elapsed = failed ? 0 : median(times, runs);
+    free(times);
+    double unit = calibrate();
+    result->milliseconds = elapsed * 1e3;
+    result->cost = unit > 0 ? elapsed / unit : 0;
+    return failed || unit <= 0;
+}
+
+/**
+ * @brief Measures a chart in a child process: its peak resident memory is its own.
+ */
+static int measure_in_child(const PerfWorkload *workload, int runs, PerfResult *result)
+{
+    int channel[2];
+    if (pipe(channel))
+        return 1;
+    fflush(NULL);
+    pid_t child = fork();
+    if (child < 0)
+        return 1;
+    if (child == 0)
+    {
+        close(channel[0]);
+        int failed = measure_chart(workload, runs, result);
+        if (!failed && write(channel[1], result, sizeof(*result)) != (ssize_t)sizeof(*result))
+            failed = 1;
+        _exit(failed);
+    }
+
+    close(channel[1]);
+    ssize_t received = read(channel[0], result, sizeof(*result));
+    close(channel[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        received != (ssize_t)sizeof(*result))
+        return 1;
+    result->rss = usage.ru_maxrss; // KB on Linux
+    return 0;
+}
+
+/**
+ * @brief Splits a line of the golden file: name, cost, rss, hash, then the arguments of the chart.
+ *
+ * @return 1 for a chart, 0 for a comment or a blank line, -1 if the line is malformed.
+ */
+static int parse_workload(char *line, PerfWorkload *workload)
+{
+    char *fields[4 + PERF_MAX_ARGS], *token, *save;
+    int count = 0;
+    for (token = strtok_r(line, " \t\r\n", &save); token && count < 4 + PERF_MAX_ARGS;
+         token = strtok_r(NULL, " \t\r\n", &save))
+        fields[count++] = token;
+    if (count == 0 || fields[0][0] == '#')
+        return 0;
+    if (count < 5 || token)
+        return -1;
+
+    workload->name = fields[0];
+    workload->cost = fields[1];
+    workload->rss = fields[2];
+    workload->hash = fields[3];
+    workload->args_count = count - 4;
+    memcpy(workload->args, fields + 4, workload->args_count * sizeof(char *));
+    return 1;
+}
+
+/**
+ * @brief Compares a measure with its baseline, prints the verdict and returns 1 on a regression.
+ */
+static int check_workload(const PerfWorkload *workload, const PerfResult *result, double time_tolerance,
+                          double rss_tolerance)
+{
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)result->hash);
+    printf("%s: %.2f ms, cost %.4g, peak RSS %ld KB, hash %s\n", workload->name, result->milliseconds, result->cost,
+           result->rss, hash);
+
+    if (strcmp(workload->cost, "-") == 0 || strcmp(workload->rss, "-") == 0 || strcmp(workload->hash, "-") == 0)
+    {
+        printf("%s: no baseline, run with --update\n", workload->name);
+        return 1;
+    }
+
+    int failed = 0;
+    double cost = atof(workload->cost), rss = atof(workload->rss);
+    double milliseconds_per_cost = result->cost > 0 ? result->milliseconds / result->cost : 0;
+    if (result->cost > cost * time_tolerance &&
+        (result->cost - cost * time_tolerance) * milliseconds_per_cost > PERF_TIME_SLACK_MS)
+    {
+        printf("%s: TIME REGRESSION, cost %.4g against %.4g (x%.2f, tolerance x%.2f)\n", workload->name, result->cost,
+               cost, result->cost / cost, time_tolerance);
+        failed = 1;
+    }
+    if (result->rss > rss * rss_tolerance)
+    {
+        printf("%s: MEMORY REGRESSION, %ld KB against %.0f KB (x%.2f, tolerance x%.2f)\n", workload->name,
+               result->rss, rss, result->rss / rss, rss_tolerance);
+        failed = 1;
+    }
+    if (strcmp(hash, workload->hash) != 0)
+    {
+        printf("%s: OUTPUT CHANGED, hash %s against %s\n", workload->name, hash, workload->hash);
+        failed = 1;
+    }
+    return failed;
+}
+
+static int usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--update] [--runs N] [--time-tolerance X] [--rss-tolerance X] GOLDEN_FILE [NAME...]\n",
+            program);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    int update = 0, runs = PERF_RUNS, first_name = 0;
+    double time_tolerance = PERF_TIME_TOLERANCE, rss_tolerance = PERF_RSS_TOLERANCE;
+    const char *golden = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = 1;
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--time-tolerance") == 0 && i + 1 < argc)
+            time_tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rss-tolerance") == 0 && i + 1 < argc)
+            rss_tolerance = atof(argv[++i]);
+        else if (argv[i][0] == '-')
+            return usage(argv[0]);
+        else if (golden == NULL)
+            golden = argv[i];
+        else
+        {
+            first_name = i;
+            break;
+        }
+    }
+    if (golden == NULL || runs < 1 || time_tolerance < 1 || rss_tolerance < 1)
+        return usage(argv[0]);
+
+    FILE *file = fopen(golden, "r");
+    if (file == NULL)
+    {
+        perror(golden);
+        return 2;
+    }
+
+    // The file is kept line by line: --update rewrites the baselines and nothing else
+    char **lines = NULL, line[PERF_MAX_LINE];
+    int lines_count = 0, failed = 0, checked = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        char **grown = realloc(lines, (lines_count + 1) * sizeof(char *));
+        if (grown == NULL || (grown[lines_count] = strdup(line)) == NULL)
+            return 2;
+        lines = grown;
+        lines_count++;
+    }
+    fclose(file);
+
+    for (int l = 0; l < lines_count; l++)
+    {
+        char copy[PERF_MAX_LINE];
+        PerfWorkload workload;
+        strcpy(copy, lines[l]);
+        int parsed = parse_workload(copy, &workload);
+        if (parsed < 0)
+        {
+            fprintf(stderr, "%s:%d: expected NAME COST RSS HASH ARGUMENTS...\n", golden, l + 1);
+            return 2;
+        }
+        int selected = parsed && first_name == 0;
+        for (int i = first_name; parsed && i && i < argc; i++)
+            selected |= strcmp(argv[i], workload.name) == 0;
+        if (!selected)
+            continue;
+
+        PerfResult result;
+        checked++;
+        if (measure_in_child(&workload, runs, &result))
+        {
+            printf("%s: FAILED to render\n", workload.name);
+            failed = 1;
+            continue;
+        }
+        if (!update)
+        {
+            failed |= check_workload(&workload, &result, time_tolerance, rss_tolerance);
+            continue;
+        }
+
+        // The new baseline, followed by the arguments as they were written
+        char baseline[PERF_MAX_LINE];
+        const char *arguments = lines[l] + (workload.args[0] - copy);
+        snprintf(baseline, sizeof(baseline), "%s %.4g %ld %016llx %s", workload.name, result.cost, result.rss,
+                 (unsigned long long)result.hash, arguments);
+        free(lines[l]);
+        lines[l] = strdup(baseline);
+        printf("%s: %.2f ms, cost %.4g, peak RSS %ld KB, hash %016llx (updated)\n", workload.name,
+               result.milliseconds, result.cost, result.rss, (unsigned long long)result.hash);
+    }
+
+    if (update && !failed)
+    {
+        file = fopen(golden, "w");
+        for (int l = 0; file && l < lines_count; l++)
+            fputs(lines[l] ? lines[l] : "", file);
+        failed = file == NULL || fclose(file) != 0;
+    }
+    for (int l = 0; l < lines_count; l++)
+        free(lines[l]);
+    free(lines);
+
+    if (checked == 0)
+    {
+        fprintf(stderr, "No chart selected in %s\n", golden);
+        return 2;
+    }
+    return failed;
+}
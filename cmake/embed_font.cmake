@@ -0,0 +1,11 @@
+# Writes a C source holding a font file as a byte array.
+# Usage: cmake -DINPUT=<font file> -DOUTPUT=<C file> -P embed_font.cmake
+
+file(READ "${INPUT}" hex HEX)
+file(SIZE "${INPUT}" size)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+file(WRITE "${OUTPUT}"
+    "/* Generated from ${INPUT} by cmake/embed_font.cmake, do not edit. */\n"
+    "#include <stddef.h>\n"
+    "const unsigned char embedded_font[] = {${bytes}};\n"
+    "const size_t embedded_font_size = ${size};\n")
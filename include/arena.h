@@ -0,0 +1,83 @@
+/**
+ * @file arena.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Bump allocator releasing everything it handed out at once.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Smallest block an arena allocates.
+ */
+#define ARENA_MIN_BLOCK (16 * 1024)
+
+/**
+ * @brief Largest block an arena keeps when it is reset: a huge chart does not pin its memory.
+ */
+#define ARENA_MAX_KEPT_BLOCK (4 * 1024 * 1024)
+
+/**
+ * @brief A block of an arena, followed by its bytes.
+ */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next; ///< The block filled before this one.
+    size_t size;             ///< Bytes after the header.
+    size_t used;
+} ArenaBlock;
+
+/**
+ * @brief Memory of one chart: allocations are bumped from the current block and never
+ * freed one by one.
+ *
+ * A reset keeps the current block, so once it has grown to the size of a typical chart,
+ * parsing further charts does not allocate anymore.
+ */
+typedef struct Arena
+{
+    ArenaBlock *current; ///< The block being filled, the largest one.
+} Arena;
+
+/**
+ * @brief Initializes an empty arena without allocating.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_init(Arena *arena);
+
+/**
+ * @brief Allocates from the arena, aligned for any type.
+ *
+ * The memory stays valid until arena_reset() or arena_free().
+ *
+ * @param arena Pointer to the arena.
+ * @param size The number of bytes.
+ * @return The memory, or NULL if the allocation failed.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Releases every allocation at once.
+ *
+ * The current block is kept for the next allocations unless it is larger than
+ * ARENA_MAX_KEPT_BLOCK; the blocks filled before it are freed.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Releases the memory of the arena.
+ *
+ * @param arena Pointer to the arena.
+ */
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
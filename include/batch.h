@@ -0,0 +1,97 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "controller.h"
+
+/**
+ * @brief Splits a chart specification line into command-line style arguments.
+ *
+ * The line is tokenized in place on whitespace. Double quotes group several words into a
+ * single argument (e.g. a title containing spaces). argv[0] is set to program_name so the
+ * result can be handed to render_chart() exactly like the program's own command line.
+ *
+ * @param line The specification line, modified in place.
+ * @param program_name The value stored in argv[0].
+ * @param argv Pointer to a growable argument array (may point to NULL initially).
+ * @param capacity Pointer to the current capacity of *argv.
+ * @return int The number of arguments stored in *argv (including argv[0]), or -1 on allocation error.
+ */
+int split_spec_line(char *line, char *program_name, char ***argv, int *capacity);
+
+/**
+ * @brief Options of a batch run, read from the command line.
+ */
+typedef struct BatchOptions
+{
+    const char *manifest_path; ///< Path of the manifest file.
+    char *program_name;        ///< Program name used as argv[0] for each chart.
+    int jobs;                  ///< Number of worker threads rendering charts.
+    uint64_t seed;             ///< Base seed from which each chart derives its colors.
+    bool pipeline;             ///< Run parse, render, encode and write as separate stages.
+    int queue_depth;           ///< Capacity of the queues between pipeline stages.
+} BatchOptions;
+
+/**
+ * @brief One chart of the manifest waiting to be rendered.
+ */
+typedef struct BatchJob
+{
+    int line_number; ///< Line of the manifest describing the chart.
+    char *spec;      ///< The specification line itself.
+} BatchJob;
+
+/**
+ * @brief Reads the batch options following --batch on the command line.
+ *
+ * Accepted form: --batch <manifest> [--jobs N] [--seed S] [--pipeline] [--queue-depth N].
+ * A value of 0 for --jobs uses one worker per online CPU. Without --seed the seed is
+ * taken from the clock. --pipeline selects the staged pipeline of run_pipeline().
+ *
+ * @param argc The number of command line arguments.
+ * @param argv Command line arguments.
+ * @param options Pointer to the BatchOptions structure to fill in.
+ * @return 0 on success, 1 if the arguments are invalid.
+ */
+int parse_batch_options(int argc, char **argv, BatchOptions *options);
+
+/**
+ * @brief Loads every chart specification of a manifest file.
+ *
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * @param manifest_path Path of the manifest file.
+ * @param jobs Pointer receiving the allocated array of jobs.
+ * @param count Pointer receiving the number of jobs.
+ * @return 0 on success, 1 on error.
+ */
+int load_manifest(const char *manifest_path, BatchJob **jobs, int *count);
+
+/**
+ * @brief Frees the jobs returned by load_manifest().
+ *
+ * @param jobs The array of jobs.
+ * @param count The number of jobs.
+ */
+void free_manifest(BatchJob *jobs, int count);
+
+/**
+ * @brief Renders every chart listed in a manifest file within the current process.
+ *
+ * Each non empty line of the manifest describes one chart with the same fields as the
+ * command line: output path, values, labels and an optional title (-T / --titre).
+ * Lines starting with '#' are ignored. The charts are spread over a pool of worker
+ * threads, each owning its own ControllerData and color generator seeded from the
+ * line number, so a chart gets the same colors whatever the number of workers.
+ * Each worker starts with a contiguous block of the manifest in its own work-stealing
+ * deque and steals from the others once it runs dry, so a few expensive charts don't
+ * leave the other workers idle. Per-worker statistics (jobs run, jobs stolen, idle time)
+ * and the throughput in charts per second are printed on stderr at the end.
+ * With --pipeline the charts go through run_pipeline() instead.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv Command line arguments, starting with --batch at argv[1].
+ * @return 0 if every chart was rendered, 1 otherwise.
+ */
+int run_batch(int argc, char **argv);
+
+#endif // BATCH_H
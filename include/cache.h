@@ -0,0 +1,114 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "output.h"
+
+/**
+ * @brief One encoded chart kept by the cache.
+ */
+typedef struct CacheEntry
+{
+    uint64_t hash;
+    unsigned char *key;            ///< Normalized chart specification.
+    size_t key_length;
+    unsigned char *value;          ///< Encoded image.
+    size_t value_length;
+    struct CacheEntry *bucket_next; ///< Next entry of the same hash bucket.
+    struct CacheEntry *newer;      ///< LRU list, towards the most recently used entry.
+    struct CacheEntry *older;      ///< LRU list, towards the least recently used entry.
+} CacheEntry;
+
+/**
+ * @brief Content-addressed cache of encoded charts.
+ *
+ * Entries are found by the hash of their key and checked against the full key, so a
+ * hash collision can never return the wrong image. The memory used by the entries is
+ * bounded, the least recently used ones being evicted first. When a directory is
+ * given, entries are also stored on disk and survive the process; the store is only
+ * bounded once cache_set_disk_limit() is called, the files used least recently being
+ * deleted first. All the functions are thread-safe.
+ */
+typedef struct PieChartCache
+{
+    pthread_mutex_t lock;
+    CacheEntry **buckets;
+    size_t bucket_count;           ///< Power of two, doubled when the entries outnumber it.
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    size_t bytes;                  ///< Memory used by keys and values.
+    size_t max_bytes;
+    int entries;
+    char *directory;               ///< On-disk store, NULL for memory only.
+    pthread_mutex_t disk_lock;     ///< Held while the size of the store is updated or reduced.
+    size_t disk_bytes;             ///< Size of the files of the store, as last counted.
+    size_t max_disk_bytes;         ///< Bound on disk_bytes, 0 for an unbounded store.
+    long hits;
+    long disk_hits;
+    long misses;
+    long evictions;
+    long disk_evictions;           ///< Files deleted from the store to keep it under its bound.
+} RenderCache;
+
+/**
+ * @brief Creates a cache.
+ *
+ * @param max_bytes Bound on the memory used by the entries.
+ * @param directory Directory of the on-disk store (created if needed), or NULL.
+ * @return RenderCache* The cache, or NULL on error.
+ */
+RenderCache *cache_create(size_t max_bytes, const char *directory);
+
+/**
+ * @brief Destroys a cache and its in-memory entries. The on-disk store is kept.
+ *
+ * @param cache The cache, may be NULL.
+ */
+void cache_destroy(RenderCache *cache);
+
+/**
+ * @brief Bounds the on-disk store, deleting the least recently used files beyond it.
+ *
+ * The files already in the directory are counted, so a bound set at startup applies to
+ * the store left by previous runs. A lookup served from disk marks its file as used.
+ *
+ * @param cache The cache.
+ * @param max_bytes Bound on the size of the files, 0 for an unbounded store.
+ */
+void cache_set_disk_limit(RenderCache *cache, size_t max_bytes);
+
+/**
+ * @brief 64-bit FNV-1a hash of a key.
+ *
+ * @param key The key.
+ * @param length The length of the key.
+ * @return uint64_t The hash.
+ */
+uint64_t cache_hash(const void *key, size_t length);
+
+/**
+ * @brief Looks a key up and copies the cached value into out on a hit.
+ *
+ * @param cache The cache.
+ * @param key The key.
+ * @param length The length of the key.
+ * @param out Buffer receiving the value, replacing its content.
+ * @return true on a hit, false on a miss.
+ */
+bool cache_lookup(RenderCache *cache, const void *key, size_t length, OutputBuffer *out);
+
+/**
+ * @brief Stores a value, replacing any previous value of the same key.
+ *
+ * @param cache The cache.
+ * @param key The key.
+ * @param key_length The length of the key.
+ * @param value The value.
+ * @param value_length The length of the value.
+ */
+void cache_store(RenderCache *cache, const void *key, size_t key_length, const void *value, size_t value_length);
+
+#endif // CACHE_H
@@ -4,34 +4,128 @@
 #include <unistd.h> // Pour accéder à la fonction access()
 #include <stdbool.h>
 #include "model.h"
-#include "view.h"
+#include "piechart.h"
+#include "profile.h"
+#include "utils.h"
+
+/**
+ * @brief How the colors of the segments are chosen.
+ */
+typedef enum ColorMode
+{
+    COLORS_RANDOM, ///< Random colors, different for every chart (default).
+    COLORS_SEEDED, ///< Colors drawn from a fixed seed: the same for every chart.
+    COLORS_LABEL   ///< Colors derived from the labels: the same label always gets the same color.
+} ColorMode;
+
+/**
+ * @brief Rendering options shared by every chart of the process.
+ * 
+ * They are read from the command line by extract_render_options() and apply to every
+ * ControllerData initialized afterwards.
+ */
+typedef struct RenderOptions
+{
+    ColorMode color_mode;
+    uint64_t color_seed;  ///< Seed of COLORS_SEEDED.
+    bool streaming;       ///< Generate the PNG row by row instead of drawing on a canvas.
+    bool antialias;       ///< Draw on a truecolor canvas with anti-aliased edges.
+    PieChartFormat format; ///< Format of the encoded charts.
+    bool format_given;    ///< --format was given: the extension of the output file does not choose the format.
+    bool compressing;     ///< Encode the PNG canvases with compression instead of libgd.
+    PieChartCompression compression; ///< Settings of the PNG compression, when compressing.
+    int width, height;    ///< Size of the charts before scaling.
+    double scale;         ///< Pixels per unit of width and height.
+    PieChartSize sizes[PIECHART_MAX_SIZES]; ///< Sizes every chart is rendered at, instead of the single size.
+    int sizes_count;      ///< Number of sizes, 0 for the single size.
+    size_t cache_size;    ///< Memory bound of the render cache in bytes, 0 without cache.
+    char *cache_dir;      ///< Directory of the on-disk render cache, or NULL.
+    size_t cache_dir_size; ///< Bound of the on-disk render cache in bytes, 0 for none.
+    PieChartCache *cache; ///< Render cache shared by every ControllerData, or NULL.
+    bool profiling;       ///< Time the stages of every chart, see ChartProfile.
+    char *profile_file;   ///< File receiving the profile lines, or NULL for the standard error.
+} RenderOptions;
 
 /**
  * @brief Structure representing the data required by the controller.
  * 
  * This structure contains all the information needed to operate the controller. 
- * of the controller. It includes an image, an array of pie chart segments, 
- * and the number of these segments.
+ * of the controller. It includes the renderer of the piechart library, an array of
+ * pie chart segments allocated with their labels from the arena of the data, the
+ * number of these segments, the state of the color generator
+ * and, for the chart being rendered, its output file, title and encoded PNG.
+ * The renderer keeps its canvas and output buffer from one chart to the next.
+ * Each thread rendering charts owns its own ControllerData.
  */
 typedef struct {
-    gdImagePtr img;
+    PieChartRenderer *renderer;
     PieChartSegment *segments;
     int segments_count;
+    Arena arena;              ///< Segments and labels of the current chart, reset by controller_reset().
+    uint64_t color_state;
+    ColorMode color_mode;
+    uint64_t color_seed;      ///< Seed of COLORS_SEEDED.
+    const PieChartSize *sizes; ///< Sizes each chart is rendered at by render_chart(), see RenderOptions.
+    int sizes_count;          ///< Number of sizes, 0 for the single size.
+    PieChartCache *cache;     ///< Shared render cache, or NULL.
+    bool cache_hit;           ///< The PNG of the current chart came from the cache.
+    char *output_file;        ///< Output path of the current chart.
+    PieChartFormat format;    ///< Format of the current chart, from the options or the extension of output_file.
+    char *base_name;          ///< Program base name, used as the default title.
+    char *title;              ///< Title of the current chart (points into argv or base_name).
+    const unsigned char *png; ///< Encoded PNG of the current chart, owned by the renderer.
+    size_t png_size;          ///< Size of png in bytes.
+    ChartProfile profile;     ///< Timings of the current chart, written by controller_reset() when profiling.
 } ControllerData;
 
 /**
  * @brief Controller initialization.
  * 
- * This function initializes controller data by setting pointers to NULL and integers to zero.
+ * This function initializes controller data by setting pointers to NULL and integers to zero,
+ * creates its renderer, seeds the color generator from the current time and applies the
+ * rendering options set by controller_configure().
  * @param data Pointer to a ControllerData structure to be initialized.
  */
 void controller_init(ControllerData *data);
 
+/**
+ * @brief Removes the rendering options from the command line and reads them.
+ * 
+ * Accepted options, anywhere on the command line: --colors random|label|seed:N,
+ * --stream, --antialias, --format png|svg|qoi|ppm|rgba|indexed, --size WIDTHxHEIGHT, --scale S,
+ * --sizes WIDTHxHEIGHT[@S][,...], --cache-size MB, --cache-dir DIR, --png-level 0-9,
+ * --png-strategy default|filtered|huffman|rle|fixed, --png-threads N, --profile and
+ * --profile-file FILE. Any of the --png options selects the parallel PNG encoder, see
+ * piechart_renderer_set_compression(); --profile-file implies --profile.
+ * argv is compacted in place.
+ * 
+ * @param argc Pointer to the number of command line arguments, updated.
+ * @param argv Command line arguments.
+ * @param options Pointer to the RenderOptions structure to fill in.
+ * @return 0 on success, 1 if an option is invalid.
+ */
+int extract_render_options(int *argc, char **argv, RenderOptions *options);
+
+/**
+ * @brief Sets the rendering options applied by controller_init().
+ * 
+ * @param options The options, copied.
+ */
+void controller_configure(const RenderOptions *options);
+
+/**
+ * @brief Returns the rendering options set by controller_configure().
+ * 
+ * @return The options.
+ */
+const RenderOptions *controller_options(void);
+
 /**
  * @brief Handles user-supplied input.
  * 
  * This function analyzes the command line arguments to determine the name of the output file, 
- * title and pie chart segments. It then generates the image and saves it.
+ * title and pie chart segments. It then generates the image and saves it. With --profile,
+ * the profile of every chart is written before it returns.
  * 
  * @param argc The number of command line arguments.
  * @param argv Command line arguments.
@@ -40,10 +134,93 @@ void controller_init(ControllerData *data);
  */
 int handle_input(int argc, char **argv, ControllerData *data);
 
+/**
+ * @brief Renders a single chart described by command-line style arguments.
+ * 
+ * The arguments follow the same layout as the program's own command line (argv[0] is the
+ * program name). The parsed segments and the rendered image are kept in data until
+ * controller_reset() or controller_cleanup() is called. With several sizes, the chart is
+ * parsed once and rendered at each size by render_chart_sizes().
+ * 
+ * @param argc The number of arguments.
+ * @param argv The arguments describing the chart.
+ * @param data Pointer to a ControllerData structure receiving the segments and the image.
+ * @return 0 on success, 1 on error.
+ */
+int render_chart(int argc, char **argv, ControllerData *data);
+
+/**
+ * @brief Renders the parsed chart at each size of data->sizes and writes the images.
+ * 
+ * The segments, colors and title are shared by every size. The image of each size is
+ * written next to the output file, its name suffixed with the size: chart.png gives
+ * chart-300x200.png, or chart-300x200@2x.png at scale 2. The render cache is not used.
+ * 
+ * @param data Pointer to a ControllerData structure filled by parse_chart().
+ * @return 0 on success, 1 on error.
+ */
+int render_chart_sizes(ControllerData *data);
+
+/**
+ * @brief Parses a chart description and assigns the segment colors.
+ * 
+ * First step of render_chart(): fills the output file, title and segments of data.
+ * Without an output file, the chart is named after the program with the extension of
+ * the format. The title may point into argv, which must stay valid until the chart is drawn.
+ * 
+ * @param argc The number of arguments.
+ * @param argv The arguments describing the chart.
+ * @param data Pointer to the ControllerData structure to fill in.
+ * @return 0 on success, 1 on error.
+ */
+int parse_chart(int argc, char **argv, ControllerData *data);
+
+/**
+ * @brief Draws the parsed chart on the canvas of data->renderer.
+ * 
+ * With a render cache, the encoded chart is looked up first and nothing is drawn on a hit.
+ * 
+ * @param data Pointer to a ControllerData structure filled by parse_chart().
+ * @return 0 on success, 1 on error.
+ */
+int draw_chart(ControllerData *data);
+
+/**
+ * @brief Encodes the drawn image in the format of the options into data->png.
+ * 
+ * The image is stored in the render cache, if any. Nothing is done on a cache hit.
+ * 
+ * @param data Pointer to a ControllerData structure filled by draw_chart().
+ * @return 0 on success, 1 on error.
+ */
+int encode_chart(ControllerData *data);
+
+/**
+ * @brief Writes the encoded PNG to the output file of the chart.
+ * 
+ * An output file named "-" streams the image to the standard output.
+ * 
+ * @param data Pointer to a ControllerData structure filled by encode_chart().
+ * @return 0 on success, 1 on error.
+ */
+int write_chart(ControllerData *data);
+
+/**
+ * @brief Releases the segments and file names of the last rendered chart.
+ * 
+ * When profiling, the profile of the chart is written first as one JSON line.
+ * After this call the controller data can be reused to render another chart.
+ * The renderer is kept with its canvas and output buffer, the arena with its block.
+ * 
+ * @param data Pointer to the ControllerData structure to be reset.
+ */
+void controller_reset(ControllerData *data);
+
 /**
  * @brief Cleans up resources or status associated with the controller.
  * 
- * This function frees all memory allocated while the application is running.
+ * This function frees all memory allocated while the application is running,
+ * including the renderer.
  * 
  * @param data Pointer to the ControllerData structure to be cleaned up.
  */
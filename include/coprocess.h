@@ -0,0 +1,26 @@
+#ifndef COPROCESS_H
+#define COPROCESS_H
+
+#include "controller.h"
+
+#define COPROCESS_MAX_FRAME (16 * 1024 * 1024)
+#define COPROCESS_STATUS_PNG 'P'
+#define COPROCESS_STATUS_ERROR 'E'
+
+/**
+ * @brief Runs the co-process loop: charts are read from stdin and written to stdout.
+ *
+ * Every request frame is a 4-byte big-endian length followed by a chart specification
+ * with the same fields as the command line (values, labels and -T title). Every
+ * response frame is a 4-byte big-endian payload length, a status byte and the payload:
+ * COPROCESS_STATUS_PNG followed by the image (in the format of --format), or
+ * COPROCESS_STATUS_ERROR followed by an error message. The loop ends when stdin is closed between two frames.
+ * Diagnostics are written on stderr only, stdout carries nothing but frames.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv Command line arguments, starting with --coprocess at argv[1].
+ * @return 0 when stdin is closed cleanly, 1 on a truncated or oversized frame.
+ */
+int run_coprocess(int argc, char **argv);
+
+#endif // COPROCESS_H
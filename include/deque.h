@@ -0,0 +1,74 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/**
+ * @brief Fixed capacity work-stealing deque of job indices (Chase-Lev).
+ *
+ * The owning thread pushes and pops at the bottom without locks, other threads
+ * steal from the top with a single compare-and-swap.
+ */
+typedef struct WorkDeque
+{
+    atomic_long top;     ///< Next index to steal, only ever incremented.
+    atomic_long bottom;  ///< Next index to push, owned by the owner thread.
+    long mask;           ///< Capacity - 1, the capacity being a power of two.
+    atomic_int *buffer;  ///< Circular buffer of job indices.
+} WorkDeque;
+
+/**
+ * @brief Outcome of a steal attempt.
+ */
+typedef enum StealResult
+{
+    STEAL_EMPTY,   ///< The deque had no job.
+    STEAL_ABORT,   ///< Another thread took the job first, the deque may still hold jobs.
+    STEAL_SUCCESS  ///< A job was stolen.
+} StealResult;
+
+/**
+ * @brief Initializes a deque able to hold at least capacity jobs.
+ *
+ * @param deque Pointer to the deque to initialize.
+ * @param capacity The minimum number of jobs the deque must hold.
+ * @return true on success, false if the allocation failed.
+ */
+bool deque_init(WorkDeque *deque, long capacity);
+
+/**
+ * @brief Frees the buffer of a deque.
+ *
+ * @param deque Pointer to the deque.
+ */
+void deque_destroy(WorkDeque *deque);
+
+/**
+ * @brief Pushes a job at the bottom of the deque. Owner thread only.
+ *
+ * @param deque Pointer to the deque.
+ * @param job The job index.
+ * @return true on success, false if the deque is full.
+ */
+bool deque_push(WorkDeque *deque, int job);
+
+/**
+ * @brief Pops the most recently pushed job. Owner thread only.
+ *
+ * @param deque Pointer to the deque.
+ * @param job Pointer receiving the job index.
+ * @return true if a job was popped, false if the deque is empty.
+ */
+bool deque_pop(WorkDeque *deque, int *job);
+
+/**
+ * @brief Steals the oldest job of the deque. Any thread.
+ *
+ * @param deque Pointer to the deque.
+ * @param job Pointer receiving the job index on success.
+ * @return StealResult The outcome of the attempt.
+ */
+StealResult deque_steal(WorkDeque *deque, int *job);
+
+#endif // DEQUE_H
@@ -0,0 +1,152 @@
+/**
+ * @file display.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Display list: the primitives of a chart, independent of the backend drawing them.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "piechart.h"
+
+/**
+ * @brief Kind of a display list primitive.
+ */
+typedef enum DisplayKind
+{
+    DISPLAY_WEDGE, ///< A filled pie slice, outlined along its arc and both radii.
+    DISPLAY_LINE,  ///< A one pixel wide line.
+    DISPLAY_TEXT   ///< A run of text on a baseline.
+} DisplayKind;
+
+/**
+ * @brief One primitive of a display list, in canvas pixels with y pointing down.
+ */
+typedef struct DisplayItem
+{
+    DisplayKind kind;
+    PieChartColor color;  ///< Fill of a wedge, color of a line or of a text.
+    PieChartColor stroke; ///< Outline of a wedge.
+    bool pie;     ///< Wedge or median tick of the pie: raster backends draw them in one pass from the pie geometry.
+    union
+    {
+        struct
+        {
+            double cx, cy, radius;
+            double start, end; ///< Angles in degrees, clockwise from the x axis.
+        } wedge;
+        struct
+        {
+            double x0, y0, x1, y1;
+        } line;
+        struct
+        {
+            int x, y;      ///< Origin of the text, on its baseline.
+            double size;   ///< Font size in points.
+            size_t offset; ///< Position of the NUL-terminated UTF-8 text in the text pool of the list.
+            size_t length; ///< Number of bytes of the text.
+        } text;
+    };
+} DisplayItem;
+
+/**
+ * @brief The primitives of a chart, in drawing order.
+ *
+ * A list keeps its allocations when it is reset: once it has held a chart, the next
+ * charts of the same shape are recorded without allocating. The texts are copied in
+ * the list, which does not depend on the strings it was built from.
+ */
+typedef struct DisplayList
+{
+    int width, height; ///< Size of the canvas in pixels.
+    PieChartColor background;  ///< Color of the whole canvas, painted before the primitives.
+    DisplayItem *items;
+    int count;
+    int capacity;
+    char *text;        ///< Text pool.
+    size_t text_length;
+    size_t text_capacity;
+} DisplayList;
+
+/**
+ * @brief Initializes an empty list without allocating.
+ *
+ * @param list Pointer to the list.
+ */
+void display_list_init(DisplayList *list);
+
+/**
+ * @brief Empties the list for a new chart, keeping its allocations.
+ *
+ * @param list Pointer to the list.
+ * @param width The width of the canvas in pixels.
+ * @param height The height of the canvas in pixels.
+ * @param background The color of the canvas.
+ */
+void display_list_reset(DisplayList *list, int width, int height, PieChartColor background);
+
+/**
+ * @brief Releases the memory of the list.
+ *
+ * @param list Pointer to the list.
+ */
+void display_list_free(DisplayList *list);
+
+/**
+ * @brief Appends a wedge.
+ *
+ * @param list Pointer to the list.
+ * @param cx The x-coordinate of the center.
+ * @param cy The y-coordinate of the center.
+ * @param radius The radius.
+ * @param start The start angle in degrees.
+ * @param end The end angle in degrees, start + 360 at most.
+ * @param color The fill color.
+ * @param stroke The outline color.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int display_list_add_wedge(DisplayList *list, double cx, double cy, double radius, double start, double end, PieChartColor color,
+                           PieChartColor stroke);
+
+/**
+ * @brief Appends a line.
+ *
+ * @param list Pointer to the list.
+ * @param x0 The x-coordinate of the first end.
+ * @param y0 The y-coordinate of the first end.
+ * @param x1 The x-coordinate of the second end.
+ * @param y1 The y-coordinate of the second end.
+ * @param color The color of the line.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int display_list_add_line(DisplayList *list, double x0, double y0, double x1, double y1, PieChartColor color);
+
+/**
+ * @brief Appends a text run, copied in the list.
+ *
+ * @param list Pointer to the list.
+ * @param text The UTF-8 text.
+ * @param size The font size in points.
+ * @param x The x-coordinate of the text origin.
+ * @param y The y-coordinate of the text baseline.
+ * @param color The color of the text.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int display_list_add_text(DisplayList *list, const char *text, double size, int x, int y, PieChartColor color);
+
+/**
+ * @brief Returns the text of a text run.
+ *
+ * @param list Pointer to the list.
+ * @param item A DISPLAY_TEXT item of the list.
+ * @return The NUL-terminated text, valid until the list is modified.
+ */
+const char *display_item_text(const DisplayList *list, const DisplayItem *item);
+
+#endif // DISPLAY_H
@@ -0,0 +1,89 @@
+/**
+ * @file encoder.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief PNG encoder compressing bands of rows in parallel into a single zlib stream.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stddef.h>
+#include <gd.h>
+#include "piechart.h"
+#include "output.h"
+
+/**
+ * @brief Smallest band of raw bytes worth a thread of its own.
+ */
+#define PNG_MIN_BAND_BYTES (512 * 1024)
+
+/**
+ * @brief Largest number of bands an image is split into.
+ */
+#define PNG_MAX_BANDS 64
+
+/**
+ * @brief PNG color types written by the encoders.
+ */
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_PALETTE 3
+
+/**
+ * @brief Compression settings of the encoders.
+ */
+typedef struct PngOptions
+{
+    int level;    ///< zlib level, 0 to 9, or Z_DEFAULT_COMPRESSION.
+    int strategy; ///< zlib strategy, Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE or Z_FIXED.
+    int threads;  ///< Threads compressing an image, 0 for one per online processor.
+} PngOptions;
+
+/**
+ * @brief Writes a PNG chunk: length, type, data and CRC of the type and data.
+ *
+ * @param write The function receiving the bytes.
+ * @param context The first argument of write.
+ * @param type The four letters of the chunk type.
+ * @param data The data of the chunk, may be NULL when length is 0.
+ * @param length The number of bytes of data.
+ * @return 0 on success, 1 if write failed.
+ */
+int png_write_chunk(PieChartWriteFn write, void *context, const char *type, const unsigned char *data, size_t length);
+
+/**
+ * @brief Writes the start of a PNG: signature, IHDR and pHYs chunks.
+ *
+ * @param write The function receiving the bytes.
+ * @param context The first argument of write.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param depth The number of bits per sample (per palette index for PNG_COLOR_PALETTE).
+ * @param color_type PNG_COLOR_RGB or PNG_COLOR_PALETTE.
+ * @param dpi The resolution in dots per inch, the same on both axes.
+ * @return 0 on success, 1 if write failed.
+ */
+int png_write_header(PieChartWriteFn write, void *context, int width, int height, int depth, int color_type, int dpi);
+
+/**
+ * @brief Encodes an image as PNG into the buffer, replacing its content.
+ *
+ * The rows are split into bands of at least PNG_MIN_BAND_BYTES raw bytes, one per thread,
+ * each deflated on its own thread like pigz does: every band is primed with the last 32 KB
+ * of the previous one as dictionary and ends on a sync flush, so the bands concatenate
+ * into one valid zlib stream, written as one IDAT chunk per band; the checksums of the
+ * bands are combined at the end. A small image is a single band compressed by the
+ * calling thread. Palette images are written with 1, 2, 4 or 8 bits per pixel like
+ * libgd, truecolor ones as RGB with the Sub filter.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @param options The compression settings.
+ * @return 0 on success, 1 on error.
+ */
+int png_encode_image(OutputBuffer *buffer, gdImagePtr img, const PngOptions *options);
+
+#endif // ENCODER_H
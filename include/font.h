@@ -0,0 +1,90 @@
+/**
+ * @file font.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Glyph atlases: text measured and rasterized from glyphs cached per font size.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stddef.h>
+
+/**
+ * @brief Font loaded at run time when none was compiled into the library (PIECHART_EMBEDDED_FONT).
+ */
+#define FONT_PATH "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf"
+
+/**
+ * @brief Resolution the font sizes in points are converted at, the one of libgd.
+ */
+#define FONT_DPI 96
+
+/**
+ * @brief Number of font sizes a thread keeps glyphs for, the least recently used is dropped beyond.
+ */
+#define FONT_MAX_ATLASES 16
+
+/**
+ * @brief A glyph of a laid out text: its coverage at its place on the canvas.
+ */
+typedef struct PlacedGlyph
+{
+    int x, y;                       ///< Position of the top left corner of the coverage.
+    int width, height;
+    const unsigned char *coverage;  ///< width * height coverage values, 255 for a fully covered pixel.
+} PlacedGlyph;
+
+/**
+ * @brief A text laid out by font_layout_text().
+ */
+typedef struct TextLayout
+{
+    const PlacedGlyph *glyphs; ///< The glyphs with a coverage, in text order.
+    int count;
+    int brect[8];              ///< Bounding rectangle, corners in the order of gdImageStringFT().
+} TextLayout;
+
+/**
+ * @brief Measures a text, like gdImageStringFT() with a NULL image.
+ *
+ * The width of a glyph is its cached advance: once the glyphs of a text have been seen at
+ * a size, measuring it only reads tables.
+ *
+ * @param text The UTF-8 text.
+ * @param size The font size in points.
+ * @param x The x-coordinate of the text origin.
+ * @param y The y-coordinate of the text baseline.
+ * @param brect Receives the bounding rectangle: lower left, lower right, upper right and upper left corners.
+ * @return 0 on success, 1 if the font cannot be loaded.
+ */
+int font_measure_text(const char *text, double size, int x, int y, int brect[8]);
+
+/**
+ * @brief Lays a text out: the coverage of each of its glyphs and where it goes.
+ *
+ * Each glyph is rasterized once per font size and kept in the atlas of that size. The
+ * atlases belong to the calling thread: threads never wait for each other, and a layout
+ * stays valid until the next call to a font function from the same thread. FreeType and
+ * the font are only loaded by the first non-empty text of a thread.
+ *
+ * @param layout Pointer receiving the layout.
+ * @param text The UTF-8 text.
+ * @param size The font size in points.
+ * @param x The x-coordinate of the text origin.
+ * @param y The y-coordinate of the text baseline.
+ * @return 0 on success, 1 if the font cannot be loaded or the allocation failed.
+ */
+int font_layout_text(TextLayout *layout, const char *text, double size, int x, int y);
+
+/**
+ * @brief Counts the glyphs rasterized in the atlases of the calling thread.
+ *
+ * @return The number of glyphs, over every font size.
+ */
+int font_cached_glyphs(void);
+
+#endif // FONT_H
@@ -2,56 +2,46 @@
 #define MODEL_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "piechart.h"
+#include "arena.h"
 
 
 /**
- * @brief Structure to represent a color in the RGB color space.
- * 
- * This structure is used to define a color using its red (r), green (g), and blue (b) components.
- * It can be used to represent a specific color for various graphical elements.
- */
-typedef struct Color
-{
-    int r; ///< Red component of the color, in the range 0-255.
-    int g; ///< Green component of the color, in the range 0-255.
-    int b; ///< Blue component of the color, in the range 0-255.
-} Color;
-
-
-/**
- * @brief Structure to represent a segment in a pie chart.
- * 
- * This structure is used to define a segment of a pie chart, including
- * its percentage representation, label, and color. 
+ * @brief Longest label kept, in bytes: longer labels are truncated.
  */
-typedef struct PieChartSegment
-{
-    double percentage;      ///< The percentage that this segment represents in the pie chart.
-    char *label;         ///< The label for this segment (e.g., the name of the category).
-    Color color;    ///< The color used to draw this segment in the pie chart.
-} PieChartSegment;
-
-/**
- * @brief Frees the memory associated with pie chart segments.
- *
- * @param segments A pointer to an array of PieChartSegments.
- * @param length The total number of pie chart segments.
- */
-void free_segments(PieChartSegment *segments, int length);
-
+#define MAX_LABEL_LENGTH 255
 
 /**
  * @brief Parses pie chart segments from input strings.
  *        This function extracts the percentages and labels from the command-line input
  *        and creates an array of PieChartSegment structures to represent each segment of a pie chart.
  * 
+ * The segments and their labels are a single allocation from the arena: the array of
+ * segments followed by a pool of the labels packed one after the other, which every
+ * label points into. They are released with the arena, all at once.
+ * 
  * @param input  An array of strings, where input[2] contains the comma-separated percentages
  *               and input[3] contains the comma-separated labels for each pie chart segment.
  * @param length A pointer to an integer to store the total number of pie chart segments.
+ * @param arena  The arena the segments and labels are allocated from.
  * @return       A pointer to an array of PieChartSegment structures representing the segments of the pie chart,
  *               or NULL if an allocation error occurs.
  */
-PieChartSegment *parse_segments(char **input, int *length, int argc, bool output_file_name);
+PieChartSegment *parse_segments(char **input, int *length, int argc, bool output_file_name, Arena *arena);
+
+/**
+ * @brief Rewrites the arguments so that an explicit "-o <path>" option becomes the
+ *        positional output file expected by the other parsing functions.
+ *        The path "-" designates the standard output.
+ * 
+ * @param argc Count of command-line arguments.
+ * @param argv Array of command-line arguments.
+ * @param normalized_argc Pointer receiving the count of rewritten arguments.
+ * @return char** A dynamically allocated, NULL terminated array pointing to the original strings,
+ *                or NULL if allocation fails. Only the array has to be freed.
+ */
+char **normalize_arguments(int argc, char **argv, int *normalized_argc);
 
 /**
  * @brief Generates the output file name based on provided arguments or executable name.
@@ -106,9 +96,34 @@ bool has_arguments(int argc);
 /**
  * @brief Generates a random RGB color.
  * 
- * @return       A Color structure representing the randomly generated RGB color,
+ * The generator state is owned by the caller, so concurrent callers using their own
+ * state never interfere and the same initial state always yields the same colors.
+ * 
+ * @param state  Pointer to the generator state, advanced by each call.
+ * @return       A PieChartColor structure representing the randomly generated RGB color,
  *               with red, green, and blue components ranging from 0 to 255.
  */
-Color generate_random_color();
+PieChartColor generate_random_color(uint64_t *state);
+
+/**
+ * @brief Derives an independent generator state from a base seed and an index.
+ * 
+ * Used to give every chart of a run its own reproducible color sequence, whatever
+ * the thread or the order in which the charts are rendered.
+ * 
+ * @param seed   The base seed of the run.
+ * @param index  The index of the chart (e.g. its line number in a manifest).
+ * @return       The generator state for this index.
+ */
+uint64_t derive_color_seed(uint64_t seed, uint64_t index);
+
+/**
+ * @brief Assigns a random color to every segment of a pie chart.
+ * 
+ * @param segments A pointer to an array of PieChartSegments.
+ * @param length   The total number of pie chart segments.
+ * @param state    Pointer to the generator state used for the colors.
+ */
+void assign_segment_colors(PieChartSegment *segments, int length, uint64_t *state);
 
 #endif // MODEL_H
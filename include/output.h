@@ -0,0 +1,79 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <gd.h>
+
+/**
+ * @brief Growable in-memory buffer receiving an encoded image.
+ *
+ * The buffer keeps its allocation between charts: once it has grown to the size of
+ * a typical image, encoding further charts does not allocate anymore.
+ */
+typedef struct OutputBuffer
+{
+    unsigned char *data; ///< Encoded bytes.
+    size_t length;       ///< Number of valid bytes in data.
+    size_t capacity;     ///< Allocated size of data.
+} OutputBuffer;
+
+/**
+ * @brief Initializes an empty buffer without allocating.
+ *
+ * @param buffer Pointer to the buffer.
+ */
+void output_buffer_init(OutputBuffer *buffer);
+
+/**
+ * @brief Empties the buffer but keeps its allocation for the next chart.
+ *
+ * @param buffer Pointer to the buffer.
+ */
+void output_buffer_reset(OutputBuffer *buffer);
+
+/**
+ * @brief Releases the memory of the buffer.
+ *
+ * @param buffer Pointer to the buffer.
+ */
+void output_buffer_free(OutputBuffer *buffer);
+
+/**
+ * @brief Makes sure the buffer can hold capacity bytes.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param capacity The number of bytes needed.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int output_buffer_reserve(OutputBuffer *buffer, size_t capacity);
+
+/**
+ * @brief Appends bytes at the end of the buffer.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param bytes The bytes to append.
+ * @param length The number of bytes.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int output_buffer_append(OutputBuffer *buffer, const void *bytes, size_t length);
+
+/**
+ * @brief Encodes an image as PNG into the buffer, replacing its content.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @return 0 on success, 1 on error.
+ */
+int output_buffer_encode_png(OutputBuffer *buffer, gdImagePtr img);
+
+/**
+ * @brief Writes encoded bytes to a file, or to stdout when path is "-".
+ *
+ * @param bytes The bytes to write.
+ * @param length The number of bytes.
+ * @param path The output path, "-" for the standard output.
+ * @return 0 on success, 1 on error.
+ */
+int write_output(const void *bytes, size_t length, const char *path);
+
+#endif // OUTPUT_H
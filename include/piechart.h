@@ -0,0 +1,490 @@
+#ifndef PIECHART_H
+#define PIECHART_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Marks the functions exported by the shared library.
+ *
+ * The library is built with hidden visibility: only the functions of this header are
+ * exported, the modules behind them stay internal and cannot clash with the application.
+ */
+#if defined(__GNUC__)
+#define PIECHART_API __attribute__((visibility("default")))
+#else
+#define PIECHART_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Structure to represent a color in the RGB color space.
+ * 
+ * This structure is used to define a color using its red (r), green (g), and blue (b) components.
+ * It can be used to represent a specific color for various graphical elements.
+ */
+typedef struct PieChartColor
+{
+    int r; ///< Red component of the color, in the range 0-255.
+    int g; ///< Green component of the color, in the range 0-255.
+    int b; ///< Blue component of the color, in the range 0-255.
+} PieChartColor;
+
+
+/**
+ * @brief Structure to represent a segment in a pie chart.
+ * 
+ * This structure is used to define a segment of a pie chart, including
+ * its percentage representation, label, and color. 
+ */
+typedef struct PieChartSegment
+{
+    double percentage;      ///< The percentage that this segment represents in the pie chart.
+    char *label;         ///< The label for this segment (e.g., the name of the category).
+    PieChartColor color;    ///< The color used to draw this segment in the pie chart.
+} PieChartSegment;
+
+/**
+ * @brief Long-lived rendering context of the piechart library.
+ * 
+ * A renderer owns the canvas, which is reused from one chart to the next, and the
+ * buffer receiving the encoded image. A renderer must only be used by one thread at
+ * a time; threads rendering in parallel each create their own.
+ */
+typedef struct PieChartRenderer PieChartRenderer;
+
+/**
+ * @brief Function receiving the bytes of a streamed chart.
+ * 
+ * @param context The context given with the function.
+ * @param bytes The bytes to write.
+ * @param length The number of bytes.
+ * @return 0 on success, non-zero to abort the rendering.
+ */
+typedef int (*PieChartWriteFn)(void *context, const unsigned char *bytes, size_t length);
+
+/**
+ * @brief Format of the charts encoded by a renderer.
+ */
+typedef enum PieChartFormat
+{
+    PIECHART_FORMAT_PNG,    ///< Raster image, drawn on a canvas or streamed (default).
+    PIECHART_FORMAT_SVG,    ///< Vector document, written from the primitives of the chart without any rasterization.
+    PIECHART_FORMAT_QOI,    ///< "Quite OK Image": runs and small differences, no deflate.
+    PIECHART_FORMAT_PPM,    ///< Binary PPM (P6): a short header and 3 bytes per pixel.
+    PIECHART_FORMAT_RGBA,   ///< Raw dump, 4 bytes per pixel, no header.
+    PIECHART_FORMAT_INDEXED ///< Raw dump of a palette canvas: 256 RGBA entries, then 1 index byte per pixel.
+} PieChartFormat;
+
+/**
+ * @brief zlib strategy of the PNG compression, see piechart_renderer_set_compression().
+ */
+typedef enum PieChartStrategy
+{
+    PIECHART_STRATEGY_DEFAULT,      ///< zlib Z_DEFAULT_STRATEGY.
+    PIECHART_STRATEGY_FILTERED,     ///< zlib Z_FILTERED.
+    PIECHART_STRATEGY_HUFFMAN_ONLY, ///< zlib Z_HUFFMAN_ONLY: no string matching at all.
+    PIECHART_STRATEGY_RLE,          ///< zlib Z_RLE: matches of repeated bytes only, suited to the constant runs of a pie.
+    PIECHART_STRATEGY_FIXED         ///< zlib Z_FIXED: no dynamic Huffman codes.
+} PieChartStrategy;
+
+/**
+ * @brief PNG compression settings of a renderer.
+ */
+typedef struct PieChartCompression
+{
+    int level;                 ///< 0 (fastest) to 9 (smallest), -1 for the zlib default (6).
+    PieChartStrategy strategy;
+    int threads;               ///< Threads compressing one canvas, 0 for one per online processor.
+} PieChartCompression;
+
+/**
+ * @brief Maximum number of sizes rendered by one call to piechart_render_sizes().
+ */
+#define PIECHART_MAX_SIZES 8
+
+/**
+ * @brief A size a chart is rendered at, see piechart_renderer_set_size().
+ */
+typedef struct PieChartSize
+{
+    int width;    ///< Width of the chart before scaling.
+    int height;   ///< Height of the chart before scaling.
+    double scale; ///< Pixels per unit of width and height: 1 for standard, 2 for retina.
+} PieChartSize;
+
+/**
+ * @brief Function receiving the image of a chart rendered at one of several sizes.
+ * 
+ * @param context The context given with the function.
+ * @param index The index of the size in the requested sizes.
+ * @param png The encoded bytes in the format of the renderer, only valid during the call.
+ * @param length The number of bytes.
+ * @return 0 on success, non-zero to abort the rendering.
+ */
+typedef int (*PieChartSizeFn)(void *context, int index, const unsigned char *png, size_t length);
+
+/**
+ * @brief Content-addressed cache of encoded charts, shared by any number of renderers.
+ */
+typedef struct PieChartCache PieChartCache;
+
+/**
+ * @brief Counters of a PieChartCache.
+ */
+typedef struct PieChartCacheStats
+{
+    long hits;       ///< Lookups answered from memory.
+    long disk_hits;  ///< Lookups answered from the on-disk store.
+    long misses;     ///< Lookups that required a render.
+    long evictions;  ///< Entries dropped to respect the memory bound.
+    int entries;     ///< Entries currently in memory.
+    size_t bytes;    ///< Memory currently used by the entries.
+    long disk_evictions; ///< Files deleted to respect the bound of the on-disk store.
+} PieChartCacheStats;
+
+/**
+ * @brief Creates a renderer.
+ * 
+ * It is safe to create renderers from several threads. The font is loaded by each
+ * thread the first time it draws a text, with its own glyph atlases.
+ * 
+ * @return PieChartRenderer* The new renderer, or NULL if the allocation failed.
+ *         Release it with piechart_renderer_destroy().
+ */
+PIECHART_API PieChartRenderer *piechart_renderer_create(void);
+
+/**
+ * @brief Destroys a renderer and everything it owns.
+ * 
+ * @param renderer The renderer, may be NULL.
+ */
+PIECHART_API void piechart_renderer_destroy(PieChartRenderer *renderer);
+
+/**
+ * @brief Releases the canvas of the renderer, keeping the last encoded image.
+ * 
+ * Useful to bound memory when many renderers wait with an encoded chart.
+ * 
+ * @param renderer The renderer.
+ */
+PIECHART_API void piechart_renderer_trim(PieChartRenderer *renderer);
+
+/**
+ * @brief Switches the renderer between the canvas and the streaming rendering paths.
+ * 
+ * In streaming mode, piechart_draw() only records the chart and piechart_encode_png()
+ * generates the PNG row by row from the geometry (see piechart_stream_png()), without
+ * any canvas. The segments and title given to piechart_draw() must then stay valid until
+ * piechart_encode_png() returns. The streaming path draws exact segment angles and
+ * produces an RGB image, so its output differs slightly from the canvas path.
+ * 
+ * @param renderer The renderer.
+ * @param enabled Non-zero to stream, zero to draw on a canvas (default).
+ */
+PIECHART_API void piechart_renderer_set_streaming(PieChartRenderer *renderer, int enabled);
+
+/**
+ * @brief Switches the canvas of the renderer between a palette and an anti-aliased truecolor image.
+ * 
+ * Anti-aliased, the chart is drawn on a truecolor canvas: the coverage of the pixels on
+ * the edge of the pie and on the lines is computed exactly, the interior is filled as
+ * usual, and the texts are blended in. The PNG is larger than the palette one. The
+ * streaming path is not anti-aliased.
+ * 
+ * @param renderer The renderer.
+ * @param enabled Non-zero for anti-aliased edges, zero for a palette canvas (default).
+ */
+PIECHART_API void piechart_renderer_set_antialias(PieChartRenderer *renderer, int enabled);
+
+/**
+ * @brief Sets the size of the charts drawn by the renderer.
+ * 
+ * The chart is width x height multiplied by scale pixels, each side between 16 and 16384
+ * pixels, and its PNG records a resolution of 96 x scale dots per inch. The layout is
+ * proportional to the canvas: the pie, the font sizes of the labels and of the title and
+ * their positions follow its size, so a small chart is proportionally cheaper to draw and
+ * to encode. The default is 2400 x 1600 at scale 1.
+ * 
+ * @param renderer The renderer.
+ * @param width The width of the chart before scaling.
+ * @param height The height of the chart before scaling.
+ * @param scale The number of pixels per unit of width and height, 2 for a high density screen.
+ * @return 0 on success, 1 if the size is out of bounds (the renderer is unchanged).
+ */
+PIECHART_API int piechart_renderer_set_size(PieChartRenderer *renderer, int width, int height, double scale);
+
+/**
+ * @brief Sets how the PNG of the renderer is compressed.
+ * 
+ * By default the canvas is encoded by libgd. With compression settings, it is encoded
+ * by the library instead: the rows are split in bands of at least 512 KB, each deflated
+ * on its own thread with the given level and strategy, and the bands are joined with
+ * sync flushes into a single valid PNG. Small charts stay on the calling thread. The
+ * streaming path uses the level and strategy but compresses on the calling thread, as
+ * its rows are produced.
+ * 
+ * @param renderer The renderer.
+ * @param compression The settings, copied, or NULL to go back to libgd.
+ * @return 0 on success, 1 if a setting is out of range (the renderer is unchanged).
+ */
+PIECHART_API int piechart_renderer_set_compression(PieChartRenderer *renderer, const PieChartCompression *compression);
+
+/**
+ * @brief Sets the format of the charts encoded by the renderer.
+ * 
+ * In SVG, piechart_draw() records the wedges, ticks and texts of the chart, placed like
+ * on a canvas of the size of the renderer, and piechart_encode() writes them as a vector
+ * document: nothing is rasterized nor compressed, which costs a few microseconds where a
+ * PNG costs milliseconds. The viewBox is the canvas in pixels, displayed at the size set
+ * with piechart_renderer_set_size() before scaling. The streaming and anti-aliasing
+ * settings only apply to PNG.
+ * 
+ * QOI, PPM, RGBA and indexed are written straight from the rows of the canvas, without
+ * deflate: for a consumer that composites or encodes the chart again, they cost a
+ * fraction of the PNG. The canvas is always drawn, the streaming setting only applies
+ * to PNG; the anti-aliasing setting applies, except to the indexed dump, which needs
+ * the palette canvas and fails to encode on a truecolor one.
+ * 
+ * @param renderer The renderer.
+ * @param format The format, PIECHART_FORMAT_PNG by default.
+ * @return 0 on success, 1 if the format is unknown (the renderer is unchanged).
+ */
+PIECHART_API int piechart_renderer_set_format(PieChartRenderer *renderer, PieChartFormat format);
+
+/**
+ * @brief Returns the media type of a format, such as "image/png".
+ * 
+ * @param format The format.
+ * @return The media type, or NULL for an unknown format.
+ */
+PIECHART_API const char *piechart_format_content_type(PieChartFormat format);
+
+/**
+ * @brief Returns the usual file extension of a format, without the dot, such as "png".
+ * 
+ * @param format The format.
+ * @return The extension, or NULL for an unknown format.
+ */
+PIECHART_API const char *piechart_format_extension(PieChartFormat format);
+
+/**
+ * @brief Returns the name of a format, as accepted by piechart_format_from_name().
+ * 
+ * @param format The format.
+ * @return The name, or NULL for an unknown format.
+ */
+PIECHART_API const char *piechart_format_name(PieChartFormat format);
+
+/**
+ * @brief Finds a format from its name: png, svg, qoi, ppm, rgba or indexed.
+ * 
+ * @param name The name of the format.
+ * @param format Pointer receiving the format.
+ * @return 0 on success, 1 if the name is unknown.
+ */
+PIECHART_API int piechart_format_from_name(const char *name, PieChartFormat *format);
+
+/**
+ * @brief Finds a format from the extension of a file name, ignoring case.
+ * 
+ * @param path The file name.
+ * @param format Pointer receiving the format.
+ * @return 0 on success, 1 if the extension is missing or unknown.
+ */
+PIECHART_API int piechart_format_from_path(const char *path, PieChartFormat *format);
+
+/**
+ * @brief Assigns a random color to every segment.
+ * 
+ * The generator state is owned by the caller: the same initial state always gives
+ * the same colors.
+ * 
+ * @param segments The segments to color.
+ * @param count The number of segments.
+ * @param state Pointer to the generator state, advanced by the call.
+ */
+PIECHART_API void piechart_assign_random_colors(PieChartSegment *segments, int count, uint64_t *state);
+
+/**
+ * @brief Assigns every segment a color derived from a hash of its label.
+ * 
+ * The same label always gets the same color, in every chart; segments without a label
+ * get a color derived from their position. The chart is then a pure function of its
+ * values, labels and title, which is what makes it cacheable.
+ * 
+ * @param segments The segments to color.
+ * @param count The number of segments.
+ */
+PIECHART_API void piechart_assign_label_colors(PieChartSegment *segments, int count);
+
+/**
+ * @brief Draws a pie chart on the canvas of the renderer.
+ * 
+ * @param renderer The renderer.
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @return 0 on success, 1 on error.
+ */
+PIECHART_API int piechart_draw(PieChartRenderer *renderer, const PieChartSegment *segments, int count, const char *title);
+
+/**
+ * @brief Encodes the last drawn chart in the format of the renderer.
+ * 
+ * @param renderer The renderer.
+ * @param bytes Pointer receiving the encoded bytes, owned by the renderer and valid
+ *              until the next encoding or the destruction of the renderer.
+ * @param length Pointer receiving the number of bytes.
+ * @return 0 on success, 1 on error.
+ */
+PIECHART_API int piechart_encode(PieChartRenderer *renderer, const unsigned char **bytes, size_t *length);
+
+/**
+ * @brief Encodes the last drawn chart as PNG.
+ * 
+ * Same as piechart_encode(), but fails when the renderer is set to another format.
+ * 
+ * @param renderer The renderer.
+ * @param png Pointer receiving the encoded bytes, owned by the renderer and valid
+ *            until the next encoding or the destruction of the renderer.
+ * @param length Pointer receiving the number of bytes.
+ * @return 0 on success, 1 on error.
+ */
+PIECHART_API int piechart_encode_png(PieChartRenderer *renderer, const unsigned char **png, size_t *length);
+
+/**
+ * @brief Draws and encodes a pie chart in one call.
+ * 
+ * @param renderer The renderer.
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @param png Pointer receiving the encoded bytes, see piechart_encode_png().
+ * @param length Pointer receiving the number of bytes.
+ * @return 0 on success, 1 on error.
+ */
+PIECHART_API int piechart_render_png(PieChartRenderer *renderer, const PieChartSegment *segments, int count,
+                                     const char *title, const unsigned char **png, size_t *length);
+
+/**
+ * @brief Renders one chart at several sizes in one call.
+ * 
+ * The chart is laid out from the same segments, colors and title at every size: the
+ * angles of the segments are computed once and only placed at each size, then each image
+ * is drawn at its native resolution (not scaled down from the largest one) with the
+ * canvas or streaming path of the renderer. Each PNG is handed to deliver as soon as it is
+ * encoded, in the order of the sizes. The size set with piechart_renderer_set_size() is
+ * not changed, and the canvases of the sizes are kept for the next call.
+ * 
+ * @param renderer The renderer.
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @param sizes The sizes, each within the bounds of piechart_renderer_set_size().
+ * @param sizes_count The number of sizes, 1 to PIECHART_MAX_SIZES.
+ * @param deliver The function receiving the PNG of each size.
+ * @param context The first argument of deliver.
+ * @return 0 on success, 1 on error, on an invalid size or if deliver failed.
+ */
+PIECHART_API int piechart_render_sizes(PieChartRenderer *renderer, const PieChartSegment *segments, int count, const char *title,
+                                       const PieChartSize *sizes, int sizes_count, PieChartSizeFn deliver, void *context);
+
+/**
+ * @brief Renders a pie chart as PNG without a canvas, handing the bytes to a function.
+ * 
+ * Each row is generated from the pie geometry, the labels and title are composited
+ * over it and the row is compressed immediately: memory stays at a few rows whatever
+ * the size of the chart. The chart has the default size, 2400 x 1600. Safe to call
+ * from several threads at once.
+ * 
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @param write The function receiving the encoded bytes, in order.
+ * @param context The first argument of write.
+ * @return 0 on success, 1 on error or if write failed.
+ */
+PIECHART_API int piechart_stream_png(const PieChartSegment *segments, int count, const char *title,
+                                     PieChartWriteFn write, void *context);
+
+/**
+ * @brief Creates a cache of encoded charts.
+ * 
+ * Charts are identified by their normalized specification (format, canvas size,
+ * values, labels, colors and title). The least recently used charts are evicted once the
+ * memory bound is reached. With a directory, charts are also kept on disk, without bound
+ * unless piechart_cache_set_disk_limit() sets one.
+ * The cache can be shared by renderers running on different threads.
+ * 
+ * @param max_bytes Bound on the memory used by the cached charts.
+ * @param directory Directory of the on-disk store, created if needed, or NULL.
+ * @return PieChartCache* The cache, or NULL on error. Release it with piechart_cache_destroy().
+ */
+PIECHART_API PieChartCache *piechart_cache_create(size_t max_bytes, const char *directory);
+
+/**
+ * @brief Destroys a cache. The on-disk store is kept.
+ * 
+ * @param cache The cache, may be NULL.
+ */
+PIECHART_API void piechart_cache_destroy(PieChartCache *cache);
+
+/**
+ * @brief Bounds the on-disk store of a cache.
+ * 
+ * Beyond the bound, the files used least recently are deleted, those left by previous
+ * runs included, until the store is back to 90% of it. Several processes may share
+ * the directory, each with its own bound.
+ * 
+ * @param cache The cache, created with a directory.
+ * @param max_bytes Bound on the size of the files of the store, 0 for no bound (the default).
+ */
+PIECHART_API void piechart_cache_set_disk_limit(PieChartCache *cache, size_t max_bytes);
+
+/**
+ * @brief Reads the counters of a cache.
+ * 
+ * @param cache The cache.
+ * @param stats Pointer receiving the counters.
+ */
+PIECHART_API void piechart_cache_get_stats(PieChartCache *cache, PieChartCacheStats *stats);
+
+/**
+ * @brief Looks for the encoded image of a chart in the cache, in the format of the renderer.
+ * 
+ * On a hit the image is copied in the output buffer of the renderer, as if it had
+ * been returned by piechart_encode().
+ * 
+ * @param cache The cache.
+ * @param renderer The renderer receiving the image.
+ * @param segments The segments of the chart.
+ * @param count The number of segments.
+ * @param title The title of the chart, may be NULL.
+ * @param png Pointer receiving the encoded bytes on a hit.
+ * @param length Pointer receiving the number of bytes on a hit.
+ * @return 1 on a hit, 0 on a miss.
+ */
+PIECHART_API int piechart_cache_lookup(PieChartCache *cache, PieChartRenderer *renderer, const PieChartSegment *segments,
+                                       int count, const char *title, const unsigned char **png, size_t *length);
+
+/**
+ * @brief Stores the image last encoded by a renderer as the image of a chart.
+ * 
+ * @param cache The cache.
+ * @param renderer The renderer that encoded the chart with piechart_encode().
+ * @param segments The segments of the chart.
+ * @param count The number of segments.
+ * @param title The title of the chart, may be NULL.
+ */
+PIECHART_API void piechart_cache_store(PieChartCache *cache, PieChartRenderer *renderer, const PieChartSegment *segments,
+                                       int count, const char *title);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIECHART_H
@@ -0,0 +1,25 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "batch.h"
+
+/**
+ * @brief Renders the charts of a manifest through a staged pipeline.
+ *
+ * The work of render_chart() is split in four stages connected by bounded queues:
+ * parse (parse_chart), render (draw_chart), encode (encode_chart) and write (write_chart).
+ * Parsing and writing run on one thread each, rendering and encoding on options->jobs
+ * threads each, so the next chart is rasterized while the previous ones are being
+ * compressed and written. The charts in flight are recycled: once written, a chart
+ * hands its renderer and buffers to the next one parsed. The occupancy of each stage
+ * and the depth of each queue are printed on stderr at the end of the run. If a thread
+ * cannot be started, the run is aborted.
+ *
+ * @param options The batch options (number of jobs, queue depth, seed...).
+ * @param jobs The charts of the manifest.
+ * @param job_count The number of charts.
+ * @return 0 if every chart was rendered, 1 otherwise.
+ */
+int run_pipeline(const BatchOptions *options, const BatchJob *jobs, int job_count);
+
+#endif // PIPELINE_H
@@ -0,0 +1,103 @@
+/**
+ * @file probes.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief USDT probes of the "piechart" provider, for bpftrace, perf and SystemTap.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <stdint.h>
+
+/*
+ * Each probe is a nop and an ELF note in .note.stapsdt telling the tracer its address
+ * and where its arguments are: nothing runs unless a tracer patches the nop. The
+ * arguments are converted to int64_t, so every probe argument is an 8-byte signed
+ * integer. The notes come from <sys/sdt.h> when it is installed; otherwise they are
+ * written here in the same format, on x86-64 and AArch64 with GCC or Clang. Elsewhere,
+ * or when built with PIECHART_NO_PROBES, the probes are empty.
+ *
+ *     bpftrace -e 'usdt:./PieChart:piechart:encode_done { @bytes = hist(arg1); }'
+ *     readelf -n PieChart    # lists the probes
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PIECHART_HAS_SDT_H 1
+#endif
+#endif
+
+#if defined(PIECHART_NO_PROBES)
+
+#define PIECHART_PROBE0(name) ((void)0)
+#define PIECHART_PROBE1(name, a) ((void)(a))
+#define PIECHART_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define PIECHART_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+
+#elif defined(PIECHART_HAS_SDT_H)
+
+#include <sys/sdt.h>
+#define PIECHART_PROBE0(name) DTRACE_PROBE(piechart, name)
+#define PIECHART_PROBE1(name, a) DTRACE_PROBE1(piechart, name, (int64_t)(a))
+#define PIECHART_PROBE2(name, a, b) DTRACE_PROBE2(piechart, name, (int64_t)(a), (int64_t)(b))
+#define PIECHART_PROBE3(name, a, b, c) DTRACE_PROBE3(piechart, name, (int64_t)(a), (int64_t)(b), (int64_t)(c))
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+
+/**
+ * @brief The nop of a probe and its note: version 3 of the stapsdt format, like <sys/sdt.h>.
+ *
+ * The note records the address of the nop, of _.stapsdt.base (to relocate it in a
+ * prelinked or PIE binary) and of the semaphore, 0 as there is none.
+ */
+#define PIECHART_PROBE_NOTE(name, arguments)                                          \
+    "990: nop\n"                                                                      \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                     \
+    ".balign 4\n"                                                                     \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                                \
+    "991: .asciz \"stapsdt\"\n"                                                       \
+    "992: .balign 4\n"                                                                \
+    "993: .8byte 990b\n"                                                              \
+    ".8byte _.stapsdt.base\n"                                                         \
+    ".8byte 0\n"                                                                      \
+    ".asciz \"piechart\"\n"                                                           \
+    ".asciz \"" #name "\"\n"                                                          \
+    ".asciz \"" arguments "\"\n"                                                      \
+    "994: .balign 4\n"                                                                \
+    ".popsection\n"                                                                   \
+    ".ifndef _.stapsdt.base\n"                                                        \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"          \
+    ".weak _.stapsdt.base\n"                                                          \
+    ".hidden _.stapsdt.base\n"                                                        \
+    "_.stapsdt.base: .space 1\n"                                                      \
+    ".size _.stapsdt.base, 1\n"                                                       \
+    ".popsection\n"                                                                   \
+    ".endif\n"
+
+// An argument is a register, a constant or a memory operand, written as the tracer reads it
+#define PIECHART_PROBE_ARGUMENT(a) "nor"((int64_t)(a))
+
+#define PIECHART_PROBE0(name) __asm__ __volatile__(PIECHART_PROBE_NOTE(name, ""))
+#define PIECHART_PROBE1(name, a) \
+    __asm__ __volatile__(PIECHART_PROBE_NOTE(name, "-8@%0") ::PIECHART_PROBE_ARGUMENT(a))
+#define PIECHART_PROBE2(name, a, b)                                    \
+    __asm__ __volatile__(PIECHART_PROBE_NOTE(name, "-8@%0 -8@%1") ::PIECHART_PROBE_ARGUMENT(a), \
+                         PIECHART_PROBE_ARGUMENT(b))
+#define PIECHART_PROBE3(name, a, b, c)                                                            \
+    __asm__ __volatile__(PIECHART_PROBE_NOTE(name, "-8@%0 -8@%1 -8@%2") ::PIECHART_PROBE_ARGUMENT(a), \
+                         PIECHART_PROBE_ARGUMENT(b), PIECHART_PROBE_ARGUMENT(c))
+
+#else
+
+#define PIECHART_PROBE0(name) ((void)0)
+#define PIECHART_PROBE1(name, a) ((void)(a))
+#define PIECHART_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define PIECHART_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,144 @@
+/**
+ * @file profile.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Per-chart stage timings and counters, written as one JSON line per chart.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "utils.h"
+
+/**
+ * @brief The timed stages of a chart.
+ *
+ * PROFILE_PARSE, PROFILE_DRAW, PROFILE_ENCODE and PROFILE_WRITE follow each other.
+ * PROFILE_LAYOUT, PROFILE_SEGMENTS and PROFILE_TEXT are parts of the draw, or of the
+ * encode when the PNG is streamed from the geometry.
+ */
+typedef enum ProfileStage
+{
+    PROFILE_PARSE,    ///< Arguments to segments, colors included.
+    PROFILE_LAYOUT,   ///< Display list of the chart: wedges, label and title placement.
+    PROFILE_SEGMENTS, ///< Background, wedges, outline and label lines on the canvas.
+    PROFILE_TEXT,     ///< Labels and title glyphs on the canvas or in text masks.
+    PROFILE_DRAW,     ///< The whole draw, cache lookup included.
+    PROFILE_ENCODE,   ///< The encoding in the output format.
+    PROFILE_WRITE,    ///< The output file written and closed.
+    PROFILE_STAGES
+} ProfileStage;
+
+/**
+ * @brief Timings and counters of one chart.
+ *
+ * Each ControllerData owns one: a chart moving between threads, as in the batch
+ * pipeline, carries its profile along. Nothing is measured unless enabled is set.
+ */
+typedef struct ChartProfile
+{
+    bool enabled;
+    bool started;                  ///< A chart has been parsed since the last profile_reset().
+    double start, end;             ///< Monotonic times of the start of the parse and of the end of the last stage.
+    long long ns[PROFILE_STAGES];  ///< Time spent in each stage in nanoseconds.
+    int glyphs;                    ///< Glyphs drawn or rendered into text masks.
+    size_t bytes;                  ///< Bytes written to the output files.
+} ChartProfile;
+
+/**
+ * @brief Profile the stages of the calling thread are added to, NULL when not profiling.
+ */
+extern _Thread_local ChartProfile *profile_current;
+
+/**
+ * @brief Clears the timings and counters, keeping enabled.
+ *
+ * @param profile Pointer to the profile.
+ */
+void profile_reset(ChartProfile *profile);
+
+/**
+ * @brief Starts a top-level stage of a chart on the calling thread.
+ *
+ * The nested stages measured with profile_start() and profile_stop() until profile_leave()
+ * are added to this profile.
+ *
+ * @param profile Pointer to the profile of the chart.
+ * @return The monotonic time of the start, 0 if the profile is not enabled.
+ */
+double profile_enter(ChartProfile *profile);
+
+/**
+ * @brief Ends a top-level stage started by profile_enter().
+ *
+ * @param profile Pointer to the profile of the chart.
+ * @param stage The stage.
+ * @param start The value returned by profile_enter().
+ */
+void profile_leave(ChartProfile *profile, ProfileStage stage, double start);
+
+/**
+ * @brief Ends a top-level entry whose time is only counted by the nested stages it ran.
+ *
+ * @param profile Pointer to the profile of the chart.
+ */
+void profile_exit(ChartProfile *profile);
+
+/**
+ * @brief Starts a nested stage: reads the clock only while a profile is entered.
+ *
+ * @return The monotonic time, or 0.
+ */
+static inline double profile_start(void)
+{
+    return profile_current ? monotonic_seconds() : 0;
+}
+
+/**
+ * @brief Adds the time since profile_start() to a nested stage.
+ *
+ * @param stage The stage.
+ * @param start The value returned by profile_start().
+ */
+static inline void profile_stop(ProfileStage stage, double start)
+{
+    if (profile_current)
+        profile_current->ns[stage] += (long long)((monotonic_seconds() - start) * 1e9);
+}
+
+/**
+ * @brief Counts glyphs drawn by the current chart.
+ *
+ * @param glyphs The number of glyphs.
+ */
+static inline void profile_count_glyphs(int glyphs)
+{
+    if (profile_current)
+        profile_current->glyphs += glyphs;
+}
+
+/**
+ * @brief Writes a profile as one JSON line.
+ *
+ * The line is written with a single call, so that the lines of charts profiled by
+ * several threads never interleave. Times are in nanoseconds; total_ns runs from the
+ * start of the parse to the end of the last stage, waits between stages included.
+ *
+ * @param stream The stream receiving the line.
+ * @param profile The profile.
+ * @param chart The output file of the chart.
+ * @param format The name of its format.
+ * @param segments Its number of segments.
+ * @param cache_hit The chart came from the render cache.
+ * @return 0 on success, 1 if the write failed.
+ */
+int profile_write(FILE *stream, const ChartProfile *profile, const char *chart, const char *format, int segments,
+                  bool cache_hit);
+
+#endif // PROFILE_H
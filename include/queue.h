@@ -0,0 +1,82 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * @brief Bounded blocking FIFO of pointers shared between pipeline stages.
+ *
+ * Producers block while the queue is full and consumers block while it is empty,
+ * which bounds the number of charts in flight between two stages. The queue also
+ * records how full it was so the slowest stage can be identified.
+ */
+typedef struct BoundedQueue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    void **items;             ///< Circular buffer of capacity items.
+    int capacity;
+    int head;                 ///< Index of the oldest item.
+    int count;                ///< Number of items currently queued.
+    bool closed;              ///< No more items will be pushed.
+    int max_depth;            ///< Highest number of items seen queued.
+    long long depth_sum;      ///< Sum of the depths seen by each push, for the mean depth.
+    long pushes;              ///< Number of items pushed.
+    long full_waits;          ///< Pushes that had to wait for room (or were refused by queue_try_push).
+    long empty_waits;         ///< Pops that had to wait for an item.
+} BoundedQueue;
+
+/**
+ * @brief Initializes a queue holding up to capacity items.
+ *
+ * @param queue Pointer to the queue to initialize.
+ * @param capacity The maximum number of queued items.
+ * @return true on success, false if the allocation failed.
+ */
+bool queue_init(BoundedQueue *queue, int capacity);
+
+/**
+ * @brief Frees the resources of a queue.
+ *
+ * @param queue Pointer to the queue.
+ */
+void queue_destroy(BoundedQueue *queue);
+
+/**
+ * @brief Appends an item, waiting while the queue is full.
+ *
+ * @param queue Pointer to the queue.
+ * @param item The item to append.
+ * @return true on success, false if the queue has been closed.
+ */
+bool queue_push(BoundedQueue *queue, void *item);
+
+/**
+ * @brief Appends an item only if there is room, without waiting.
+ *
+ * @param queue Pointer to the queue.
+ * @param item The item to append.
+ * @return true on success, false if the queue is full or closed.
+ */
+bool queue_try_push(BoundedQueue *queue, void *item);
+
+/**
+ * @brief Removes the oldest item, waiting while the queue is empty.
+ *
+ * @param queue Pointer to the queue.
+ * @return void* The item, or NULL once the queue is closed and drained.
+ */
+void *queue_pop(BoundedQueue *queue);
+
+/**
+ * @brief Marks the queue as closed and wakes up every waiting thread.
+ *
+ * Items already queued can still be popped.
+ *
+ * @param queue Pointer to the queue.
+ */
+void queue_close(BoundedQueue *queue);
+
+#endif // QUEUE_H
@@ -0,0 +1,70 @@
+/**
+ * @file raster.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Raster encoders without deflate: QOI, binary PPM and raw RGBA or indexed dumps.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <gd.h>
+#include "output.h"
+
+/**
+ * @brief Number of palette entries at the start of an indexed dump.
+ */
+#define RASTER_PALETTE_SIZE 256
+
+/**
+ * @brief Encodes an image as QOI into the buffer, replacing its content.
+ *
+ * The "Quite OK Image" format: runs, a 64-entry index of recent colors and small
+ * differences with the previous pixel, each pixel read once from the canvas rows. The
+ * long constant runs of a pie make it a few bytes per row. Written with 4 channels, sRGB.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int qoi_encode(OutputBuffer *buffer, gdImagePtr img);
+
+/**
+ * @brief Encodes an image as binary PPM (P6) into the buffer, replacing its content.
+ *
+ * The header, then 3 bytes per pixel; the alpha channel is dropped.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int ppm_encode(OutputBuffer *buffer, gdImagePtr img);
+
+/**
+ * @brief Dumps the pixels of an image as RGBA into the buffer, replacing its content.
+ *
+ * No header: 4 bytes per pixel, rows from top to bottom, alpha 255 for opaque. The
+ * reader knows the size it asked for.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int rgba_encode(OutputBuffer *buffer, gdImagePtr img);
+
+/**
+ * @brief Dumps a palette image as its palette and indexes into the buffer, replacing its content.
+ *
+ * RASTER_PALETTE_SIZE RGBA entries, the unused ones zero, followed by one index byte
+ * per pixel: the rows of the canvas copied as they are.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param img The image to encode.
+ * @return 0 on success, 1 if the image is truecolor or the allocation failed.
+ */
+int indexed_encode(OutputBuffer *buffer, gdImagePtr img);
+
+#endif // RASTER_H
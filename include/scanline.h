@@ -0,0 +1,125 @@
+/**
+ * @file scanline.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Row by row rasterization of the pie geometry, without a canvas.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#include <stdint.h>
+#include "model.h"
+
+/**
+ * @brief Layout of the pixels of a row.
+ */
+typedef enum PixelFormat
+{
+    PIXELS_RGB,       ///< 3 bytes per pixel, an ink is 0xRRGGBB.
+    PIXELS_PALETTE,   ///< 1 byte per pixel, an ink is a palette index (libgd palette image).
+    PIXELS_TRUECOLOR  ///< One int per pixel, an ink is a libgd truecolor value.
+} PixelFormat;
+
+/**
+ * @brief A median tick of one pixel drawn beyond the edge of the pie.
+ */
+typedef struct ScanLine
+{
+    double x0, y0, x1, y1;
+    int ymin, ymax; ///< Rows the line can touch.
+} ScanLine;
+
+/**
+ * @brief The geometry of a pie chart, rasterized one row at a time from top to bottom.
+ *
+ * Each row of the pie is a handful of constant color runs bounded by the crossings of the
+ * separation lines. Within a half disc the crossings are ordered like the boundary angles,
+ * so a row is walked run by run, the end of each run found by a binary search over the
+ * precomputed fixed-point cotangents of the boundaries: the cost depends on the number of
+ * runs, not on the number of segments. The median ticks are swept with an active edge list.
+ *
+ * Anti-aliased, the interior keeps its color runs: only the pixels within reach of the
+ * circle and of the lines get a coverage, computed from their distance to the exact edge.
+ */
+typedef struct PieGeometry
+{
+    int cx, cy, radius;
+    int count;           ///< Number of segments.
+    double *angles;      ///< count + 1 boundary angles in degrees, increasing from angles[0].
+    uint32_t *bounds;    ///< The boundary angles as pseudo-angles, in 16.16 fixed point.
+    double *cosines;     ///< Cosine of each boundary angle.
+    double *sines;       ///< Sine of each boundary angle.
+    double *medians;     ///< Cosine and sine of the median angle of each segment.
+    int64_t *cotangents; ///< Cotangent of each boundary angle, in 16.16 fixed point.
+    int lower_first;     ///< First boundary strictly between 0 and 180 degrees (below the center).
+    int lower_last;      ///< Last boundary strictly between 0 and 180 degrees.
+    int upper_first;     ///< First boundary strictly between 180 and 360 degrees (above the center).
+    int upper_last;      ///< Last boundary strictly between 180 and 360 degrees.
+    int *inks;           ///< Ink of each segment, 0xRRGGBB until the caller replaces them.
+    int background;      ///< Ink of the pixels outside the pie, white by default.
+    int border;          ///< Ink of the outline and lines, black by default.
+    int antialias;       ///< Analytic anti-aliased edges on PIXELS_TRUECOLOR rows, off by default.
+    ScanLine *lines;     ///< Median ticks, sorted by ymin.
+    int lines_count;
+    int next_line;       ///< First line not yet active.
+    int *active;         ///< Indexes of the ticks crossing the current row.
+    int active_count;
+} PieGeometry;
+
+/**
+ * @brief Computes the geometry of a pie chart.
+ *
+ * Segment angles are accumulated from 0 degrees; a segment overflowing the full circle
+ * is clipped to it.
+ *
+ * @param geometry Pointer to the geometry to initialize.
+ * @param segments The segments with their percentage and color.
+ * @param count The number of segments.
+ * @param cx The x-coordinate of the pie center.
+ * @param cy The y-coordinate of the pie center.
+ * @param radius The radius of the pie.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int pie_geometry_init(PieGeometry *geometry, const PieChartSegment *segments, int count, int cx, int cy, int radius);
+
+/**
+ * @brief Places the pie of a geometry on a canvas, to rasterize it again at another size.
+ *
+ * The boundary tables do not depend on the size: only the median ticks are recomputed.
+ * The rows are then requested from the top again.
+ *
+ * @param geometry Pointer to the geometry.
+ * @param cx The x-coordinate of the pie center.
+ * @param cy The y-coordinate of the pie center.
+ * @param radius The radius of the pie.
+ */
+void pie_geometry_place(PieGeometry *geometry, int cx, int cy, int radius);
+
+/**
+ * @brief Releases the memory of a geometry.
+ *
+ * @param geometry Pointer to the geometry.
+ */
+void pie_geometry_free(PieGeometry *geometry);
+
+/**
+ * @brief Rasterizes one row of the chart.
+ *
+ * The row is painted with the background ink, then the pie segments with whole color runs,
+ * their outline, the separation lines and the median ticks are drawn in the same pass.
+ * Rows must be requested from top to bottom, from the initialization or the last
+ * pie_geometry_place().
+ *
+ * @param geometry Pointer to the geometry.
+ * @param y The row.
+ * @param format The layout of the row pixels, which also gives the meaning of the inks.
+ * @param pixels The row pixels.
+ * @param width The number of pixels of the row.
+ */
+void pie_geometry_fill_row(PieGeometry *geometry, int y, PixelFormat format, void *pixels, int width);
+
+#endif // SCANLINE_H
@@ -0,0 +1,45 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "controller.h"
+
+/**
+ * @brief Options of the render server, read from the command line.
+ */
+typedef struct ServerOptions
+{
+    char *program_name; ///< Program name used as argv[0] for each chart.
+    int port;           ///< TCP port listened on 127.0.0.1.
+    int jobs;           ///< Number of worker threads rendering charts.
+    int queue_depth;    ///< Maximum number of requests waiting for a worker.
+} ServerOptions;
+
+/**
+ * @brief Reads the server options following --serve on the command line.
+ *
+ * Accepted form: --serve [--port P] [--jobs N] [--queue-depth N]. The defaults are
+ * port 8080, one worker per online CPU and 64 waiting requests.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv Command line arguments.
+ * @param options Pointer to the ServerOptions structure to fill in.
+ * @return 0 on success, 1 if the arguments are invalid.
+ */
+int parse_server_options(int argc, char **argv, ServerOptions *options);
+
+/**
+ * @brief Runs a persistent HTTP render server until SIGINT or SIGTERM.
+ *
+ * The server listens on 127.0.0.1 with a single epoll event loop and keep-alive
+ * connections. The body of a POST request is a chart specification with the same
+ * fields as the command line (values, labels and -T title); the response is the
+ * PNG image. Requests are rendered by a fixed pool of workers, each owning its own
+ * ControllerData; when the waiting queue is full the request is answered with 429.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv Command line arguments, starting with --serve at argv[1].
+ * @return 0 on clean shutdown, 1 on error.
+ */
+int run_server(int argc, char **argv);
+
+#endif // SERVER_H
@@ -0,0 +1,75 @@
+/**
+ * @file simd.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Span fill and coverage blending kernels for truecolor pixel rows.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Instruction sets the kernels are written for.
+ */
+typedef enum SimdLevel
+{
+    SIMD_SCALAR, ///< Portable C, always available.
+    SIMD_SSE2,   ///< 4 pixels per step.
+    SIMD_AVX2,   ///< 8 pixels per step.
+    SIMD_LEVELS
+} SimdLevel;
+
+/**
+ * @brief The kernels of one instruction set.
+ *
+ * Pixels are libgd truecolor values: 0xAARRGGBB with a 7 bits alpha, handled as 4
+ * independent bytes. Every level gives exactly the same result.
+ */
+typedef struct SimdKernels
+{
+    const char *name;
+
+    /**
+     * @brief Sets count pixels to color.
+     */
+    void (*fill_span)(uint32_t *pixels, uint32_t color, size_t count);
+
+    /**
+     * @brief Blends color over count pixels, weighted by their coverage (0 to 255):
+     * each byte becomes round((pixel * (255 - coverage) + color * coverage) / 255).
+     */
+    void (*blend_span)(uint32_t *pixels, const unsigned char *coverage, uint32_t color, size_t count);
+} SimdKernels;
+
+/**
+ * @brief Returns the kernels of an instruction set.
+ *
+ * @param level The instruction set.
+ * @return The kernels, or NULL if the processor or the compiler does not support it.
+ */
+const SimdKernels *simd_kernels_for(SimdLevel level);
+
+/**
+ * @brief Returns the kernels of the best instruction set of the processor, detected once.
+ *
+ * @return The kernels, never NULL.
+ */
+const SimdKernels *simd_kernels(void);
+
+/**
+ * @brief Sets count truecolor pixels to color with the best kernel.
+ */
+void fill_span(uint32_t *pixels, uint32_t color, size_t count);
+
+/**
+ * @brief Blends color over count truecolor pixels weighted by their coverage with the best kernel.
+ */
+void blend_span(uint32_t *pixels, const unsigned char *coverage, uint32_t color, size_t count);
+
+#endif // SIMD_H
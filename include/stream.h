@@ -0,0 +1,70 @@
+/**
+ * @file stream.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Streaming PNG encoder generating the rows of a chart from its geometry.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include "model.h"
+#include "scanline.h"
+#include "encoder.h"
+
+/**
+ * @brief Size of the IDAT chunks written by the streaming encoder.
+ */
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Renders a pie chart as an RGB PNG, one row at a time.
+ *
+ * Nothing of the size of the canvas is allocated: every row is generated from the pie
+ * geometry, the labels and the title are composited over it, and the row is compressed
+ * right away. The PNG is handed to the writer in chunks of at most STREAM_CHUNK_SIZE
+ * bytes, which makes very large charts affordable. The layout follows the size of the
+ * chart, see chart_layout_init().
+ *
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @param width The width of the chart in pixels.
+ * @param height The height of the chart in pixels.
+ * @param dpi The resolution recorded in the PNG, in dots per inch.
+ * @param compression The zlib level and strategy (the rows are compressed as they come, on the calling
+ *                    thread), or NULL for the zlib defaults.
+ * @param write The function receiving the encoded bytes.
+ * @param context The first argument of write.
+ * @return 0 on success, 1 on error.
+ */
+int stream_pie_chart(const PieChartSegment *segments, int count, const char *title, int width, int height, int dpi,
+                     const PngOptions *compression, PieChartWriteFn write, void *context);
+
+/**
+ * @brief Renders a pie chart as an RGB PNG from a geometry computed beforehand.
+ *
+ * Like stream_pie_chart(), but the geometry is only placed at the size of the chart,
+ * so one geometry serves a chart streamed at several sizes.
+ *
+ * @param geometry The geometry of the segments, from pie_geometry_init(); its placement and inks are overwritten.
+ * @param segments The segments with their percentage, label (may be NULL) and color.
+ * @param count The number of segments.
+ * @param title The title drawn at the top of the chart, may be NULL.
+ * @param width The width of the chart in pixels.
+ * @param height The height of the chart in pixels.
+ * @param dpi The resolution recorded in the PNG, in dots per inch.
+ * @param compression The zlib level and strategy, or NULL for the zlib defaults.
+ * @param write The function receiving the encoded bytes.
+ * @param context The first argument of write.
+ * @return 0 on success, 1 on error.
+ */
+int stream_pie_chart_geometry(PieGeometry *geometry, const PieChartSegment *segments, int count, const char *title,
+                              int width, int height, int dpi, const PngOptions *compression, PieChartWriteFn write,
+                              void *context);
+
+#endif // STREAM_H
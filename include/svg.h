@@ -0,0 +1,50 @@
+/**
+ * @file svg.h
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief SVG backend: a display list written as a vector document.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef SVG_H
+#define SVG_H
+
+#include "display.h"
+#include "output.h"
+
+/**
+ * @brief Upper bound of the bytes written for the document header and footer.
+ */
+#define SVG_HEADER_BOUND 512
+
+/**
+ * @brief Upper bound of the bytes written for one primitive, besides the bytes of its text.
+ */
+#define SVG_ITEM_BOUND 384
+
+/**
+ * @brief Upper bound of the bytes written for one byte of a text, the length of "&quot;".
+ */
+#define SVG_TEXT_BYTE_BOUND 6
+
+/**
+ * @brief Writes a display list as an SVG document into the buffer, replacing its content.
+ *
+ * The size of the document is bounded from the number of primitives and the length of
+ * the texts before anything is written: the buffer is reserved once, then filled without
+ * any further check or allocation. The coordinates are the pixels of the canvas of the
+ * list, displayed at width x height CSS pixels. The texts keep the position measured for
+ * the raster backends and are escaped for XML, malformed UTF-8 being read as Latin-1 like
+ * the font does.
+ *
+ * @param buffer Pointer to the buffer.
+ * @param list The display list.
+ * @param width The displayed width of the document.
+ * @param height The displayed height of the document.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int svg_encode(OutputBuffer *buffer, const DisplayList *list, int width, int height);
+
+#endif // SVG_H
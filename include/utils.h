@@ -1,8 +1,38 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
+
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+/**
+ * @brief Returns the current value of the monotonic clock.
+ *
+ * Only differences between two calls are meaningful, which makes it suitable
+ * for measuring elapsed time independently of wall clock adjustments.
+ *
+ * @return double The monotonic time in seconds.
+ */
+double monotonic_seconds(void);
+
+/**
+ * @brief Decodes the next code point of a UTF-8 text and advances past it.
+ *
+ * A malformed sequence is read as Latin-1, one byte at a time: truncated or without its
+ * continuation bytes, overlong (such as 0xC0 0xBC for '<'), a surrogate or beyond
+ * U+10FFFF. A text is thus always read as the same characters, and never as a NUL or an
+ * ASCII character it does not spell plainly.
+ *
+ * @param text Pointer to the position in the text, at least one byte before end.
+ * @param end The end of the text.
+ * @return The code point.
+ */
+uint32_t utf8_next(const unsigned char **text, const unsigned char *end);
+
 #endif
@@ -3,31 +3,156 @@
 
 #include <gd.h>
 #include "model.h"
+#include "scanline.h"
+#include "display.h"
 #include "utils.h"
 
-#define FONT_PATH "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf"
-
-#define SIZE_TITLE 44
+/**
+ * @brief Default canvas size, the reference of the layout proportions.
+ */
 #define WIDTH 2400
 #define HEIGHT 1600
 
 /**
- * @brief Creates an image representing a pie chart based on the segments provided.
+ * @brief Font size of the title in points on the default canvas, scaled with the canvas.
+ */
+#define SIZE_TITLE 44
+
+/**
+ * @brief Font size of the labels relative to the radius of the pie.
+ */
+#define LABEL_SIZE_RATIO 0.05
+
+/**
+ * @brief Bounds of each side of the canvas, in pixels.
+ */
+#define MIN_CANVAS_SIZE 16
+#define MAX_CANVAS_SIZE 16384
+
+/**
+ * @brief Resolution of a canvas drawn at scale 1, in dots per inch.
+ */
+#define BASE_DPI 96
+
+/**
+ * @brief Where the parts of a chart go on a canvas, proportional to its size.
+ */
+typedef struct ChartLayout
+{
+    int cx, cy, radius;   ///< The pie.
+    double label_size;    ///< Font size of the labels in points.
+    double title_size;    ///< Font size of the title in points.
+    int title_x, title_y; ///< Center of the title, on its baseline.
+} ChartLayout;
+
+/**
+ * @brief Coverage of a text rendered once, composited over the rows it crosses.
+ */
+typedef struct TextMask
+{
+    int x, y;                ///< Position of the top left corner on the chart.
+    int width, height;
+    unsigned char *coverage; ///< width * height coverage values, 255 for a fully covered pixel.
+} TextMask;
+
+/**
+ * @brief Computes the layout of a chart on a canvas.
+ *
+ * The pie is centered with a radius of a third of the smaller side, the title is centered
+ * at a tenth of the height, and both font sizes follow the canvas: a thumbnail is the
+ * default chart scaled down, not a crop of it.
+ *
+ * @param layout Pointer to the layout to fill in.
+ * @param width The width of the canvas in pixels.
+ * @param height The height of the canvas in pixels.
+ */
+void chart_layout_init(ChartLayout *layout, int width, int height);
+
+/**
+ * @brief Draws a pie chart on an existing image.
  * 
- * This function generates a pie chart image using the data provided through the segments.
- * It uses the gd library to draw the image. Diagram segments are drawn with random colors 
- labels corresponding to each segment are also drawn on the image, and a title is * added to the top of the image. 
- * added at the top of the image.
+ * The palette of the image is emptied and the whole canvas is repainted, so the same
+ * image can be reused for successive charts of the same size. The layout follows the size
+ * of the image (see chart_layout_init()). The edges are anti-aliased on a truecolor image.
  * 
+ * @param img The image to draw on.
  * @param segments Pointer to an array of PieChartSegment structures containing the data for each segment of the diagram.
  * @param segments_count Number of segments in the array.
- * @param title Title of the pie chart to be displayed at the top of the image.
- * 
- * @return gdImagePtr Pointer to the created image. The user is responsible for destroying this image 
- * using gdImageDestroy() once he's finished with it.
+ * @param title Title of the pie chart to be displayed at the top of the image, or NULL for no title.
+ * @return 0 on success, 1 if the allocation failed.
  */
-gdImagePtr create_pie_chart_image(PieChartSegment *segments, int segments_count, char *title);
+int draw_pie_chart(gdImagePtr img, const PieChartSegment *segments, int segments_count, const char *title);
 
+/**
+ * @brief Draws a pie chart on an existing image through a display list and a geometry kept by the caller.
+ *
+ * Like draw_pie_chart(), but the primitives are recorded in list, which keeps its
+ * allocations for the next chart. With a geometry, the boundary tables of the segments are
+ * not computed again: the geometry is only placed at the size of the image, so one
+ * geometry serves a chart drawn at several sizes.
+ *
+ * @param img The image to draw on.
+ * @param list The display list receiving the primitives of the chart.
+ * @param geometry The geometry of the segments, from pie_geometry_init(); its placement and inks are overwritten. NULL to compute it.
+ * @param segments Pointer to an array of PieChartSegment structures containing the data for each segment of the diagram.
+ * @param segments_count Number of segments in the array.
+ * @param title Title of the pie chart to be displayed at the top of the image, or NULL for no title.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int draw_pie_chart_list(gdImagePtr img, DisplayList *list, PieGeometry *geometry, const PieChartSegment *segments,
+                        int segments_count, const char *title);
+
+/**
+ * @brief Records the primitives of a pie chart in a display list.
+ *
+ * The chart is laid out on a canvas of the given size (see chart_layout_init()): the
+ * segments as wedges with their median ticks, then the labels and the title as text runs
+ * already measured and placed, so every backend writes them at the same place.
+ *
+ * @param list The display list, reset for this chart.
+ * @param segments Pointer to an array of PieChartSegment structures containing the data for each segment of the diagram.
+ * @param segments_count Number of segments in the array.
+ * @param title Title of the pie chart to be displayed at the top of the image, or NULL for no title.
+ * @param width The width of the canvas in pixels.
+ * @param height The height of the canvas in pixels.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int display_pie_chart(DisplayList *list, const PieChartSegment *segments, int segments_count, const char *title,
+                      int width, int height);
+
+/**
+ * @brief Draws a display list on an image with libgd.
+ *
+ * The palette of the image is emptied and the whole canvas is repainted. The wedges and
+ * ticks of the pie are rasterized in one pass from the geometry, anti-aliased on a truecolor
+ * image; without a geometry matching the wedges, they are drawn one by one with libgd.
+ *
+ * @param img The image to draw on.
+ * @param list The display list.
+ * @param geometry The geometry of the pie of the list, placed and inked here, or NULL.
+ */
+void draw_display_list(gdImagePtr img, const DisplayList *list, PieGeometry *geometry);
+
+/**
+ * @brief Returns the ink of a color in an image: allocated in order, the closest one when the palette is full.
+ *
+ * @param img The image.
+ * @param color The color.
+ * @return The palette index or truecolor value of the color.
+ */
+int allocate_ink(gdImagePtr img, PieChartColor color);
+
+/**
+ * @brief Rasterizes a placed geometry over the whole image in one pass over the rows:
+ * background, wedges, outline and lines, as draw_display_list() paints the pie of a chart.
+ *
+ * @param img The image.
+ * @param geometry The geometry, placed, its inks allocated in the image with allocate_ink().
+ * @param background The ink of the canvas around the pie.
+ * @param black The ink of the outline and lines.
+ * @param antialias Smooth the edges, on truecolor images only.
+ */
+void paint_pie_geometry(gdImagePtr img, PieGeometry *geometry, int background, int black, bool antialias);
 
 /**
  * @brief Calculates the coordinates of a point on a circle's circumference.
@@ -46,50 +171,100 @@ gdImagePtr create_pie_chart_image(PieChartSegment *segments, int segments_count,
 void calculate_coordinates(int x, int y, int radius, int angle, int *coord_x, int *coord_y);
 
 /**
- * @brief Draws the segments of a pie chart.
+ * @brief Computes where the label of a segment is written.
+ *
+ * The label is placed 10% beyond the edge of the pie, on the median of its segment,
+ * and aligned according to the side of the pie it lies on.
+ *
+ * @param label The label text.
+ * @param font_size The font size in points.
+ * @param x The x-coordinate of the pie chart's center.
+ * @param y The y-coordinate of the pie chart's center.
+ * @param radius The radius of the pie chart.
+ * @param angle The angle of the median of the segment (in degrees).
+ * @param text_x Pointer receiving the x-coordinate of the text origin.
+ * @param text_y Pointer receiving the y-coordinate of the text baseline.
+ */
+void place_label(const char *label, double font_size, int x, int y, int radius, int angle, int *text_x, int *text_y);
+
+/**
+ * @brief Records the segments of a pie chart as wedges and median ticks.
  *
- * This function iterates through the provided segments of a pie chart, calculates the start and end angles for each segment,
- * and draws the segment using a randomly generated color. It also draws black borders around each segment and separating lines
- * between adjacent segments.
+ * The angles are accumulated and clipped exactly like pie_geometry_init(), so raster
+ * backends draw the wedges from the geometry of the same segments. The ticks go from the
+ * edge of the pie to 5% beyond it, on the median of each segment.
  *
- * @param img Pointer to the image where the segments will be drawn.
- * @param segments Pointer to an array of PieChartSegment structures containing the segment information.
+ * @param list The display list.
+ * @param segments Pointer to an array of PieChartSegment structures.
  * @param length The number of segments in the pie chart.
  * @param x The x-coordinate of the pie chart's center.
  * @param y The y-coordinate of the pie chart's center.
- * @param start_angle The starting angle for drawing the first segment (in degrees).
  * @param radius The radius of the pie chart.
- * @param black The color used for drawing the borders and separating lines (usually black).
+ * @param border The color of the outline, separation lines and ticks.
+ * @return 0 on success, 1 if the allocation failed.
  */
-void draw_pie_segments(gdImagePtr img, PieChartSegment *segments, int length, int x, int y, double start_angle, int radius, int black);
+int display_pie_segments(DisplayList *list, const PieChartSegment *segments, int length, int x, int y, int radius,
+                         PieChartColor border);
 
 /**
- * @brief Draws labels for segments of a pie chart.
+ * @brief Records the labels of the segments of a pie chart as text runs.
  *
- * This function iterates through the provided segments of a pie chart, calculates the position
- * for the label of each segment, and draws the label using the specified font settings. 
- * The labels are positioned near the outer edge of the segments.
+ * Each label is placed near the outer edge of its segment (see place_label()); segments
+ * without a label are skipped without measuring anything.
  *
- * @param img Pointer to the image where the labels will be drawn.
+ * @param list The display list.
  * @param segments Pointer to an array of PieChartSegment structures containing the label information.
  * @param length The number of segments in the pie chart.
  * @param x The x-coordinate of the pie chart's center.
  * @param y The y-coordinate of the pie chart's center.
- * @param start_angle The starting angle for drawing the first segment (in degrees).
  * @param radius The radius of the pie chart.
- * @param color The color used for drawing the text labels.
+ * @param color The color of the labels.
+ * @return 0 on success, 1 if the allocation failed.
  */
-void draw_label(gdImagePtr img, PieChartSegment *segments, int length, int x, int y, int start_angle, int radius, int color);
+int display_labels(DisplayList *list, const PieChartSegment *segments, int length, int x, int y, int radius, PieChartColor color);
 
 /**
- * @brief Draws the title text at the specified position in an image.
- * 
- * @param img    A pointer to the image where the title will be drawn.
- * @param title  The title text to draw.
+ * @brief Computes where the title is written, converting it to upper case.
+ *
+ * @param title  The title text.
+ * @param upper  Buffer of strlen(title) + 1 bytes receiving the upper case title.
+ * @param size   The font size in points.
  * @param x      The x-coordinate of the position where the title will be centered.
  * @param y      The y-coordinate of the position where the title will be drawn.
- * @param color  The color value to use for the text.
+ * @param text_x Pointer receiving the x-coordinate of the text origin.
+ * @param text_y Pointer receiving the y-coordinate of the text baseline.
+ * @return 0 on success, 1 if the title cannot be rendered.
+ */
+int place_title(const char *title, char *upper, double size, int x, int y, int *text_x, int *text_y);
+
+/**
+ * @brief Records the title as a text run, in upper case and centered.
+ *
+ * A title the font cannot render is reported and left out of the list.
+ *
+ * @param list   The display list.
+ * @param title  The title text.
+ * @param size   The font size in points.
+ * @param x      The x-coordinate of the position where the title will be centered.
+ * @param y      The y-coordinate of the position where the title will be drawn.
+ * @param color  The color of the title.
+ * @return 0 on success, 1 if the allocation failed.
+ */
+int display_title(DisplayList *list, const char *title, double size, int x, int y, PieChartColor color);
+
+/**
+ * @brief Renders the coverage of a text once, to composite it later.
+ *
+ * The mask covers the glyphs of the text drawn at (x, y), copied from the glyph atlas; an
+ * empty text, or one the font cannot render, gives an empty mask.
+ *
+ * @param mask Pointer to the mask, its coverage is to be released with free().
+ * @param text The text.
+ * @param size The font size in points.
+ * @param x The x-coordinate of the text origin.
+ * @param y The y-coordinate of the text baseline.
+ * @return 0 on success, 1 if the allocation failed.
  */
-void draw_title(gdImagePtr img, char *title, int x, int y, int color);
+int render_text_mask(TextMask *mask, const char *text, double size, int x, int y);
 
 #endif // VIEW_H
@@ -0,0 +1,85 @@
+/**
+ * @file arena.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Bump allocator releasing everything it handed out at once.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "arena.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief Alignment of every allocation, that of malloc().
+ */
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+/**
+ * @brief Size of a block header, rounded so that the bytes after it are aligned.
+ */
+#define ARENA_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+void arena_init(Arena *arena)
+{
+    arena->current = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    ArenaBlock *block = arena->current;
+    if (block == NULL || block->size - block->used < size)
+    {
+        // Twice the previous block, so that a chart needs few blocks and the last one fits it next time
+        size_t capacity = block ? block->size * 2 : ARENA_MIN_BLOCK;
+        if (capacity < size)
+            capacity = size;
+        if (capacity > SIZE_MAX - ARENA_HEADER)
+            return NULL;
+        ArenaBlock *grown = malloc(ARENA_HEADER + capacity);
+        if (grown == NULL)
+            return NULL;
+        grown->next = block;
+        grown->size = capacity;
+        grown->used = 0;
+        arena->current = block = grown;
+    }
+    void *memory = (unsigned char *)block + ARENA_HEADER + block->used;
+    block->used += size;
+    return memory;
+}
+
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *block = arena->current;
+    if (block == NULL)
+        return;
+
+    // The blocks filled before the current one are smaller than it
+    ArenaBlock *older = block->next;
+    while (older)
+    {
+        ArenaBlock *next = older->next;
+        free(older);
+        older = next;
+    }
+    block->next = NULL;
+    block->used = 0;
+
+    if (block->size > ARENA_MAX_KEPT_BLOCK)
+    {
+        free(block);
+        arena->current = NULL;
+    }
+}
+
+void arena_free(Arena *arena)
+{
+    arena_reset(arena);
+    free(arena->current);
+    arena->current = NULL;
+}
@@ -0,0 +1,419 @@
+/**
+ * @file batch.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Renders many pie charts described in a manifest file within a single process.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "batch.h"
+#include "deque.h"
+#include "pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * @brief State of one worker thread of a batch run.
+ */
+typedef struct BatchWorker
+{
+    pthread_t thread;
+    int index;                    ///< Index of the worker in the pool.
+    int worker_count;             ///< Number of workers in the pool.
+    struct BatchWorker *pool;     ///< All the workers, to steal from.
+    const BatchOptions *options;
+    const BatchJob *jobs;
+    WorkDeque deque;              ///< Jobs owned by the worker.
+    ControllerData data;          ///< Private controller state of the worker.
+    uint64_t victim_state;        ///< Generator choosing the first worker to steal from.
+    int jobs_run;
+    int jobs_stolen;
+    int rendered;
+    int failed;
+    double busy_seconds;          ///< Time spent rendering charts.
+    bool started;                 ///< True when the worker runs on its own thread.
+} BatchWorker;
+
+int parse_batch_options(int argc, char **argv, BatchOptions *options)
+{
+    options->manifest_path = NULL;
+    options->program_name = argv[0];
+    options->jobs = 1;
+    options->seed = time(NULL);
+    options->pipeline = false;
+    options->queue_depth = 8;
+
+    if (argc < 3 || strcmp(argv[1], "--batch") != 0)
+        return 1;
+    options->manifest_path = argv[2];
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc && is_number(argv[i + 1]))
+        {
+            options->jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc && is_number(argv[i + 1]))
+        {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0)
+        {
+            options->pipeline = true;
+        }
+        else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc && is_number(argv[i + 1]) && atoi(argv[i + 1]) > 0)
+        {
+            options->queue_depth = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown batch option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (options->jobs <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options->jobs = cpus > 0 ? (int)cpus : 1;
+    }
+    return 0;
+}
+
+int split_spec_line(char *line, char *program_name, char ***argv, int *capacity)
+{
+    int count = 0;
+    char *cursor = line;
+
+    while (true)
+    {
+        // Keep one slot for the next argument and one for the terminating NULL
+        if (count + 2 > *capacity)
+        {
+            int new_capacity = *capacity ? *capacity * 2 : 16;
+            char **grown = realloc(*argv, new_capacity * sizeof(char *));
+            if (grown == NULL)
+                return -1;
+            *argv = grown;
+            *capacity = new_capacity;
+        }
+
+        if (count == 0)
+        {
+            (*argv)[count++] = program_name;
+            continue;
+        }
+
+        while (isspace((unsigned char)*cursor))
+            cursor++;
+        if (*cursor == '\0')
+            break;
+
+        char *token = cursor;
+        if (*cursor == '"')
+        {
+            // Quoted argument: keep everything up to the closing quote
+            token = ++cursor;
+            while (*cursor && *cursor != '"')
+                cursor++;
+        }
+        else
+        {
+            while (*cursor && !isspace((unsigned char)*cursor))
+                cursor++;
+        }
+        if (*cursor)
+            *cursor++ = '\0';
+        (*argv)[count++] = token;
+    }
+
+    (*argv)[count] = NULL;
+    return count;
+}
+
+int load_manifest(const char *manifest_path, BatchJob **jobs, int *count)
+{
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest)
+    {
+        perror("Error opening batch manifest");
+        return 1;
+    }
+
+    char *line = NULL;
+    size_t line_size = 0;
+    int line_number = 0;
+    int capacity = 0;
+    int result = 0;
+    *jobs = NULL;
+    *count = 0;
+
+    while (getline(&line, &line_size, manifest) != -1)
+    {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *first = line + strspn(line, " \t");
+        if (*first == '\0' || *first == '#')
+            continue;
+
+        if (*count == capacity)
+        {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            BatchJob *grown = realloc(*jobs, new_capacity * sizeof(BatchJob));
+            if (grown == NULL)
+            {
+                result = 1;
+                break;
+            }
+            *jobs = grown;
+            capacity = new_capacity;
+        }
+
+        BatchJob *job = &(*jobs)[*count];
+        job->line_number = line_number;
+        job->spec = strdup(first);
+        if (job->spec == NULL)
+        {
+            result = 1;
+            break;
+        }
+        (*count)++;
+    }
+
+    if (result)
+    {
+        fprintf(stderr, "Out of memory while reading the manifest\n");
+        free_manifest(*jobs, *count);
+        *jobs = NULL;
+        *count = 0;
+    }
+    free(line);
+    fclose(manifest);
+    return result;
+}
+
+void free_manifest(BatchJob *jobs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(jobs[i].spec);
+    }
+    free(jobs);
+}
+
+/**
+ * @brief Renders one chart of the manifest with the worker's private state.
+ */
+static void render_job(BatchWorker *worker, const BatchJob *job, char ***argv, int *capacity)
+{
+    // The line is tokenized in place, work on a private copy
+    char *line = strdup(job->spec);
+    int argc = line ? split_spec_line(line, worker->options->program_name, argv, capacity) : -1;
+    if (argc < 0)
+    {
+        fprintf(stderr, "%s:%d: out of memory\n", worker->options->manifest_path, job->line_number);
+        worker->failed++;
+        free(line);
+        return;
+    }
+
+    // Colors depend only on the run seed and the line, not on the worker
+    worker->data.color_state = derive_color_seed(worker->options->seed, job->line_number);
+    if (render_chart(argc, *argv, &worker->data) == 0)
+    {
+        worker->rendered++;
+    }
+    else
+    {
+        fprintf(stderr, "%s:%d: chart could not be rendered\n", worker->options->manifest_path, job->line_number);
+        worker->failed++;
+    }
+    controller_reset(&worker->data);
+    free(line);
+}
+
+/**
+ * @brief Returns a pseudo-random worker index (xorshift64) so thieves don't all hit the same deque.
+ */
+static int pick_victim(BatchWorker *worker)
+{
+    uint64_t x = worker->victim_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->victim_state = x;
+    return x % worker->worker_count;
+}
+
+/**
+ * @brief Picks the next job of a worker: from its own deque first, then stolen from the others.
+ *
+ * No job is added once the run has started, so a sweep finding every deque empty
+ * without losing a race means the whole manifest has been handed out.
+ */
+static bool next_job(BatchWorker *worker, int *job)
+{
+    if (deque_pop(&worker->deque, job))
+        return true;
+
+    while (worker->worker_count > 1)
+    {
+        bool contended = false;
+        int first = pick_victim(worker);
+
+        for (int k = 0; k < worker->worker_count; k++)
+        {
+            int victim = (first + k) % worker->worker_count;
+            if (victim == worker->index)
+                continue;
+
+            StealResult result = deque_steal(&worker->pool[victim].deque, job);
+            if (result == STEAL_SUCCESS)
+            {
+                worker->jobs_stolen++;
+                return true;
+            }
+            if (result == STEAL_ABORT)
+                contended = true;
+        }
+
+        if (!contended)
+            break;
+    }
+    return false;
+}
+
+/**
+ * @brief Runs jobs until every deque of the pool is empty.
+ */
+static void *batch_worker_main(void *arg)
+{
+    BatchWorker *worker = arg;
+    char **argv = NULL;
+    int capacity = 0;
+    int job;
+
+    while (next_job(worker, &job))
+    {
+        double job_start = monotonic_seconds();
+        render_job(worker, &worker->jobs[job], &argv, &capacity);
+        worker->busy_seconds += monotonic_seconds() - job_start;
+        worker->jobs_run++;
+    }
+
+    free(argv);
+    return NULL;
+}
+
+int run_batch(int argc, char **argv)
+{
+    BatchOptions options;
+    if (parse_batch_options(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s --batch <manifest> [--jobs N] [--seed S] [--pipeline] [--queue-depth N]\n", argv[0]);
+        return 1;
+    }
+
+    BatchJob *jobs;
+    int job_count;
+    if (load_manifest(options.manifest_path, &jobs, &job_count))
+        return 1;
+
+    // The stages carry one image per chart: several sizes are rendered by the workers
+    if (options.pipeline && controller_options()->sizes_count)
+    {
+        fprintf(stderr, "Warning: --pipeline does not render several sizes, using the workers\n");
+        options.pipeline = false;
+    }
+
+    if (options.pipeline)
+    {
+        int result = run_pipeline(&options, jobs, job_count);
+        free_manifest(jobs, job_count);
+        return result;
+    }
+
+    if (options.jobs > job_count && job_count > 0)
+        options.jobs = job_count;
+
+    BatchWorker *workers = calloc(options.jobs, sizeof(BatchWorker));
+    if (workers == NULL)
+    {
+        free_manifest(jobs, job_count);
+        return 1;
+    }
+
+    // Hand out contiguous blocks of the manifest, pushed in reverse so each owner pops them in file order
+    int block = (job_count + options.jobs - 1) / options.jobs;
+    for (int w = 0; w < options.jobs; w++)
+    {
+        BatchWorker *worker = &workers[w];
+        worker->index = w;
+        worker->worker_count = options.jobs;
+        worker->pool = workers;
+        worker->options = &options;
+        worker->jobs = jobs;
+        worker->victim_state = derive_color_seed(options.seed, w) | 1;
+        controller_init(&worker->data);
+
+        int first = w * block;
+        int last = MIN(first + block, job_count);
+        if (!deque_init(&worker->deque, block > 0 ? block : 1))
+        {
+            fprintf(stderr, "Out of memory while scheduling the batch\n");
+            for (int i = 0; i < w; i++)
+                deque_destroy(&workers[i].deque);
+            free(workers);
+            free_manifest(jobs, job_count);
+            return 1;
+        }
+        for (int i = last - 1; i >= first; i--)
+            deque_push(&worker->deque, i);
+    }
+
+    double start = monotonic_seconds();
+    for (int w = 1; w < options.jobs; w++)
+    {
+        // The calling thread acts as the first worker
+        BatchWorker *worker = &workers[w];
+        worker->started = pthread_create(&worker->thread, NULL, batch_worker_main, worker) == 0;
+        if (!worker->started)
+            fprintf(stderr, "Could not start worker %d, its jobs will be stolen\n", w);
+    }
+    batch_worker_main(&workers[0]);
+
+    int rendered = 0;
+    int failed = 0;
+    for (int w = 0; w < options.jobs; w++)
+    {
+        if (workers[w].started)
+            pthread_join(workers[w].thread, NULL);
+    }
+    double elapsed = monotonic_seconds() - start;
+
+    for (int w = 0; w < options.jobs; w++)
+    {
+        BatchWorker *worker = &workers[w];
+        // Idle time covers stealing attempts and waiting for the slowest worker to finish
+        fprintf(stderr, "Worker %d: %d jobs run, %d stolen, %.3f s idle\n",
+                w, worker->jobs_run, worker->jobs_stolen, elapsed - worker->busy_seconds);
+        rendered += worker->rendered;
+        failed += worker->failed;
+        deque_destroy(&worker->deque);
+        controller_cleanup(&worker->data);
+    }
+
+    fprintf(stderr, "Rendered %d charts (%d failed) with %d worker(s) in %.3f s: %.1f charts/s\n",
+            rendered, failed, options.jobs, elapsed, elapsed > 0 ? rendered / elapsed : 0.0);
+
+    free(workers);
+    free_manifest(jobs, job_count);
+    return failed ? 1 : 0;
+}
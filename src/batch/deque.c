@@ -0,0 +1,89 @@
+/**
+ * @file deque.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Lock-free work-stealing deque used by the batch scheduler.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "deque.h"
+#include <stdlib.h>
+
+bool deque_init(WorkDeque *deque, long capacity)
+{
+    long size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    deque->buffer = malloc(size * sizeof(atomic_int));
+    if (deque->buffer == NULL)
+        return false;
+    deque->mask = size - 1;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    return true;
+}
+
+void deque_destroy(WorkDeque *deque)
+{
+    free(deque->buffer);
+    deque->buffer = NULL;
+}
+
+bool deque_push(WorkDeque *deque, int job)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top > deque->mask)
+        return false;
+
+    atomic_store_explicit(&deque->buffer[bottom & deque->mask], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+bool deque_pop(WorkDeque *deque, int *job)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // Empty: restore the bottom
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *job = atomic_load_explicit(&deque->buffer[bottom & deque->mask], memory_order_relaxed);
+    if (top < bottom)
+        return true;
+
+    // Last job: race against the thieves for it
+    bool won = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                       memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return won;
+}
+
+StealResult deque_steal(WorkDeque *deque, int *job)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+        return STEAL_EMPTY;
+
+    int value = atomic_load_explicit(&deque->buffer[top & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return STEAL_ABORT;
+
+    *job = value;
+    return STEAL_SUCCESS;
+}
@@ -0,0 +1,344 @@
+/**
+ * @file pipeline.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Staged parse / render / encode / write pipeline for batch mode.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "pipeline.h"
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Identifiers of the pipeline stages, in processing order.
+ */
+typedef enum PipelineStage
+{
+    STAGE_PARSE,
+    STAGE_RENDER,
+    STAGE_ENCODE,
+    STAGE_WRITE,
+    STAGE_COUNT
+} PipelineStage;
+
+static const char *stage_names[STAGE_COUNT] = {"parse", "render", "encode", "write"};
+
+/**
+ * @brief One chart travelling through the pipeline.
+ */
+typedef struct ChartTask
+{
+    const BatchJob *job;
+    char *line;          ///< Private copy of the specification, tokenized in place.
+    char **argv;         ///< Arguments pointing into line, kept alive for the title.
+    int capacity;
+    ControllerData data; ///< Parsed segments, image and PNG of the chart.
+    struct ChartTask *next; ///< Next idle task of the pool.
+} ChartTask;
+
+/**
+ * @brief Shared state of a pipeline run.
+ */
+typedef struct Pipeline
+{
+    const BatchOptions *options;
+    const BatchJob *jobs;
+    int job_count;
+    BoundedQueue queues[STAGE_COUNT];           ///< queues[s] feeds stage s (queues[STAGE_PARSE] is unused).
+    int threads[STAGE_COUNT];                   ///< Number of threads of each stage.
+    atomic_int running[STAGE_COUNT];            ///< Threads of each stage still running.
+    _Atomic long long busy_ns[STAGE_COUNT];     ///< Time spent working, summed over the threads of a stage.
+    atomic_int rendered;
+    atomic_int failed;
+    pthread_mutex_t pool_lock;
+    ChartTask *pool;                            ///< Idle tasks, with their renderer and buffers, for the next charts.
+} Pipeline;
+
+/**
+ * @brief Thread argument: the pipeline and the stage the thread serves.
+ */
+typedef struct StageThread
+{
+    pthread_t thread;
+    Pipeline *pipeline;
+    PipelineStage stage;
+    bool started;
+} StageThread;
+
+static void free_task(ChartTask *task)
+{
+    controller_cleanup(&task->data);
+    free(task->argv);
+    free(task->line);
+    free(task);
+}
+
+/**
+ * @brief Returns a task to the pool once its chart is done.
+ *
+ * The task keeps its renderer, output buffer, display list, arena and argument
+ * buffers for the next chart. Only the tasks in flight at once are ever created, so
+ * the pool is bounded by the queue depths and the number of threads.
+ */
+static void release_task(Pipeline *pipeline, ChartTask *task)
+{
+    controller_reset(&task->data);
+    pthread_mutex_lock(&pipeline->pool_lock);
+    task->next = pipeline->pool;
+    pipeline->pool = task;
+    pthread_mutex_unlock(&pipeline->pool_lock);
+}
+
+/**
+ * @brief Takes an idle task from the pool, or creates one.
+ */
+static ChartTask *acquire_task(Pipeline *pipeline)
+{
+    pthread_mutex_lock(&pipeline->pool_lock);
+    ChartTask *task = pipeline->pool;
+    if (task)
+        pipeline->pool = task->next;
+    pthread_mutex_unlock(&pipeline->pool_lock);
+
+    if (task == NULL)
+    {
+        task = calloc(1, sizeof(ChartTask));
+        if (task)
+            controller_init(&task->data);
+    }
+    return task;
+}
+
+static void report_failure(Pipeline *pipeline, const BatchJob *job)
+{
+    fprintf(stderr, "%s:%d: chart could not be rendered\n", pipeline->options->manifest_path, job->line_number);
+    atomic_fetch_add(&pipeline->failed, 1);
+}
+
+static void fail_task(Pipeline *pipeline, ChartTask *task)
+{
+    report_failure(pipeline, task->job);
+    release_task(pipeline, task);
+}
+
+/**
+ * @brief Builds the task of a manifest line and runs the parse step on it.
+ */
+static ChartTask *parse_task(Pipeline *pipeline, const BatchJob *job)
+{
+    ChartTask *task = acquire_task(pipeline);
+    if (task == NULL)
+    {
+        report_failure(pipeline, job);
+        return NULL;
+    }
+    task->job = job;
+
+    // Colors depend only on the run seed and the line, as in the other batch modes
+    task->data.color_state = derive_color_seed(pipeline->options->seed, job->line_number);
+
+    free(task->line);
+    task->line = strdup(job->spec);
+    int argc = task->line ? split_spec_line(task->line, pipeline->options->program_name, &task->argv, &task->capacity) : -1;
+    if (argc < 0 || parse_chart(argc, task->argv, &task->data))
+    {
+        fail_task(pipeline, task);
+        return NULL;
+    }
+    return task;
+}
+
+/**
+ * @brief Runs the step of a stage on one task, returns 0 on success.
+ */
+static int run_stage(PipelineStage stage, ChartTask *task)
+{
+    switch (stage)
+    {
+    case STAGE_RENDER:
+        return draw_chart(&task->data);
+    case STAGE_ENCODE:
+    {
+        int result = encode_chart(&task->data);
+        // The canvas is no longer needed, release it before the write
+        piechart_renderer_trim(task->data.renderer);
+        return result;
+    }
+    case STAGE_WRITE:
+        return write_chart(&task->data);
+    default:
+        return 1;
+    }
+}
+
+static long long elapsed_ns(double start)
+{
+    return (long long)((monotonic_seconds() - start) * 1e9);
+}
+
+static void *stage_main(void *arg)
+{
+    StageThread *self = arg;
+    Pipeline *pipeline = self->pipeline;
+    PipelineStage stage = self->stage;
+
+    if (stage == STAGE_PARSE)
+    {
+        for (int i = 0; i < pipeline->job_count; i++)
+        {
+            double start = monotonic_seconds();
+            ChartTask *task = parse_task(pipeline, &pipeline->jobs[i]);
+            atomic_fetch_add(&pipeline->busy_ns[stage], elapsed_ns(start));
+            if (task && !queue_push(&pipeline->queues[STAGE_RENDER], task))
+            {
+                // The run was aborted
+                release_task(pipeline, task);
+                break;
+            }
+        }
+    }
+    else
+    {
+        ChartTask *task;
+        while ((task = queue_pop(&pipeline->queues[stage])) != NULL)
+        {
+            double start = monotonic_seconds();
+            int result = run_stage(stage, task);
+            atomic_fetch_add(&pipeline->busy_ns[stage], elapsed_ns(start));
+
+            if (result)
+            {
+                fail_task(pipeline, task);
+            }
+            else if (stage == STAGE_WRITE)
+            {
+                atomic_fetch_add(&pipeline->rendered, 1);
+                release_task(pipeline, task);
+            }
+            else if (!queue_push(&pipeline->queues[stage + 1], task))
+            {
+                release_task(pipeline, task);
+            }
+        }
+    }
+
+    // The last thread of a stage closes the queue of the next one
+    if (atomic_fetch_sub(&pipeline->running[stage], 1) == 1 && stage + 1 < STAGE_COUNT)
+        queue_close(&pipeline->queues[stage + 1]);
+    return NULL;
+}
+
+int run_pipeline(const BatchOptions *options, const BatchJob *jobs, int job_count)
+{
+    Pipeline pipeline;
+    pipeline.options = options;
+    pipeline.jobs = jobs;
+    pipeline.job_count = job_count;
+    pipeline.threads[STAGE_PARSE] = 1;
+    pipeline.threads[STAGE_RENDER] = options->jobs;
+    pipeline.threads[STAGE_ENCODE] = options->jobs;
+    pipeline.threads[STAGE_WRITE] = 1;
+    atomic_init(&pipeline.rendered, 0);
+    atomic_init(&pipeline.failed, 0);
+    pipeline.pool = NULL;
+
+    int thread_count = 0;
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        atomic_init(&pipeline.running[s], pipeline.threads[s]);
+        atomic_init(&pipeline.busy_ns[s], 0);
+        thread_count += pipeline.threads[s];
+        if (s > STAGE_PARSE && !queue_init(&pipeline.queues[s], options->queue_depth))
+        {
+            for (int q = STAGE_PARSE + 1; q < s; q++)
+                queue_destroy(&pipeline.queues[q]);
+            return 1;
+        }
+    }
+
+    StageThread *threads = calloc(thread_count, sizeof(StageThread));
+    if (threads == NULL || pthread_mutex_init(&pipeline.pool_lock, NULL) != 0)
+    {
+        free(threads);
+        for (int s = STAGE_PARSE + 1; s < STAGE_COUNT; s++)
+            queue_destroy(&pipeline.queues[s]);
+        return 1;
+    }
+
+    double start = monotonic_seconds();
+
+    // Start the stages from the last one so consumers are waiting when the first charts arrive
+    bool aborted = false;
+    int t = 0;
+    for (int s = STAGE_COUNT - 1; s >= 0 && !aborted; s--)
+    {
+        for (int i = 0; i < pipeline.threads[s] && !aborted; i++, t++)
+        {
+            threads[t].pipeline = &pipeline;
+            threads[t].stage = s;
+            threads[t].started = pthread_create(&threads[t].thread, NULL, stage_main, &threads[t]) == 0;
+            if (!threads[t].started)
+            {
+                fprintf(stderr, "Could not start a %s thread, aborting the pipeline\n", stage_names[s]);
+                aborted = true;
+            }
+        }
+    }
+    if (aborted)
+    {
+        // Closed queues stop every stage: pushes fail and pops return once the queue is empty
+        for (int s = STAGE_PARSE + 1; s < STAGE_COUNT; s++)
+            queue_close(&pipeline.queues[s]);
+    }
+    for (t = 0; t < thread_count; t++)
+    {
+        if (threads[t].started)
+            pthread_join(threads[t].thread, NULL);
+    }
+    double elapsed = monotonic_seconds() - start;
+
+    while (pipeline.pool)
+    {
+        ChartTask *task = pipeline.pool;
+        pipeline.pool = task->next;
+        free_task(task);
+    }
+    pthread_mutex_destroy(&pipeline.pool_lock);
+    free(threads);
+
+    if (aborted)
+    {
+        for (int s = STAGE_PARSE + 1; s < STAGE_COUNT; s++)
+            queue_destroy(&pipeline.queues[s]);
+        return 1;
+    }
+
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        // Occupancy: share of the stage's thread time spent working rather than waiting
+        double occupancy = elapsed > 0 ? atomic_load(&pipeline.busy_ns[s]) / 1e9 / (elapsed * pipeline.threads[s]) : 0.0;
+        fprintf(stderr, "Stage %-6s: %d thread(s), %5.1f%% busy", stage_names[s], pipeline.threads[s], occupancy * 100.0);
+        if (s > STAGE_PARSE)
+        {
+            BoundedQueue *queue = &pipeline.queues[s];
+            fprintf(stderr, ", input queue depth mean %.1f max %d/%d, %ld full waits, %ld empty waits",
+                    queue->pushes ? (double)queue->depth_sum / queue->pushes : 0.0,
+                    queue->max_depth, queue->capacity, queue->full_waits, queue->empty_waits);
+            queue_destroy(queue);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    int rendered = atomic_load(&pipeline.rendered);
+    int failed = atomic_load(&pipeline.failed);
+    fprintf(stderr, "Rendered %d charts (%d failed) through the pipeline in %.3f s: %.1f charts/s\n",
+            rendered, failed, elapsed, elapsed > 0 ? rendered / elapsed : 0.0);
+    return failed ? 1 : 0;
+}
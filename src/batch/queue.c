@@ -0,0 +1,117 @@
+/**
+ * @file queue.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Bounded blocking queue connecting the stages of the rendering pipeline.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "queue.h"
+#include <stdlib.h>
+
+bool queue_init(BoundedQueue *queue, int capacity)
+{
+    queue->items = malloc(capacity * sizeof(void *));
+    if (queue->items == NULL)
+        return false;
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    queue->max_depth = 0;
+    queue->depth_sum = 0;
+    queue->pushes = 0;
+    queue->full_waits = 0;
+    queue->empty_waits = 0;
+    return true;
+}
+
+void queue_destroy(BoundedQueue *queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    queue->items = NULL;
+}
+
+/**
+ * @brief Stores an item at the tail. The lock must be held and the queue must have room.
+ */
+static void queue_append(BoundedQueue *queue, void *item)
+{
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    queue->pushes++;
+    queue->depth_sum += queue->count;
+    if (queue->count > queue->max_depth)
+        queue->max_depth = queue->count;
+    pthread_cond_signal(&queue->not_empty);
+}
+
+bool queue_push(BoundedQueue *queue, void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity && !queue->closed)
+    {
+        queue->full_waits++;
+        while (queue->count == queue->capacity && !queue->closed)
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    bool pushed = !queue->closed;
+    if (pushed)
+        queue_append(queue, item);
+    pthread_mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+bool queue_try_push(BoundedQueue *queue, void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool pushed = !queue->closed && queue->count < queue->capacity;
+    if (pushed)
+        queue_append(queue, item);
+    else if (!queue->closed)
+        queue->full_waits++;
+    pthread_mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+void *queue_pop(BoundedQueue *queue)
+{
+    void *item = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0 && !queue->closed)
+    {
+        queue->empty_waits++;
+        while (queue->count == 0 && !queue->closed)
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    if (queue->count > 0)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void queue_close(BoundedQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
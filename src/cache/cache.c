@@ -0,0 +1,486 @@
+/**
+ * @file cache.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Content-addressed LRU cache of encoded charts, in memory and optionally on disk.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "cache.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define CACHE_FILE_MAGIC "PCC1"
+
+/**
+ * @brief Buckets of an empty cache, doubled whenever the entries outnumber them.
+ */
+#define CACHE_MIN_BUCKETS 64
+
+/**
+ * @brief Share of its bound a full on-disk store is reduced to, so that the next stores do
+ * not each scan the directory again.
+ */
+#define CACHE_DISK_LOW_WATER 0.9
+
+/**
+ * @brief A file of the on-disk store, as found when the directory is scanned.
+ */
+typedef struct DiskFile
+{
+    struct timespec used; ///< Modification time: when it was stored or last read.
+    size_t size;
+    char name[32];
+} DiskFile;
+
+RenderCache *cache_create(size_t max_bytes, const char *directory)
+{
+    RenderCache *cache = calloc(1, sizeof(RenderCache));
+    if (cache == NULL)
+        return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_mutex_init(&cache->disk_lock, NULL);
+
+    cache->bucket_count = CACHE_MIN_BUCKETS;
+    cache->buckets = calloc(cache->bucket_count, sizeof(CacheEntry *));
+    cache->max_bytes = max_bytes;
+    if (directory)
+    {
+        cache->directory = strdup(directory);
+        if (cache->directory && mkdir(directory, 0755) != 0 && errno != EEXIST)
+            perror("Error creating the cache directory");
+    }
+    if (cache->buckets == NULL || (directory && cache->directory == NULL))
+    {
+        cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+static void free_entry(CacheEntry *entry)
+{
+    free(entry->key);
+    free(entry->value);
+    free(entry);
+}
+
+void cache_destroy(RenderCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    CacheEntry *entry = cache->newest;
+    while (entry)
+    {
+        CacheEntry *older = entry->older;
+        free_entry(entry);
+        entry = older;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    pthread_mutex_destroy(&cache->disk_lock);
+    free(cache->buckets);
+    free(cache->directory);
+    free(cache);
+}
+
+uint64_t cache_hash(const void *key, size_t length)
+{
+    const unsigned char *bytes = key;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Removes an entry from the LRU list. The lock must be held.
+ */
+static void lru_unlink(RenderCache *cache, CacheEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+/**
+ * @brief Inserts an entry as the most recently used one. The lock must be held.
+ */
+static void lru_push(RenderCache *cache, CacheEntry *entry)
+{
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if (cache->newest)
+        cache->newest->newer = entry;
+    cache->newest = entry;
+    if (cache->oldest == NULL)
+        cache->oldest = entry;
+}
+
+static CacheEntry **find_slot(RenderCache *cache, uint64_t hash, const void *key, size_t length)
+{
+    CacheEntry **slot = &cache->buckets[hash & (cache->bucket_count - 1)];
+    while (*slot)
+    {
+        CacheEntry *entry = *slot;
+        if (entry->hash == hash && entry->key_length == length && memcmp(entry->key, key, length) == 0)
+            break;
+        slot = &entry->bucket_next;
+    }
+    return slot;
+}
+
+static void remove_entry(RenderCache *cache, CacheEntry *entry)
+{
+    CacheEntry **slot = find_slot(cache, entry->hash, entry->key, entry->key_length);
+    *slot = entry->bucket_next;
+    lru_unlink(cache, entry);
+    cache->bytes -= entry->key_length + entry->value_length;
+    cache->entries--;
+    free_entry(entry);
+}
+
+/**
+ * @brief Doubles the buckets and moves the entries to them. The lock must be held.
+ *
+ * On allocation failure the table keeps its size: chains get longer, lookups stay correct.
+ */
+static void grow_buckets(RenderCache *cache)
+{
+    size_t count = cache->bucket_count * 2;
+    CacheEntry **buckets = calloc(count, sizeof(CacheEntry *));
+    if (buckets == NULL)
+        return;
+    for (size_t i = 0; i < cache->bucket_count; i++)
+    {
+        CacheEntry *entry = cache->buckets[i];
+        while (entry)
+        {
+            CacheEntry *next = entry->bucket_next;
+            CacheEntry **slot = &buckets[entry->hash & (count - 1)];
+            entry->bucket_next = *slot;
+            *slot = entry;
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = count;
+}
+
+/**
+ * @brief Inserts a copy of a key and value in memory, evicting old entries. The lock must be held.
+ */
+static void insert_entry(RenderCache *cache, uint64_t hash, const void *key, size_t key_length,
+                         const void *value, size_t value_length)
+{
+    size_t size = key_length + value_length;
+    if (size > cache->max_bytes)
+        return;
+
+    CacheEntry **slot = find_slot(cache, hash, key, key_length);
+    if (*slot)
+        remove_entry(cache, *slot);
+
+    while (cache->bytes + size > cache->max_bytes && cache->oldest)
+    {
+        remove_entry(cache, cache->oldest);
+        cache->evictions++;
+    }
+
+    CacheEntry *entry = calloc(1, sizeof(CacheEntry));
+    if (entry == NULL)
+        return;
+    entry->key = malloc(key_length);
+    entry->value = malloc(value_length);
+    if (entry->key == NULL || entry->value == NULL)
+    {
+        free_entry(entry);
+        return;
+    }
+    memcpy(entry->key, key, key_length);
+    memcpy(entry->value, value, value_length);
+    entry->hash = hash;
+    entry->key_length = key_length;
+    entry->value_length = value_length;
+
+    if ((size_t)cache->entries >= cache->bucket_count)
+        grow_buckets(cache);
+    slot = &cache->buckets[hash & (cache->bucket_count - 1)];
+    entry->bucket_next = *slot;
+    *slot = entry;
+    lru_push(cache, entry);
+    cache->bytes += size;
+    cache->entries++;
+}
+
+static void cache_file_path(const RenderCache *cache, uint64_t hash, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%016llx.pcc", cache->directory, (unsigned long long)hash);
+}
+
+/**
+ * @brief Reads the value of a key from the on-disk store into out.
+ *
+ * Files start with a magic, the key length and the key, checked before the value is used.
+ */
+static bool load_from_disk(const RenderCache *cache, uint64_t hash, const void *key, size_t length, OutputBuffer *out)
+{
+    char path[4096];
+    cache_file_path(cache, hash, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    bool found = false;
+    char magic[4];
+    uint32_t key_length;
+    struct stat info;
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, CACHE_FILE_MAGIC, 4) == 0 &&
+        fread(&key_length, sizeof(key_length), 1, fp) == 1 && key_length == length &&
+        fstat(fileno(fp), &info) == 0 && (size_t)info.st_size > 8 + length)
+    {
+        size_t value_length = info.st_size - 8 - length;
+        output_buffer_reset(out);
+        if (output_buffer_reserve(out, length + value_length) == 0 &&
+            fread(out->data, 1, length + value_length, fp) == length + value_length &&
+            memcmp(out->data, key, length) == 0)
+        {
+            // Drop the key in front of the value
+            memmove(out->data, out->data + length, value_length);
+            out->length = value_length;
+            found = true;
+            futimens(fileno(fp), NULL); // Used now: the last file the bound evicts
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static int compare_disk_files(const void *a, const void *b)
+{
+    const DiskFile *first = a, *second = b;
+    if (first->used.tv_sec != second->used.tv_sec)
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    return (first->used.tv_nsec > second->used.tv_nsec) - (first->used.tv_nsec < second->used.tv_nsec);
+}
+
+/**
+ * @brief Lists the files of the on-disk store, returns their number or -1 on error.
+ *
+ * Only the entries are listed: the temporary files being written are left alone.
+ */
+static int scan_disk(const RenderCache *cache, DiskFile **files, size_t *total)
+{
+    *files = NULL;
+    *total = 0;
+    DIR *directory = opendir(cache->directory);
+    if (directory == NULL)
+        return -1;
+
+    int count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        struct stat info;
+        if (length != 20 || strcmp(entry->d_name + 16, ".pcc") != 0 ||
+            fstatat(dirfd(directory), entry->d_name, &info, 0) != 0 || !S_ISREG(info.st_mode))
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 256;
+            DiskFile *grown = realloc(*files, capacity * sizeof(DiskFile));
+            if (grown == NULL)
+            {
+                closedir(directory);
+                free(*files);
+                *files = NULL;
+                return -1;
+            }
+            *files = grown;
+        }
+        DiskFile *file = &(*files)[count++];
+        file->used = info.st_mtim;
+        file->size = info.st_size;
+        memcpy(file->name, entry->d_name, length + 1);
+        *total += file->size;
+    }
+    closedir(directory);
+    return count;
+}
+
+/**
+ * @brief Deletes the least recently used files of the store until it is back under its
+ * low water mark. The disk lock must be held.
+ *
+ * The directory is scanned rather than trusted: other processes may share the store.
+ */
+static void evict_disk(RenderCache *cache)
+{
+    DiskFile *files;
+    size_t total;
+    int count = scan_disk(cache, &files, &total);
+    if (count < 0)
+        return;
+
+    if (count > 0)
+        qsort(files, count, sizeof(DiskFile), compare_disk_files);
+    size_t target = cache->max_disk_bytes * CACHE_DISK_LOW_WATER;
+    long evicted = 0;
+    char path[4096];
+    for (int i = 0; i < count && total > target; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", cache->directory, files[i].name);
+        if (unlink(path) == 0)
+        {
+            total -= files[i].size;
+            evicted++;
+        }
+    }
+    free(files);
+    cache->disk_bytes = total;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->disk_evictions += evicted;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Counts a file written to the store, replacing one of replaced bytes, and evicts
+ * beyond the bound.
+ */
+static void account_disk_file(RenderCache *cache, size_t size, size_t replaced)
+{
+    pthread_mutex_lock(&cache->disk_lock);
+    cache->disk_bytes = cache->disk_bytes + size - MIN(replaced, cache->disk_bytes + size);
+    if (cache->max_disk_bytes && cache->disk_bytes > cache->max_disk_bytes)
+        evict_disk(cache);
+    pthread_mutex_unlock(&cache->disk_lock);
+}
+
+void cache_set_disk_limit(RenderCache *cache, size_t max_bytes)
+{
+    if (cache->directory == NULL)
+        return;
+
+    pthread_mutex_lock(&cache->disk_lock);
+    cache->max_disk_bytes = max_bytes;
+    DiskFile *files;
+    size_t total;
+    if (scan_disk(cache, &files, &total) >= 0)
+    {
+        free(files);
+        cache->disk_bytes = total;
+    }
+    if (max_bytes && cache->disk_bytes > max_bytes)
+        evict_disk(cache);
+    pthread_mutex_unlock(&cache->disk_lock);
+}
+
+static void save_to_disk(RenderCache *cache, uint64_t hash, const void *key, size_t key_length,
+                         const void *value, size_t value_length)
+{
+    if (cache->max_disk_bytes && 8 + key_length + value_length > cache->max_disk_bytes)
+        return;
+
+    char path[4096];
+    char temporary[4096];
+    cache_file_path(cache, hash, path, sizeof(path));
+    if (snprintf(temporary, sizeof(temporary), "%s/.%016llx.XXXXXX", cache->directory, (unsigned long long)hash) >=
+        (int)sizeof(temporary))
+        return;
+
+    // Written under a unique temporary name then renamed: readers never see a partial file,
+    // and threads or processes storing the same chart never write to the same file
+    int fd = mkstemp(temporary);
+    if (fd < 0)
+        return;
+    fchmod(fd, 0644);
+    FILE *fp = fdopen(fd, "wb");
+    if (!fp)
+    {
+        close(fd);
+        unlink(temporary);
+        return;
+    }
+    uint32_t length = key_length;
+    bool written = fwrite(CACHE_FILE_MAGIC, 1, 4, fp) == 4 && fwrite(&length, sizeof(length), 1, fp) == 1 &&
+                   fwrite(key, 1, key_length, fp) == key_length && fwrite(value, 1, value_length, fp) == value_length;
+    struct stat replaced;
+    size_t replaced_size = stat(path, &replaced) == 0 ? (size_t)replaced.st_size : 0;
+    if (fclose(fp) == 0 && written && rename(temporary, path) == 0)
+    {
+        account_disk_file(cache, 8 + key_length + value_length, replaced_size);
+        return;
+    }
+    unlink(temporary);
+}
+
+bool cache_lookup(RenderCache *cache, const void *key, size_t length, OutputBuffer *out)
+{
+    uint64_t hash = cache_hash(key, length);
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = *find_slot(cache, hash, key, length);
+    if (entry)
+    {
+        lru_unlink(cache, entry);
+        lru_push(cache, entry);
+        output_buffer_reset(out);
+        bool copied = output_buffer_append(out, entry->value, entry->value_length) == 0;
+        if (copied)
+            cache->hits++;
+        else
+            cache->misses++; // The caller renders the chart, as for any miss
+        pthread_mutex_unlock(&cache->lock);
+        return copied;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Disk reads happen outside the lock
+    bool found = cache->directory && load_from_disk(cache, hash, key, length, out);
+
+    pthread_mutex_lock(&cache->lock);
+    if (found)
+    {
+        cache->disk_hits++;
+        insert_entry(cache, hash, key, length, out->data, out->length);
+    }
+    else
+    {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+void cache_store(RenderCache *cache, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    uint64_t hash = cache_hash(key, key_length);
+
+    pthread_mutex_lock(&cache->lock);
+    insert_entry(cache, hash, key, key_length, value, value_length);
+    pthread_mutex_unlock(&cache->lock);
+
+    if (cache->directory)
+        save_to_disk(cache, hash, key, key_length, value, value_length);
+}
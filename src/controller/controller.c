@@ -10,59 +10,660 @@
 
 // Include necessary header(s)
 #include "controller.h"
+#include "batch.h"
+#include "server.h"
+#include "coprocess.h"
+#include "output.h"
+#include "probes.h"
+#include "view.h"
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+static int dispatch_input(int argc, char **argv, ControllerData *data);
+
+// Options applied to every ControllerData, set once by handle_input()
+static RenderOptions render_options = {
+    .color_mode = COLORS_RANDOM,
+    .format = PIECHART_FORMAT_PNG,
+    .compression = {.level = -1, .strategy = PIECHART_STRATEGY_DEFAULT, .threads = 0},
+    .width = WIDTH,
+    .height = HEIGHT,
+    .scale = 1.0,
+};
+
+// Destination of the profile lines, the standard error unless --profile-file was given
+static FILE *profile_stream = NULL;
+
+void controller_configure(const RenderOptions *options)
+{
+    render_options = *options;
+}
+
+const RenderOptions *controller_options(void)
+{
+    return &render_options;
+}
 
 void controller_init(ControllerData *data)
 {
-    srand(time(NULL)); // Seed the random number generator
-    data->img = NULL;
+    data->renderer = piechart_renderer_create();
     data->segments = NULL;
     data->segments_count = 0;
+    arena_init(&data->arena);
+    data->output_file = NULL;
+    data->format = render_options.format;
+    data->base_name = NULL;
+    data->title = NULL;
+    data->png = NULL;
+    data->png_size = 0;
+    data->color_state = derive_color_seed(time(NULL), 0); // Seed the color generator
+    data->color_mode = render_options.color_mode;
+    data->color_seed = render_options.color_seed;
+    data->sizes = render_options.sizes;
+    data->sizes_count = render_options.sizes_count;
+    data->cache = render_options.cache;
+    data->cache_hit = false;
+    data->profile.enabled = render_options.profiling;
+    profile_reset(&data->profile);
+    if (data->renderer)
+    {
+        piechart_renderer_set_streaming(data->renderer, render_options.streaming);
+        piechart_renderer_set_antialias(data->renderer, render_options.antialias);
+        piechart_renderer_set_format(data->renderer, render_options.format);
+        piechart_renderer_set_compression(data->renderer, render_options.compressing ? &render_options.compression : NULL);
+        piechart_renderer_set_size(data->renderer, render_options.width, render_options.height, render_options.scale);
+    }
+}
+
+/**
+ * @brief Reads a non-negative decimal integer of at most max, without sign or fraction.
+ */
+static bool parse_count(const char *value, unsigned long long max, unsigned long long *count)
+{
+    if (!isdigit((unsigned char)*value))
+        return false;
+    char *end;
+    errno = 0;
+    *count = strtoull(value, &end, 10);
+    return *end == '\0' && errno == 0 && *count <= max;
+}
+
+/**
+ * @brief Reads a comma separated list of WIDTHxHEIGHT[@SCALE] sizes.
+ */
+static int parse_sizes(const char *value, RenderOptions *options)
+{
+    options->sizes_count = 0;
+    while (*value)
+    {
+        PieChartSize *size = &options->sizes[options->sizes_count];
+        int consumed = 0;
+        size->scale = 1.0;
+        if (options->sizes_count == PIECHART_MAX_SIZES ||
+            sscanf(value, "%dx%d%n", &size->width, &size->height, &consumed) != 2)
+            return 1;
+        value += consumed;
+        if (*value == '@')
+        {
+            char *end;
+            size->scale = strtod(value + 1, &end);
+            if (end == value + 1)
+                return 1;
+            value = end;
+        }
+        options->sizes_count++;
+        if (*value == ',')
+            value++;
+        else if (*value)
+            return 1;
+    }
+    return options->sizes_count == 0;
+}
+
+int extract_render_options(int *argc, char **argv, RenderOptions *options)
+{
+    options->color_mode = COLORS_RANDOM;
+    options->color_seed = 0;
+    options->streaming = false;
+    options->antialias = false;
+    options->format = PIECHART_FORMAT_PNG;
+    options->format_given = false;
+    options->compressing = false;
+    options->compression.level = -1;
+    options->compression.strategy = PIECHART_STRATEGY_DEFAULT;
+    options->compression.threads = 0;
+    options->width = WIDTH;
+    options->height = HEIGHT;
+    options->scale = 1.0;
+    options->sizes_count = 0;
+    options->cache_size = 0;
+    options->cache_dir = NULL;
+    options->cache_dir_size = 0;
+    options->cache = NULL;
+    options->profiling = false;
+    options->profile_file = NULL;
+
+    int count = 1;
+    for (int i = 1; i < *argc; i++)
+    {
+        char *value = i + 1 < *argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--colors") == 0 && value)
+        {
+            unsigned long long seed;
+            if (strcmp(value, "random") == 0)
+                options->color_mode = COLORS_RANDOM;
+            else if (strcmp(value, "label") == 0)
+                options->color_mode = COLORS_LABEL;
+            else if (strncmp(value, "seed:", 5) == 0 && parse_count(value + 5, UINT64_MAX, &seed))
+            {
+                options->color_mode = COLORS_SEEDED;
+                options->color_seed = seed;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid color mode: %s (random, label or seed:N)\n", value);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            options->streaming = true;
+        }
+        else if (strcmp(argv[i], "--antialias") == 0)
+        {
+            options->antialias = true;
+        }
+        else if (strcmp(argv[i], "--format") == 0 && value)
+        {
+            if (piechart_format_from_name(value, &options->format))
+            {
+                fprintf(stderr, "Invalid format: %s (png, svg, qoi, ppm, rgba or indexed)\n", value);
+                return 1;
+            }
+            options->format_given = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--png-level") == 0 && value)
+        {
+            if (!is_number(value) || strlen(value) != 1)
+            {
+                fprintf(stderr, "Invalid PNG level: %s (0 to 9)\n", value);
+                return 1;
+            }
+            options->compressing = true;
+            options->compression.level = atoi(value);
+            i++;
+        }
+        else if (strcmp(argv[i], "--png-strategy") == 0 && value)
+        {
+            static const char *strategies[] = {"default", "filtered", "huffman", "rle", "fixed"};
+            int strategy = 0;
+            while (strategy < 5 && strcmp(value, strategies[strategy]) != 0)
+                strategy++;
+            if (strategy == 5)
+            {
+                fprintf(stderr, "Invalid PNG strategy: %s (default, filtered, huffman, rle or fixed)\n", value);
+                return 1;
+            }
+            options->compressing = true;
+            options->compression.strategy = (PieChartStrategy)strategy;
+            i++;
+        }
+        else if (strcmp(argv[i], "--png-threads") == 0 && value)
+        {
+            unsigned long long threads;
+            if (!parse_count(value, INT_MAX, &threads))
+            {
+                fprintf(stderr, "Invalid PNG threads: %s (0 for one per processor)\n", value);
+                return 1;
+            }
+            options->compressing = true;
+            options->compression.threads = (int)threads;
+            i++;
+        }
+        else if (strcmp(argv[i], "--size") == 0 && value)
+        {
+            char extra;
+            if (sscanf(value, "%dx%d%c", &options->width, &options->height, &extra) != 2)
+            {
+                fprintf(stderr, "Invalid canvas size: %s (WIDTHxHEIGHT)\n", value);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && value)
+        {
+            char *end;
+            options->scale = strtod(value, &end);
+            if (end == value || *end != '\0')
+            {
+                fprintf(stderr, "Invalid scale: %s\n", value);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--sizes") == 0 && value)
+        {
+            if (parse_sizes(value, options))
+            {
+                fprintf(stderr, "Invalid sizes: %s (WIDTHxHEIGHT[@SCALE],... up to %d sizes)\n", value, PIECHART_MAX_SIZES);
+                return 1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && value)
+        {
+            unsigned long long megabytes;
+            if (!parse_count(value, SIZE_MAX / (1024 * 1024), &megabytes))
+            {
+                fprintf(stderr, "Invalid cache size: %s (megabytes)\n", value);
+                return 1;
+            }
+            options->cache_size = megabytes * 1024 * 1024;
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-dir-size") == 0 && value)
+        {
+            unsigned long long megabytes;
+            if (!parse_count(value, SIZE_MAX / (1024 * 1024), &megabytes))
+            {
+                fprintf(stderr, "Invalid cache directory size: %s (megabytes)\n", value);
+                return 1;
+            }
+            options->cache_dir_size = megabytes * 1024 * 1024;
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0 && value)
+        {
+            options->cache_dir = value;
+            i++;
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            options->profiling = true;
+        }
+        else if (strcmp(argv[i], "--profile-file") == 0 && value)
+        {
+            options->profiling = true;
+            options->profile_file = value;
+            i++;
+        }
+        else
+        {
+            argv[count++] = argv[i];
+        }
+    }
+    argv[count] = NULL;
+    *argc = count;
+    return 0;
 }
 
 int handle_input(int argc, char **argv, ControllerData *data)
 {
+    RenderOptions options;
+    if (extract_render_options(&argc, argv, &options))
+        return 1;
+
+    if (data->renderer && piechart_renderer_set_size(data->renderer, options.width, options.height, options.scale))
+    {
+        fprintf(stderr, "Invalid canvas size: %dx%d at scale %g (%d to %d pixels per side)\n", options.width,
+                options.height, options.scale, MIN_CANVAS_SIZE, MAX_CANVAS_SIZE);
+        return 1;
+    }
+
+    if (options.format == PIECHART_FORMAT_INDEXED && options.antialias)
+    {
+        fprintf(stderr, "The indexed format needs the palette canvas, it cannot be anti-aliased\n");
+        return 1;
+    }
+
+    if (options.cache_dir_size && !options.cache_dir)
+    {
+        fprintf(stderr, "--cache-dir-size bounds the store of --cache-dir, which is missing\n");
+        return 1;
+    }
+    if (options.cache_size || options.cache_dir)
+    {
+        if (options.color_mode == COLORS_RANDOM)
+            fprintf(stderr, "Warning: with random colors every chart differs, use --colors label or seed:N to benefit from the cache\n");
+        options.cache = piechart_cache_create(options.cache_size ? options.cache_size : 64 * 1024 * 1024, options.cache_dir);
+        if (!options.cache)
+        {
+            fprintf(stderr, "Error creating the render cache\n");
+            return 1;
+        }
+        if (options.cache_dir_size)
+            piechart_cache_set_disk_limit(options.cache, options.cache_dir_size);
+    }
+
+    if (options.profile_file)
+    {
+        profile_stream = fopen(options.profile_file, "a");
+        if (!profile_stream)
+        {
+            perror("Error opening the profile file");
+            piechart_cache_destroy(options.cache);
+            return 1;
+        }
+    }
+
+    // Apply the options to the data created by main() and to every ControllerData to come
+    controller_configure(&options);
+    data->color_mode = options.color_mode;
+    data->color_seed = options.color_seed;
+    data->sizes = render_options.sizes;
+    data->sizes_count = render_options.sizes_count;
+    data->cache = options.cache;
+    data->profile.enabled = options.profiling;
+    if (data->renderer)
+    {
+        piechart_renderer_set_streaming(data->renderer, options.streaming);
+        piechart_renderer_set_antialias(data->renderer, options.antialias);
+        piechart_renderer_set_format(data->renderer, options.format);
+        if (piechart_renderer_set_compression(data->renderer, options.compressing ? &options.compression : NULL))
+        {
+            fprintf(stderr, "Invalid PNG compression settings\n");
+            return 1;
+        }
+    }
+
+    int result = dispatch_input(argc, argv, data);
+    controller_reset(data); // Writes the profile of the last chart while the file is open
+
+    if (profile_stream)
+    {
+        fclose(profile_stream);
+        profile_stream = NULL;
+    }
+
+    if (options.cache)
+    {
+        PieChartCacheStats stats;
+        piechart_cache_get_stats(options.cache, &stats);
+        fprintf(stderr,
+                "Render cache: %ld hits, %ld disk hits, %ld misses, %ld evictions, %ld disk evictions, %d entries (%zu bytes)\n",
+                stats.hits, stats.disk_hits, stats.misses, stats.evictions, stats.disk_evictions, stats.entries, stats.bytes);
+        data->cache = NULL;
+        piechart_cache_destroy(options.cache);
+    }
+    return result;
+}
+
+/**
+ * @brief Runs the mode selected on the command line.
+ */
+static int dispatch_input(int argc, char **argv, ControllerData *data)
+{
+    // Batch mode: render every chart listed in the manifest within this process
+    if (argc > 2 && strcmp(argv[1], "--batch") == 0)
+    {
+        return run_batch(argc, argv);
+    }
+
+    // Server mode: keep rendering charts posted over HTTP
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+    {
+        return run_server(argc, argv);
+    }
+
+    // Co-process mode: exchange length-prefixed frames with the parent process
+    if (argc > 1 && strcmp(argv[1], "--coprocess") == 0)
+    {
+        return run_coprocess(argc, argv);
+    }
+
+    return render_chart(argc, argv, data);
+}
+
+int render_chart(int argc, char **argv, ControllerData *data)
+{
+    if (parse_chart(argc, argv, data))
+        return 1;
+    if (data->sizes_count)
+        return render_chart_sizes(data);
+    if (draw_chart(data) || encode_chart(data) || write_chart(data))
+        return 1;
+    return 0;
+}
+
+/**
+ * @brief Builds the output file of one size: the size is inserted before the extension.
+ */
+static char *sized_output_file(const char *output_file, const PieChartSize *size)
+{
+    const char *slash = strrchr(output_file, '/'), *dot = strrchr(output_file, '.');
+    size_t stem = dot && (!slash || dot > slash) ? (size_t)(dot - output_file) : strlen(output_file);
+    char suffix[64];
+    if (size->scale == 1.0)
+        snprintf(suffix, sizeof(suffix), "-%dx%d", size->width, size->height);
+    else
+        snprintf(suffix, sizeof(suffix), "-%dx%d@%gx", size->width, size->height, size->scale);
+
+    char *name = malloc(strlen(output_file) + strlen(suffix) + 1);
+    if (name)
+        sprintf(name, "%.*s%s%s", (int)stem, output_file, suffix, output_file + stem);
+    return name;
+}
+
+static int write_sized_chart(void *context, int index, const unsigned char *png, size_t length)
+{
+    ControllerData *data = context;
+    double start = profile_start();
+    PIECHART_PROBE1(write_start, length);
+    char *name = sized_output_file(data->output_file, &data->sizes[index]);
+    int failed = name == NULL || write_output(png, length, name);
+    free(name);
+    PIECHART_PROBE2(write_done, length, failed);
+    profile_stop(PROFILE_WRITE, start);
+    data->profile.bytes += failed ? 0 : length;
+    return failed;
+}
+
+int render_chart_sizes(ControllerData *data)
+{
+    if (strcmp(data->output_file, "-") == 0)
+    {
+        fprintf(stderr, "Several sizes cannot be written to the standard output\n");
+        return 1;
+    }
+    profile_enter(&data->profile);
+    int failed = !data->renderer || piechart_render_sizes(data->renderer, data->segments, data->segments_count,
+                                                          data->title, data->sizes, data->sizes_count,
+                                                          write_sized_chart, data);
+    // The draw, encode and write of every size are timed where they run
+    profile_exit(&data->profile);
+    if (failed)
+    {
+        fprintf(stderr, "Error during chart rendering!\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Replaces the extension of a file name allocated with malloc, freeing it on failure.
+ */
+static char *replace_extension(char *file, const char *extension)
+{
+    const char *slash = strrchr(file, '/');
+    char *dot = strrchr(file, '.');
+    size_t stem = dot && (!slash || dot > slash) ? (size_t)(dot - file) : strlen(file);
+    char *renamed = realloc(file, stem + strlen(extension) + 2);
+    if (renamed == NULL)
+    {
+        free(file);
+        return NULL;
+    }
+    sprintf(renamed + stem, ".%s", extension);
+    return renamed;
+}
+
+/**
+ * @brief Body of parse_chart(), timed by it.
+ */
+static int parse_arguments(int argc, char **argv, ControllerData *data)
+{
+    if (!has_arguments(argc))
+    {
+        fprintf(stderr, "No segment values provided!\n");
+        return 1;
+    }
+
+    // An explicit "-o <path>" is moved to the position of the output file
+    char **args = normalize_arguments(argc, argv, &argc);
+    if (!args)
+    {
+        fprintf(stderr, "Error during segment analysis!\n");
+        return 1;
+    }
 
     // Extract necessary information from command-line arguments (this is part of the Model)
-    char *output_file = generate_output_file(argc, argv);
-    char *base_name = generate_base_name_from_executable(argv[0]);
-    char *title = retrieve_title(argc, argv, base_name);
-    int segments_count = 0;
-    data->segments = parse_segments(argv, &segments_count, argc, !is_number(argv[1]));
+    bool named = argc > 1 && !is_number(args[1]);
+    data->output_file = generate_output_file(argc, args);
+    data->format = render_options.format;
+    if (data->output_file && named && !render_options.format_given)
+        piechart_format_from_path(data->output_file, &data->format); // chart.qoi is written as QOI
+    else if (data->output_file && !named)
+        data->output_file = replace_extension(data->output_file, piechart_format_extension(data->format));
+    if (data->renderer)
+        piechart_renderer_set_format(data->renderer, data->format);
+    data->base_name = generate_base_name_from_executable(args[0]);
+    data->title = retrieve_title(argc, args, data->base_name);
+    data->segments = parse_segments(args, &data->segments_count, argc, argc > 1 && !is_number(args[1]), &data->arena);
+    free(args);
 
-    if (!data->segments)
+    if (!data->output_file || !data->title || !data->segments)
     {
-        printf("Error during segment analysis!\n");
+        fprintf(stderr, "Error during segment analysis!\n");
         return 1;
     }
 
-    // Create and render the pie chart (this is the View)
-    data->img = create_pie_chart_image(data->segments, segments_count, title);
+    if (data->segments_count == 0)
+    {
+        fprintf(stderr, "No segment values provided!\n");
+        return 1;
+    }
 
-    // Save the pie chart image to the output file
-    FILE *fp = fopen(output_file, "wb+");
-    if (!fp)
+    // Colors: random, the same sequence for every chart, or derived from the labels
+    if (data->color_mode == COLORS_LABEL)
     {
-        perror("Error opening output file for writing");
+        piechart_assign_label_colors(data->segments, data->segments_count);
+    }
+    else
+    {
+        if (data->color_mode == COLORS_SEEDED)
+            data->color_state = derive_color_seed(data->color_seed, 0);
+        piechart_assign_random_colors(data->segments, data->segments_count, &data->color_state);
+    }
+    return 0;
+}
+
+int parse_chart(int argc, char **argv, ControllerData *data)
+{
+    double start = profile_enter(&data->profile);
+    PIECHART_PROBE1(chart_start, argc);
+    int failed = parse_arguments(argc, argv, data);
+    profile_leave(&data->profile, PROFILE_PARSE, start);
+    return failed;
+}
+
+int draw_chart(ControllerData *data)
+{
+    if (!data->renderer)
+    {
+        fprintf(stderr, "Error during chart rendering!\n");
         return 1;
     }
-    gdImagePng(data->img, fp);
-    fclose(fp);
 
+    // An identical chart may already have been encoded
+    double start = profile_enter(&data->profile);
+    data->cache_hit = data->cache && piechart_cache_lookup(data->cache, data->renderer, data->segments, data->segments_count,
+                                                           data->title, &data->png, &data->png_size);
+
+    // Render the pie chart (this is the View)
+    int failed = !data->cache_hit && piechart_draw(data->renderer, data->segments, data->segments_count, data->title);
+    profile_leave(&data->profile, PROFILE_DRAW, start);
+    if (failed)
+    {
+        fprintf(stderr, "Error during chart rendering!\n");
+        return 1;
+    }
     return 0;
 }
 
-void controller_cleanup(ControllerData *data)
+int encode_chart(ControllerData *data)
 {
-    if (data->img)
+    if (data->cache_hit)
+        return 0;
+
+    double start = profile_enter(&data->profile);
+    PIECHART_PROBE1(encode_start, data->format);
+    int failed = piechart_encode(data->renderer, &data->png, &data->png_size);
+    PIECHART_PROBE3(encode_done, data->format, failed ? 0 : data->png_size, failed);
+    if (!failed && data->cache)
+        piechart_cache_store(data->cache, data->renderer, data->segments, data->segments_count, data->title);
+    profile_leave(&data->profile, PROFILE_ENCODE, start);
+    if (failed)
     {
-        gdImageDestroy(data->img);
+        fprintf(stderr, "Error during chart encoding!\n");
+        return 1;
     }
+    return 0;
+}
 
-    if (data->segments)
+int write_chart(ControllerData *data)
+{
+    // Save the pie chart image to the output file (or stream it to stdout)
+    double start = profile_enter(&data->profile);
+    PIECHART_PROBE1(write_start, data->png_size);
+    int failed = write_output(data->png, data->png_size, data->output_file);
+    PIECHART_PROBE2(write_done, data->png_size, failed);
+    data->profile.bytes += failed ? 0 : data->png_size;
+    profile_leave(&data->profile, PROFILE_WRITE, start);
+    return failed;
+}
+
+void controller_reset(ControllerData *data)
+{
+    // The end of a chart, rendered or not, once parse_chart() has named it
+    if (data->output_file)
+        PIECHART_PROBE3(chart_done, data->segments_count, data->png_size, data->cache_hit);
+    if (data->profile.started)
     {
-        free_segments(data->segments, data->segments_count);
+        profile_write(profile_stream ? profile_stream : stderr, &data->profile, data->output_file,
+                      piechart_format_name(data->format), data->segments_count, data->cache_hit);
     }
+    profile_reset(&data->profile);
+
+    // The segments and their labels, in one shot; the arena keeps its block for the next chart
+    arena_reset(&data->arena);
+    data->segments = NULL;
+    data->segments_count = 0;
+
+    data->png = NULL;
+    data->png_size = 0;
+    data->cache_hit = false;
+
+    free(data->output_file);
+    free(data->base_name);
+    data->output_file = NULL;
+    data->format = render_options.format;
+    data->base_name = NULL;
+    data->title = NULL;
+}
+
+void controller_cleanup(ControllerData *data)
+{
+    controller_reset(data);
+    arena_free(&data->arena);
+    piechart_renderer_destroy(data->renderer);
+    data->renderer = NULL;
 }
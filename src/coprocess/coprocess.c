@@ -0,0 +1,123 @@
+/**
+ * @file coprocess.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Co-process mode rendering length-prefixed chart frames read from stdin.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "coprocess.h"
+#include "batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Reads a 4-byte big-endian length.
+ *
+ * @return 1 on success, 0 on a clean end of file, -1 on a truncated header.
+ */
+static int read_length(FILE *in, uint32_t *length)
+{
+    unsigned char bytes[4];
+    size_t count = fread(bytes, 1, sizeof(bytes), in);
+    if (count == 0 && feof(in))
+        return 0;
+    if (count != sizeof(bytes))
+        return -1;
+    *length = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+    return 1;
+}
+
+/**
+ * @brief Writes one response frame and flushes it to the parent process.
+ */
+static int write_frame(FILE *out, char status, const void *payload, uint32_t length)
+{
+    unsigned char header[5] = {length >> 24, length >> 16, length >> 8, length, (unsigned char)status};
+    if (fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+        fwrite(payload, 1, length, out) != length || fflush(out) != 0)
+    {
+        perror("Error writing co-process frame");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_error(FILE *out, const char *message)
+{
+    return write_frame(out, COPROCESS_STATUS_ERROR, message, strlen(message));
+}
+
+int run_coprocess(int argc, char **argv)
+{
+    (void)argc;
+    ControllerData data;
+    controller_init(&data);
+
+    // Buffers reused from one frame to the next
+    char *spec = NULL;
+    uint32_t spec_capacity = 0;
+    char **chart_argv = NULL;
+    int chart_capacity = 0;
+    int result = 0;
+    uint32_t length;
+    int status;
+
+    while ((status = read_length(stdin, &length)) > 0)
+    {
+        if (length >= COPROCESS_MAX_FRAME)
+        {
+            fprintf(stderr, "Co-process frame of %u bytes is too large\n", length);
+            result = 1;
+            break;
+        }
+        if (length + 1 > spec_capacity)
+        {
+            char *grown = realloc(spec, length + 1);
+            if (grown == NULL)
+            {
+                fprintf(stderr, "Out of memory reading a co-process frame\n");
+                result = 1;
+                break;
+            }
+            spec = grown;
+            spec_capacity = length + 1;
+        }
+        if (fread(spec, 1, length, stdin) != length)
+        {
+            fprintf(stderr, "Truncated co-process frame\n");
+            result = 1;
+            break;
+        }
+        spec[length] = '\0';
+
+        int chart_argc = split_spec_line(spec, argv[0], &chart_argv, &chart_capacity);
+        int written;
+        if (chart_argc >= 0 && parse_chart(chart_argc, chart_argv, &data) == 0 &&
+            draw_chart(&data) == 0 && encode_chart(&data) == 0)
+            written = write_frame(stdout, COPROCESS_STATUS_PNG, data.png, data.png_size);
+        else
+            written = write_error(stdout, "Invalid chart specification");
+        controller_reset(&data);
+
+        if (written)
+        {
+            result = 1;
+            break;
+        }
+    }
+
+    if (status < 0)
+    {
+        fprintf(stderr, "Truncated co-process frame header\n");
+        result = 1;
+    }
+
+    free(chart_argv);
+    free(spec);
+    controller_cleanup(&data);
+    return result;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file display.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Display list: the primitives of a chart, independent of the backend drawing them.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "display.h"
+#include <stdlib.h>
+#include <string.h>
+
+void display_list_init(DisplayList *list)
+{
+    memset(list, 0, sizeof(DisplayList));
+}
+
+void display_list_reset(DisplayList *list, int width, int height, PieChartColor background)
+{
+    list->width = width;
+    list->height = height;
+    list->background = background;
+    list->count = 0;
+    list->text_length = 0;
+}
+
+void display_list_free(DisplayList *list)
+{
+    free(list->items);
+    free(list->text);
+    display_list_init(list);
+}
+
+/**
+ * @brief Returns a new item at the end of the list, or NULL if the allocation failed.
+ */
+static DisplayItem *append_item(DisplayList *list, DisplayKind kind, PieChartColor color)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? 2 * list->capacity : 32;
+        DisplayItem *items = realloc(list->items, capacity * sizeof(DisplayItem));
+        if (items == NULL)
+            return NULL;
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    DisplayItem *item = &list->items[list->count++];
+    memset(item, 0, sizeof(DisplayItem));
+    item->kind = kind;
+    item->color = color;
+    return item;
+}
+
+int display_list_add_wedge(DisplayList *list, double cx, double cy, double radius, double start, double end, PieChartColor color,
+                           PieChartColor stroke)
+{
+    DisplayItem *item = append_item(list, DISPLAY_WEDGE, color);
+    if (item == NULL)
+        return 1;
+    item->stroke = stroke;
+    item->wedge.cx = cx;
+    item->wedge.cy = cy;
+    item->wedge.radius = radius;
+    item->wedge.start = start;
+    item->wedge.end = end;
+    return 0;
+}
+
+int display_list_add_line(DisplayList *list, double x0, double y0, double x1, double y1, PieChartColor color)
+{
+    DisplayItem *item = append_item(list, DISPLAY_LINE, color);
+    if (item == NULL)
+        return 1;
+    item->line.x0 = x0;
+    item->line.y0 = y0;
+    item->line.x1 = x1;
+    item->line.y1 = y1;
+    return 0;
+}
+
+int display_list_add_text(DisplayList *list, const char *text, double size, int x, int y, PieChartColor color)
+{
+    size_t length = strlen(text);
+    if (list->text_length + length + 1 > list->text_capacity)
+    {
+        size_t capacity = list->text_capacity ? list->text_capacity : 256;
+        while (capacity < list->text_length + length + 1)
+            capacity *= 2;
+        char *pool = realloc(list->text, capacity);
+        if (pool == NULL)
+            return 1;
+        list->text = pool;
+        list->text_capacity = capacity;
+    }
+
+    DisplayItem *item = append_item(list, DISPLAY_TEXT, color);
+    if (item == NULL)
+        return 1;
+    item->text.x = x;
+    item->text.y = y;
+    item->text.size = size;
+    item->text.offset = list->text_length;
+    item->text.length = length;
+    memcpy(list->text + list->text_length, text, length + 1);
+    list->text_length += length + 1;
+    return 0;
+}
+
+const char *display_item_text(const DisplayList *list, const DisplayItem *item)
+{
+    return list->text + item->text.offset;
+}
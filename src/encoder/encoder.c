@@ -0,0 +1,330 @@
+/**
+ * @file encoder.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief PNG encoder compressing bands of rows in parallel into a single zlib stream.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "encoder.h"
+#include "utils.h"
+#include <zlib.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Size of the deflate window: the dictionary a band is primed with.
+ */
+#define WINDOW_SIZE 32768
+
+/**
+ * @brief A band of rows compressed by one thread.
+ */
+typedef struct PngBand
+{
+    gdImagePtr img;
+    const PngOptions *options;
+    int depth;            ///< Bits per pixel of the rows.
+    size_t row_bytes;     ///< Bytes of a row, its filter byte included.
+    int first, last;      ///< Rows of the band, last excluded.
+    int final;            ///< Last band: ends the zlib stream instead of a sync flush.
+    OutputBuffer output;  ///< Compressed bytes, the zlib header before the first band.
+    uLong adler;          ///< Adler-32 of the raw bytes of the band.
+    int failed;
+    pthread_t thread;
+    int started;          ///< Runs on its own thread, to be joined.
+} PngBand;
+
+static void store_be32(unsigned char *bytes, uint32_t value)
+{
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+int png_write_chunk(PieChartWriteFn write, void *context, const char *type, const unsigned char *data, size_t length)
+{
+    unsigned char header[8], crc[4];
+    store_be32(header, length);
+    memcpy(header + 4, type, 4);
+    uLong sum = crc32(0, header + 4, 4);
+    if (length)
+        sum = crc32(sum, data, length); // A NULL buffer would reset the CRC
+
+    store_be32(crc, sum);
+
+    return write(context, header, sizeof(header)) || (length && write(context, data, length)) ||
+           write(context, crc, sizeof(crc));
+}
+
+int png_write_header(PieChartWriteFn write, void *context, int width, int height, int depth, int color_type, int dpi)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    // Header: no interlacing
+    unsigned char ihdr[13] = {0};
+    store_be32(ihdr, width);
+    store_be32(ihdr + 4, height);
+    ihdr[8] = depth;
+    ihdr[9] = color_type;
+    if (write(context, signature, sizeof(signature)) || png_write_chunk(write, context, "IHDR", ihdr, sizeof(ihdr)))
+        return 1;
+
+    // Physical size: the resolution in pixels per meter, the same on both axes
+    unsigned char phys[9];
+    store_be32(phys, (uint32_t)(dpi / 0.0254 + 0.5));
+    store_be32(phys + 4, (uint32_t)(dpi / 0.0254 + 0.5));
+    phys[8] = 1;
+    return png_write_chunk(write, context, "pHYs", phys, sizeof(phys));
+}
+
+/**
+ * @brief Writes the raw bytes of row y: the filter byte, then the packed pixels.
+ *
+ * Truecolor rows use the Sub filter, the difference with the pixel on the left: a
+ * constant color run becomes a run of zeros, which deflate, and Z_RLE above all, match
+ * much better than the period of 3 bytes of the RGB run. Palette rows are not filtered.
+ */
+static void fill_row(gdImagePtr img, int y, int depth, unsigned char *row)
+{
+    int width = gdImageSX(img);
+    if (gdImageTrueColor(img))
+    {
+        const int *pixels = img->tpixels[y];
+        int left = 0; // Black before the first pixel, as the filter defines it
+        row[0] = 1;
+        for (int x = 0; x < width; x++)
+        {
+            int pixel = pixels[x];
+            row[1 + 3 * x] = gdTrueColorGetRed(pixel) - gdTrueColorGetRed(left);
+            row[2 + 3 * x] = gdTrueColorGetGreen(pixel) - gdTrueColorGetGreen(left);
+            row[3 + 3 * x] = gdTrueColorGetBlue(pixel) - gdTrueColorGetBlue(left);
+            left = pixel;
+        }
+        return;
+    }
+
+    const unsigned char *pixels = img->pixels[y];
+    unsigned char *packed = row + 1;
+    row[0] = 0;
+    if (depth == 8)
+    {
+        memcpy(packed, pixels, width);
+        return;
+    }
+
+    // Several indexes per byte, the leftmost pixel in the high bits
+    int per_byte = 8 / depth, x = 0;
+    for (; x + per_byte <= width; x += per_byte)
+    {
+        unsigned byte = 0;
+        for (int i = 0; i < per_byte; i++)
+            byte = (byte << depth) | pixels[x + i];
+        *packed++ = byte;
+    }
+    if (x < width)
+    {
+        unsigned byte = 0;
+        for (int i = 0; i < per_byte; i++)
+            byte = (byte << depth) | (x + i < width ? pixels[x + i] : 0);
+        *packed = byte;
+    }
+}
+
+/**
+ * @brief Compresses bytes at the end of a buffer, growing it as needed.
+ */
+static int deflate_into(z_stream *deflater, OutputBuffer *output, unsigned char *bytes, size_t length, int flush)
+{
+    deflater->next_in = bytes;
+    deflater->avail_in = length;
+    for (;;)
+    {
+        if (output_buffer_reserve(output, output->length + 64 * 1024))
+            return 1;
+        deflater->next_out = output->data + output->length;
+        deflater->avail_out = output->capacity - output->length;
+        int result = deflate(deflater, flush);
+        output->length = output->capacity - deflater->avail_out;
+        if (result == Z_STREAM_ERROR)
+            return 1;
+        // Room left: the input is consumed, and the flush complete unless the stream must end
+        if (deflater->avail_out != 0 && (flush != Z_FINISH || result == Z_STREAM_END))
+            return 0;
+    }
+}
+
+/**
+ * @brief Deflates the rows of a band as raw deflate blocks, on its own thread.
+ */
+static void *compress_band(void *argument)
+{
+    PngBand *band = argument;
+    z_stream deflater;
+    memset(&deflater, 0, sizeof(deflater));
+    band->failed = 1;
+    band->adler = adler32(0, NULL, 0);
+
+    // The previous band is rendered again as dictionary: long matches still reach across the seam
+    int history = band->first ? MIN(band->first, (int)((WINDOW_SIZE + band->row_bytes - 1) / band->row_bytes)) : 0;
+    unsigned char *rows = malloc((history + 1) * band->row_bytes);
+    if (rows == NULL || deflateInit2(&deflater, band->options->level, Z_DEFLATED, -15, 8, band->options->strategy) != Z_OK)
+    {
+        free(rows);
+        return NULL;
+    }
+
+    int failed = 0;
+    if (history)
+    {
+        size_t length = history * band->row_bytes, used = MIN(length, (size_t)WINDOW_SIZE);
+        for (int i = 0; i < history; i++)
+            fill_row(band->img, band->first - history + i, band->depth, rows + i * band->row_bytes);
+        failed = deflateSetDictionary(&deflater, rows + length - used, used) != Z_OK;
+    }
+    else
+    {
+        // The zlib header: deflate with a 32 KB window, no preset dictionary
+        static const unsigned char header[2] = {0x78, 0x9C};
+        failed = output_buffer_append(&band->output, header, sizeof(header));
+    }
+
+    unsigned char *row = rows + history * band->row_bytes;
+    for (int y = band->first; y < band->last && !failed; y++)
+    {
+        fill_row(band->img, y, band->depth, row);
+        band->adler = adler32(band->adler, row, band->row_bytes);
+        failed = deflate_into(&deflater, &band->output, row, band->row_bytes, Z_NO_FLUSH);
+    }
+
+    // A sync flush ends the band on a byte boundary with a non-final block: the next band follows
+    if (!failed)
+        failed = deflate_into(&deflater, &band->output, NULL, 0, band->final ? Z_FINISH : Z_SYNC_FLUSH);
+    deflateEnd(&deflater);
+    free(rows);
+    band->failed = failed;
+    return NULL;
+}
+
+/**
+ * @brief Bits per palette index: the smallest that holds every color of the palette, like libgd.
+ */
+static int palette_depth(gdImagePtr img)
+{
+    int colors = gdImageColorsTotal(img);
+    return colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+}
+
+static int append_bytes(void *context, const unsigned char *bytes, size_t length)
+{
+    return output_buffer_append(context, bytes, length);
+}
+
+/**
+ * @brief Writes the chunks of the image around the compressed bands.
+ */
+static int write_image(OutputBuffer *buffer, gdImagePtr img, int depth, PngBand *bands, int count)
+{
+    int palette = !gdImageTrueColor(img);
+    if (png_write_header(append_bytes, buffer, gdImageSX(img), gdImageSY(img), depth,
+                         palette ? PNG_COLOR_PALETTE : PNG_COLOR_RGB, img->res_x))
+        return 1;
+
+    if (palette)
+    {
+        unsigned char colors[3 * gdMaxColors];
+        int total = gdImageColorsTotal(img);
+        for (int i = 0; i < total; i++)
+        {
+            colors[3 * i] = img->red[i];
+            colors[3 * i + 1] = img->green[i];
+            colors[3 * i + 2] = img->blue[i];
+        }
+        if (png_write_chunk(append_bytes, buffer, "PLTE", colors, 3 * (size_t)MAX(total, 1)))
+            return 1;
+
+        // Only the transparent color is not opaque
+        int transparent = img->transparent;
+        if (transparent >= 0 && transparent < total)
+        {
+            unsigned char alpha[gdMaxColors];
+            memset(alpha, 255, transparent);
+            alpha[transparent] = 0;
+            if (png_write_chunk(append_bytes, buffer, "tRNS", alpha, transparent + 1))
+                return 1;
+        }
+    }
+
+    // The zlib stream, one IDAT chunk per band
+    for (int i = 0; i < count; i++)
+    {
+        if (png_write_chunk(append_bytes, buffer, "IDAT", bands[i].output.data, bands[i].output.length))
+            return 1;
+    }
+    return png_write_chunk(append_bytes, buffer, "IEND", NULL, 0);
+}
+
+int png_encode_image(OutputBuffer *buffer, gdImagePtr img, const PngOptions *options)
+{
+    int width = gdImageSX(img), height = gdImageSY(img);
+    int depth = gdImageTrueColor(img) ? 8 : palette_depth(img);
+    size_t row_bytes = 1 + (gdImageTrueColor(img) ? 3 * (size_t)width : ((size_t)width * depth + 7) / 8);
+
+    // One band per thread, none smaller than PNG_MIN_BAND_BYTES
+    long threads = options->threads > 0 ? options->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    long by_size = row_bytes * height / PNG_MIN_BAND_BYTES;
+    int count = MAX(1, MIN(MIN(threads, by_size), MIN(height, PNG_MAX_BANDS)));
+
+    PngBand *bands = calloc(count, sizeof(PngBand));
+    if (bands == NULL)
+        return 1;
+    for (int i = 0; i < count; i++)
+    {
+        PngBand *band = &bands[i];
+        band->img = img;
+        band->options = options;
+        band->depth = depth;
+        band->row_bytes = row_bytes;
+        band->first = (int)((long long)height * i / count);
+        band->last = (int)((long long)height * (i + 1) / count);
+        band->final = i == count - 1;
+        output_buffer_init(&band->output);
+    }
+
+    // The calling thread compresses the first band, and any band no thread could be started for
+    for (int i = 1; i < count; i++)
+        bands[i].started = pthread_create(&bands[i].thread, NULL, compress_band, &bands[i]) == 0;
+    compress_band(&bands[0]);
+    int failed = bands[0].failed;
+    for (int i = 1; i < count; i++)
+    {
+        if (bands[i].started)
+            pthread_join(bands[i].thread, NULL);
+        else
+            compress_band(&bands[i]);
+        failed |= bands[i].failed;
+    }
+
+    // The checksum of the whole stream, from the checksums of the bands
+    if (!failed)
+    {
+        uLong adler = bands[0].adler;
+        unsigned char trailer[4];
+        for (int i = 1; i < count; i++)
+            adler = adler32_combine(adler, bands[i].adler, (z_off_t)(bands[i].last - bands[i].first) * row_bytes);
+        store_be32(trailer, adler);
+        failed = output_buffer_append(&bands[count - 1].output, trailer, sizeof(trailer));
+    }
+
+    output_buffer_reset(buffer);
+    failed = failed || write_image(buffer, img, depth, bands, count);
+    for (int i = 0; i < count; i++)
+        output_buffer_free(&bands[i].output);
+    free(bands);
+    return failed;
+}
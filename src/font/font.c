@@ -0,0 +1,366 @@
+/**
+ * @file font.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Glyph atlases: text measured and rasterized from glyphs cached per font size.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "font.h"
+#include "utils.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PIECHART_EMBEDDED_FONT
+// Generated by cmake/embed_font.cmake from PIECHART_FONT_FILE
+extern const unsigned char embedded_font[];
+extern const size_t embedded_font_size;
+#endif
+
+/**
+ * @brief A glyph rasterized at the size of its atlas.
+ */
+typedef struct Glyph
+{
+    uint32_t code;      ///< Unicode code point, 0 for a free slot of the table.
+    FT_UInt index;      ///< Index of the glyph in the face, for the kerning.
+    int left, top;      ///< Position of the coverage relative to the pen, on the baseline.
+    int width, height;
+    FT_Pos advance;     ///< Horizontal advance, in 26.6 fixed point.
+    size_t offset;      ///< Start of the coverage in the pixels of the atlas.
+} Glyph;
+
+/**
+ * @brief The glyphs of one font size: a hash table by code point and their coverage, packed.
+ */
+typedef struct FontAtlas
+{
+    FT_F26Dot6 size;         ///< Font size in points, in 26.6 fixed point.
+    Glyph *glyphs;
+    int capacity;            ///< Slots of the table, a power of two.
+    int count;
+    unsigned char *pixels;
+    size_t used, allocated;
+    struct FontAtlas *next;  ///< Next atlas, from the most to the least recently used.
+} FontAtlas;
+
+/**
+ * @brief The font and the atlases of one thread.
+ */
+typedef struct FontCache
+{
+    FT_Library library;
+    FT_Face face;
+    int failed;              ///< The font could not be loaded, do not try again.
+    FT_F26Dot6 face_size;    ///< Size the face is currently set to.
+    FontAtlas *atlases;
+    int atlases_count;
+    PlacedGlyph *placed;     ///< Glyphs of the last layout.
+    int placed_capacity;
+} FontCache;
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static void free_atlas(FontAtlas *atlas)
+{
+    free(atlas->glyphs);
+    free(atlas->pixels);
+    free(atlas);
+}
+
+/**
+ * @brief Releases the cache of a thread when it exits.
+ */
+static void free_cache(void *pointer)
+{
+    FontCache *cache = pointer;
+    while (cache->atlases)
+    {
+        FontAtlas *next = cache->atlases->next;
+        free_atlas(cache->atlases);
+        cache->atlases = next;
+    }
+    if (cache->face)
+        FT_Done_Face(cache->face);
+    if (cache->library)
+        FT_Done_FreeType(cache->library);
+    free(cache->placed);
+    free(cache);
+}
+
+static void create_cache_key(void)
+{
+    pthread_key_create(&cache_key, free_cache);
+}
+
+static pthread_once_t report_once = PTHREAD_ONCE_INIT;
+
+static void report_missing_font(void)
+{
+#ifdef PIECHART_EMBEDDED_FONT
+    fprintf(stderr, "Cannot load the embedded font, texts are not drawn\n");
+#else
+    fprintf(stderr, "Cannot load the font %s, texts are not drawn\n", FONT_PATH);
+#endif
+}
+
+/**
+ * @brief Opens the face: the font compiled into the library, or FONT_PATH without one.
+ */
+static int open_face(FontCache *cache)
+{
+    if (FT_Init_FreeType(&cache->library) != 0)
+        return 1;
+#ifdef PIECHART_EMBEDDED_FONT
+    // Read in place: every thread shares the same bytes
+    return FT_New_Memory_Face(cache->library, embedded_font, (FT_Long)embedded_font_size, 0, &cache->face) != 0;
+#else
+    return FT_New_Face(cache->library, FONT_PATH, 0, &cache->face) != 0;
+#endif
+}
+
+/**
+ * @brief Returns the cache of the calling thread, loading the font on its first text.
+ */
+static FontCache *thread_cache(void)
+{
+    pthread_once(&cache_key_once, create_cache_key);
+    FontCache *cache = pthread_getspecific(cache_key);
+    if (cache)
+        return cache->failed ? NULL : cache;
+
+    cache = calloc(1, sizeof(FontCache));
+    if (cache == NULL)
+        return NULL;
+    cache->failed = open_face(cache);
+    if (cache->failed)
+        pthread_once(&report_once, report_missing_font);
+    pthread_setspecific(cache_key, cache);
+    return cache->failed ? NULL : cache;
+}
+
+/**
+ * @brief Returns the atlas of a size, created if needed, moved to the front of the list.
+ */
+static FontAtlas *find_atlas(FontCache *cache, FT_F26Dot6 size)
+{
+    FontAtlas **link = &cache->atlases, **last = link;
+    for (; *link; link = &(*link)->next)
+    {
+        if ((*link)->size == size)
+        {
+            FontAtlas *atlas = *link;
+            *link = atlas->next;
+            atlas->next = cache->atlases;
+            cache->atlases = atlas;
+            return atlas;
+        }
+        last = link;
+    }
+
+    // Too many sizes: drop the least recently used one
+    if (cache->atlases_count == FONT_MAX_ATLASES)
+    {
+        free_atlas(*last);
+        *last = NULL;
+        cache->atlases_count--;
+    }
+
+    FontAtlas *atlas = calloc(1, sizeof(FontAtlas));
+    if (atlas)
+    {
+        atlas->capacity = 128;
+        atlas->glyphs = calloc(atlas->capacity, sizeof(Glyph));
+        if (atlas->glyphs == NULL)
+        {
+            free(atlas);
+            return NULL;
+        }
+        atlas->size = size;
+        atlas->next = cache->atlases;
+        cache->atlases = atlas;
+        cache->atlases_count++;
+    }
+    return atlas;
+}
+
+static int slot_of(const FontAtlas *atlas, uint32_t code)
+{
+    int mask = atlas->capacity - 1, slot = (code * 2654435761u) & mask;
+    while (atlas->glyphs[slot].code != 0 && atlas->glyphs[slot].code != code)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/**
+ * @brief Doubles the table of an atlas.
+ */
+static int grow_table(FontAtlas *atlas)
+{
+    Glyph *old = atlas->glyphs;
+    int old_capacity = atlas->capacity;
+    atlas->glyphs = calloc(2 * old_capacity, sizeof(Glyph));
+    if (atlas->glyphs == NULL)
+    {
+        atlas->glyphs = old;
+        return 1;
+    }
+    atlas->capacity = 2 * old_capacity;
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old[i].code != 0)
+            atlas->glyphs[slot_of(atlas, old[i].code)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief Rasterizes a glyph into an atlas. A glyph the font cannot render is kept empty.
+ */
+static int add_glyph(FontCache *cache, FontAtlas *atlas, uint32_t code)
+{
+    if (2 * (atlas->count + 1) > atlas->capacity && grow_table(atlas))
+        return 1;
+
+    if (cache->face_size != atlas->size)
+    {
+        FT_Set_Char_Size(cache->face, 0, atlas->size, FONT_DPI, FONT_DPI);
+        cache->face_size = atlas->size;
+    }
+
+    Glyph glyph = {code, FT_Get_Char_Index(cache->face, code), 0, 0, 0, 0, 0, atlas->used};
+    FT_GlyphSlot slot = cache->face->glyph;
+    if (FT_Load_Glyph(cache->face, glyph.index, FT_LOAD_DEFAULT) == 0 &&
+        FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) == 0)
+    {
+        const FT_Bitmap *bitmap = &slot->bitmap;
+        size_t bytes = (size_t)bitmap->width * bitmap->rows;
+        if (atlas->used + bytes > atlas->allocated)
+        {
+            size_t allocated = MAX(2 * atlas->allocated, atlas->used + bytes);
+            unsigned char *pixels = realloc(atlas->pixels, MAX(allocated, 4096));
+            if (pixels == NULL)
+                return 1;
+            atlas->pixels = pixels;
+            atlas->allocated = MAX(allocated, 4096);
+        }
+        for (unsigned row = 0; row < bitmap->rows; row++)
+            memcpy(atlas->pixels + atlas->used + (size_t)row * bitmap->width, bitmap->buffer + (long)row * bitmap->pitch,
+                   bitmap->width);
+        atlas->used += bytes;
+
+        glyph.left = slot->bitmap_left;
+        glyph.top = slot->bitmap_top;
+        glyph.width = bitmap->width;
+        glyph.height = bitmap->rows;
+        glyph.advance = slot->advance.x;
+    }
+    atlas->glyphs[slot_of(atlas, code)] = glyph;
+    atlas->count++;
+    return 0;
+}
+
+int font_layout_text(TextLayout *layout, const char *text, double size, int x, int y)
+{
+    memset(layout, 0, sizeof(TextLayout));
+    for (int i = 0; i < 8; i += 2)
+    {
+        layout->brect[i] = x;
+        layout->brect[i + 1] = y;
+    }
+
+    // Nothing to draw: FreeType is not even initialized
+    if (*text == '\0')
+        return 0;
+
+    FontCache *cache = thread_cache();
+    FontAtlas *atlas = cache ? find_atlas(cache, (FT_F26Dot6)(size * 64 + 0.5)) : NULL;
+    if (atlas == NULL)
+        return 1;
+
+    // Rasterize the glyphs not seen yet at this size, the table may move meanwhile
+    // Overlong and malformed sequences are read as Latin-1: a code is never 0, the free slot
+    const unsigned char *end = (const unsigned char *)text + strlen(text);
+    int length = 0;
+    for (const unsigned char *bytes = (const unsigned char *)text; *bytes; length++)
+    {
+        uint32_t code = utf8_next(&bytes, end);
+        if (atlas->glyphs[slot_of(atlas, code)].code == 0 && add_glyph(cache, atlas, code))
+            return 1;
+    }
+    if (length > cache->placed_capacity)
+    {
+        PlacedGlyph *placed = realloc(cache->placed, length * sizeof(PlacedGlyph));
+        if (placed == NULL)
+            return 1;
+        cache->placed = placed;
+        cache->placed_capacity = length;
+    }
+    if (cache->face_size != atlas->size)
+    {
+        FT_Set_Char_Size(cache->face, 0, atlas->size, FONT_DPI, FONT_DPI);
+        cache->face_size = atlas->size;
+    }
+
+    // Then only table lookups: the pen advances glyph by glyph, kerned
+    int kerning = FT_HAS_KERNING(cache->face), left = x, right = x, top = y, bottom = y;
+    FT_Pos pen = 0;
+    FT_UInt previous = 0;
+    for (const unsigned char *bytes = (const unsigned char *)text; *bytes;)
+    {
+        const Glyph *glyph = &atlas->glyphs[slot_of(atlas, utf8_next(&bytes, end))];
+        FT_Vector delta;
+        if (kerning && previous && glyph->index &&
+            FT_Get_Kerning(cache->face, previous, glyph->index, FT_KERNING_DEFAULT, &delta) == 0)
+            pen += delta.x;
+        previous = glyph->index;
+
+        if (glyph->width > 0 && glyph->height > 0)
+        {
+            PlacedGlyph *placed = &cache->placed[layout->count++];
+            placed->x = x + (int)(pen >> 6) + glyph->left;
+            placed->y = y - glyph->top;
+            placed->width = glyph->width;
+            placed->height = glyph->height;
+            placed->coverage = atlas->pixels + glyph->offset;
+            left = MIN(left, placed->x);
+            right = MAX(right, placed->x + placed->width);
+            top = MIN(top, placed->y);
+            bottom = MAX(bottom, placed->y + placed->height);
+        }
+        pen += glyph->advance;
+    }
+    right = MAX(right, x + (int)(pen >> 6));
+
+    layout->glyphs = cache->placed;
+    int brect[8] = {left, bottom, right, bottom, right, top, left, top};
+    memcpy(layout->brect, brect, sizeof(brect));
+    return 0;
+}
+
+int font_measure_text(const char *text, double size, int x, int y, int brect[8])
+{
+    TextLayout layout;
+    int failed = font_layout_text(&layout, text, size, x, y);
+    memcpy(brect, layout.brect, sizeof(layout.brect));
+    return failed;
+}
+
+int font_cached_glyphs(void)
+{
+    pthread_once(&cache_key_once, create_cache_key);
+    const FontCache *cache = pthread_getspecific(cache_key);
+    int glyphs = 0;
+    for (const FontAtlas *atlas = cache ? cache->atlases : NULL; atlas; atlas = atlas->next)
+        glyphs += atlas->count;
+    return glyphs;
+}
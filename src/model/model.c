@@ -15,65 +15,95 @@
 #include <ctype.h>
 #include <libgen.h>
 
-void free_segments(PieChartSegment *segments, int length)
+/**
+ * @brief Whether an argument ends the values and labels: the title option.
+ */
+static bool is_title_option(const char *argument)
 {
-    for (int i = 0; i < length; i++)
-    {
-        free(segments[i].label);
-    }
-    free(segments);
+    return strcmp(argument, "-T") == 0 || strcmp(argument, "--titre") == 0;
 }
 
-PieChartSegment *parse_segments(char **input, int *length, int argc, bool output_file_name)
+PieChartSegment *parse_segments(char **input, int *length, int argc, bool output_file_name, Arena *arena)
 {
-    // TODO: Parse percentages and labels from the input string
-    // Store the total number of segments in *length
-    // Return an array of PieChartSegments
-    int segmentIndex = 1;
-    int segmentLengh = 1;
-    int i = 0;
+    int first_value = output_file_name ? 2 : 1;
+    int first_label = first_value;
     *length = 0;
-    if (output_file_name)
-    {
-        segmentIndex++;
-        segmentLengh++;
-    }
-    while (segmentLengh < argc && is_number(input[segmentLengh]) && (strcmp(input[segmentLengh], "-T") != 0 && strcmp(input[segmentLengh], "--titre") != 0))
+    while (first_label < argc && is_number(input[first_label]) && !is_title_option(input[first_label]))
     {
         (*length)++;
-        segmentLengh++;
+        first_label++;
     }
 
-    PieChartSegment *segments = malloc(*length * sizeof(PieChartSegment));
+    // The labels, then the bytes of the pool: one allocation for the whole chart
+    size_t pool_size = 1; // The empty label shared by the segments without one
+    for (int i = 0; i < *length; i++)
+    {
+        int label = first_label + i;
+        if (label < argc && !is_title_option(input[label]))
+            pool_size += strnlen(input[label], MAX_LABEL_LENGTH) + 1;
+    }
+    size_t array_size = (size_t)*length * sizeof(PieChartSegment);
+    PieChartSegment *segments = arena_alloc(arena, array_size + pool_size);
     if (segments == NULL)
         return NULL; // Stop processing if allocation error occurs
 
-    while (i < *length)
+    char *pool = (char *)segments + array_size;
+    char *empty = pool++;
+    *empty = '\0';
+    for (int i = 0; i < *length; i++)
     {
-        int labelIndex = segmentLengh + i;
-        segments[i].label = malloc(256 * sizeof(char));
-        if (segments[i].label == NULL)
-        {
-            free_segments(segments, i); // Libérer la mémoire pour les segments précédents
-            return NULL;
-        }
-        sscanf(input[segmentIndex], "%lf", &(segments[i].percentage));
-
-        if (labelIndex < argc && (strcmp(input[labelIndex], "-T") != 0 && strcmp(input[labelIndex], "--titre") != 0))
+        int label = first_label + i;
+        segments[i].percentage = strtod(input[first_value + i], NULL);
+        segments[i].color = (PieChartColor){0, 0, 0};
+        if (label < argc && !is_title_option(input[label]))
         {
-            strncpy(segments[i].label, input[labelIndex], 255);
-            segments[i].label[255] = '\0'; // Assure que la chaîne est terminée
+            size_t size = strnlen(input[label], MAX_LABEL_LENGTH);
+            memcpy(pool, input[label], size);
+            pool[size] = '\0';
+            segments[i].label = pool;
+            pool += size + 1;
         }
         else
         {
-            segments[i].label[0] = '\0'; // Label vide si pas d'argument fourni
+            segments[i].label = empty; // Label vide si pas d'argument fourni
         }
-        segmentIndex++;
-        i++;
     }
     return segments;
 }
 
+char **normalize_arguments(int argc, char **argv, int *normalized_argc)
+{
+    char **normalized = malloc((argc + 1) * sizeof(char *));
+    if (normalized == NULL)
+        return NULL;
+
+    // Find an explicit "-o <path>" option
+    int option = 0;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0)
+        {
+            option = i;
+            break;
+        }
+    }
+
+    int count = 0;
+    normalized[count++] = argv[0];
+    if (option)
+        normalized[count++] = argv[option + 1]; // L'option devient le fichier de sortie positionnel
+    for (int i = 1; i < argc; i++)
+    {
+        if (option && (i == option || i == option + 1))
+            continue;
+        normalized[count++] = argv[i];
+    }
+    normalized[count] = NULL;
+
+    *normalized_argc = count;
+    return normalized;
+}
+
 char *generate_output_file(int argc, char **argv)
 {
     char *output_file;
@@ -86,6 +116,8 @@ char *generate_output_file(int argc, char **argv)
     else
     {
         char *base_name = generate_base_name_from_executable(argv[0]);
+        if (base_name == NULL)
+            return NULL;
         size_t len = strlen(base_name) + 5; // Espace pour l'extension ".png"
         output_file = malloc(len * sizeof(char));
         if (output_file)
@@ -118,7 +150,14 @@ char *retrieve_title(int argc, char **argv, char *base_name)
 
 char *generate_base_name_from_executable(const char *executable_name)
 {
-    return basename(strdup(executable_name)); // Extrait le nom de base
+    char *path = strdup(executable_name);
+    if (path == NULL)
+        return NULL;
+
+    // basename() may return a pointer inside path, copy it so the result can be freed
+    char *base_name = strdup(basename(path));
+    free(path);
+    return base_name;
 }
 
 bool is_number(char *str)
@@ -127,6 +166,7 @@ bool is_number(char *str)
         return false;
 
     bool has_dot = false; // Pour vérifier qu'il y a au plus un point décimal
+    bool has_digit = false; // "-", "+" ou "." seuls ne sont pas des nombres
 
     if (*str == '-' || *str == '+') // Gérer un éventuel signe au début
         str++;
@@ -141,11 +181,13 @@ bool is_number(char *str)
         }
         else if (!isdigit((unsigned char)*str))
             return false;
+        else
+            has_digit = true;
 
         str++;
     }
 
-    return true;
+    return has_digit;
 }
 
 bool has_arguments(int argc)
@@ -153,11 +195,37 @@ bool has_arguments(int argc)
     return argc >= 2;
 }
 
-Color generate_random_color()
+/**
+ * @brief Advances a SplitMix64 generator and returns its next value.
+ */
+static uint64_t next_random(uint64_t *state)
 {
-    Color color;
-    color.r = rand() % 256;
-    color.g = rand() % 256;
-    color.b = rand() % 256;
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+PieChartColor generate_random_color(uint64_t *state)
+{
+    uint64_t value = next_random(state);
+    PieChartColor color;
+    color.r = value & 0xFF;
+    color.g = (value >> 8) & 0xFF;
+    color.b = (value >> 16) & 0xFF;
     return color;
 }
+
+uint64_t derive_color_seed(uint64_t seed, uint64_t index)
+{
+    uint64_t state = seed ^ (index * 0xD1B54A32D192ED03ULL);
+    return next_random(&state);
+}
+
+void assign_segment_colors(PieChartSegment *segments, int length, uint64_t *state)
+{
+    for (int i = 0; i < length; i++)
+    {
+        segments[i].color = generate_random_color(state);
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ * @file output.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief In-memory output of encoded charts, written to a file or streamed to stdout.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/**
+ * @brief libgd output context appending everything it receives to an OutputBuffer.
+ */
+typedef struct BufferContext
+{
+    gdIOCtx ctx; ///< Must stay the first member, libgd only knows about it.
+    OutputBuffer *buffer;
+    int failed;
+} BufferContext;
+
+void output_buffer_init(OutputBuffer *buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+void output_buffer_reset(OutputBuffer *buffer)
+{
+    buffer->length = 0;
+}
+
+void output_buffer_free(OutputBuffer *buffer)
+{
+    free(buffer->data);
+    output_buffer_init(buffer);
+}
+
+int output_buffer_reserve(OutputBuffer *buffer, size_t capacity)
+{
+    if (capacity <= buffer->capacity)
+        return 0;
+
+    size_t new_capacity = buffer->capacity ? buffer->capacity : 64 * 1024;
+    while (new_capacity < capacity)
+        new_capacity *= 2;
+
+    unsigned char *grown = realloc(buffer->data, new_capacity);
+    if (grown == NULL)
+        return 1;
+    buffer->data = grown;
+    buffer->capacity = new_capacity;
+    return 0;
+}
+
+int output_buffer_append(OutputBuffer *buffer, const void *bytes, size_t length)
+{
+    if (output_buffer_reserve(buffer, buffer->length + length))
+        return 1;
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return 0;
+}
+
+static int context_put_buf(gdIOCtx *ctx, const void *bytes, int length)
+{
+    BufferContext *context = (BufferContext *)ctx;
+    if (output_buffer_append(context->buffer, bytes, length))
+    {
+        context->failed = 1;
+        return 0;
+    }
+    return length;
+}
+
+static void context_put_c(gdIOCtx *ctx, int c)
+{
+    unsigned char byte = c;
+    context_put_buf(ctx, &byte, 1);
+}
+
+static long context_tell(gdIOCtx *ctx)
+{
+    return ((BufferContext *)ctx)->buffer->length;
+}
+
+static int context_seek(gdIOCtx *ctx, const int position)
+{
+    BufferContext *context = (BufferContext *)ctx;
+    if (position < 0 || (size_t)position > context->buffer->length)
+        return 0;
+    context->buffer->length = position;
+    return 1;
+}
+
+int output_buffer_encode_png(OutputBuffer *buffer, gdImagePtr img)
+{
+    BufferContext context;
+    memset(&context, 0, sizeof(context));
+    context.ctx.putC = context_put_c;
+    context.ctx.putBuf = context_put_buf;
+    context.ctx.tell = context_tell;
+    context.ctx.seek = context_seek;
+    context.buffer = buffer;
+
+    output_buffer_reset(buffer);
+    gdImagePngCtx(img, &context.ctx);
+    return context.failed || buffer->length == 0;
+}
+
+int write_output(const void *bytes, size_t length, const char *path)
+{
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE *fp = to_stdout ? stdout : fopen(path, "wb");
+    if (!fp)
+    {
+        perror("Error opening output file for writing");
+        return 1;
+    }
+
+    size_t written = fwrite(bytes, 1, length, fp);
+    int closed = to_stdout ? fflush(fp) : fclose(fp);
+    if (closed != 0 || written != length)
+    {
+        perror("Error writing output file");
+        return 1;
+    }
+    return 0;
+}
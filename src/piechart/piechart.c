@@ -0,0 +1,533 @@
+/**
+ * @file piechart.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Public API of the piechart library: a reusable renderer context.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "piechart.h"
+#include "model.h"
+#include "view.h"
+#include "output.h"
+#include "cache.h"
+#include "stream.h"
+#include "svg.h"
+#include "encoder.h"
+#include "raster.h"
+#include "profile.h"
+#include <zlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+struct PieChartRenderer
+{
+    gdImagePtr canvas;   ///< Reused while the chart size does not change.
+    OutputBuffer output; ///< Last encoded image, reused between charts.
+    OutputBuffer key;    ///< Scratch buffer for the cache key of a chart.
+    DisplayList display; ///< Primitives of the last drawn chart, reused between charts.
+    PieChartFormat format;
+    int compressing;     ///< Encode the canvas with png_encode_image() instead of libgd.
+    PngOptions compression;
+    int streaming;       ///< Encode from the geometry instead of drawing on the canvas.
+    int antialias;       ///< Draw on a truecolor canvas with anti-aliased edges.
+    int width, height;   ///< Size of the charts in pixels.
+    int dpi;             ///< Resolution recorded in the PNG.
+    gdImagePtr sized[PIECHART_MAX_SIZES]; ///< Canvases of piechart_render_sizes(), one per requested size.
+    const PieChartSegment *segments; ///< Chart recorded by piechart_draw() in streaming mode.
+    int count;
+    const char *title;
+};
+
+PieChartRenderer *piechart_renderer_create(void)
+{
+    PieChartRenderer *renderer = calloc(1, sizeof(PieChartRenderer));
+    if (renderer == NULL)
+        return NULL;
+    output_buffer_init(&renderer->output);
+    output_buffer_init(&renderer->key);
+    display_list_init(&renderer->display);
+    renderer->width = WIDTH;
+    renderer->height = HEIGHT;
+    renderer->dpi = BASE_DPI;
+    return renderer;
+}
+
+void piechart_renderer_destroy(PieChartRenderer *renderer)
+{
+    if (renderer == NULL)
+        return;
+    piechart_renderer_trim(renderer);
+    output_buffer_free(&renderer->output);
+    output_buffer_free(&renderer->key);
+    display_list_free(&renderer->display);
+    free(renderer);
+}
+
+void piechart_renderer_trim(PieChartRenderer *renderer)
+{
+    if (renderer->canvas)
+    {
+        gdImageDestroy(renderer->canvas);
+        renderer->canvas = NULL;
+    }
+    for (int i = 0; i < PIECHART_MAX_SIZES; i++)
+    {
+        if (renderer->sized[i])
+        {
+            gdImageDestroy(renderer->sized[i]);
+            renderer->sized[i] = NULL;
+        }
+    }
+}
+
+void piechart_renderer_set_streaming(PieChartRenderer *renderer, int enabled)
+{
+    renderer->streaming = enabled;
+    renderer->segments = NULL;
+    if (enabled)
+        piechart_renderer_trim(renderer);
+}
+
+void piechart_renderer_set_antialias(PieChartRenderer *renderer, int enabled)
+{
+    // The canvas changes of kind
+    if (renderer->antialias != !!enabled)
+        piechart_renderer_trim(renderer);
+    renderer->antialias = !!enabled;
+}
+
+/**
+ * @brief Converts a chart size and scale to pixels and resolution, returns 1 if out of bounds.
+ */
+static int scale_size(int width, int height, double scale, int *pixels_width, int *pixels_height, int *dpi)
+{
+    // Rounded, so that a scale of 1.5 on an odd size does not lose the last pixel
+    double pixels_x = width * scale + 0.5, pixels_y = height * scale + 0.5;
+    if (!(scale > 0) || pixels_x < MIN_CANVAS_SIZE || pixels_x >= MAX_CANVAS_SIZE + 1 ||
+        pixels_y < MIN_CANVAS_SIZE || pixels_y >= MAX_CANVAS_SIZE + 1)
+        return 1;
+    *pixels_width = pixels_x;
+    *pixels_height = pixels_y;
+    *dpi = BASE_DPI * scale + 0.5;
+    return 0;
+}
+
+int piechart_renderer_set_size(PieChartRenderer *renderer, int width, int height, double scale)
+{
+    int pixels_width, pixels_height, dpi;
+    if (scale_size(width, height, scale, &pixels_width, &pixels_height, &dpi))
+        return 1;
+
+    // The canvas is only reusable for charts of its own size
+    if (renderer->width != pixels_width || renderer->height != pixels_height)
+        piechart_renderer_trim(renderer);
+    renderer->width = pixels_width;
+    renderer->height = pixels_height;
+    renderer->dpi = dpi;
+    return 0;
+}
+
+int piechart_renderer_set_compression(PieChartRenderer *renderer, const PieChartCompression *compression)
+{
+    static const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+    if (compression == NULL)
+    {
+        renderer->compressing = 0;
+        return 0;
+    }
+    if (compression->level < -1 || compression->level > 9 || compression->threads < 0 ||
+        (unsigned)compression->strategy >= sizeof(strategies) / sizeof(strategies[0]))
+        return 1;
+
+    renderer->compressing = 1;
+    renderer->compression.level = compression->level;
+    renderer->compression.strategy = strategies[compression->strategy];
+    renderer->compression.threads = compression->threads;
+    return 0;
+}
+
+int piechart_renderer_set_format(PieChartRenderer *renderer, PieChartFormat format)
+{
+    if (piechart_format_content_type(format) == NULL)
+        return 1;
+    renderer->format = format;
+    renderer->display.count = 0; // A chart drawn for another format is not encoded in this one
+    return 0;
+}
+
+/**
+ * @brief Name, file extension and media type of every format, in the order of PieChartFormat.
+ */
+static const struct
+{
+    const char *name, *extension, *content_type;
+} formats[] = {
+    {"png", "png", "image/png"},
+    {"svg", "svg", "image/svg+xml"},
+    {"qoi", "qoi", "image/qoi"},
+    {"ppm", "ppm", "image/x-portable-pixmap"},
+    {"rgba", "rgba", "application/octet-stream"},
+    {"indexed", "idx", "application/octet-stream"},
+};
+
+#define FORMATS_COUNT ((int)(sizeof(formats) / sizeof(formats[0])))
+
+const char *piechart_format_content_type(PieChartFormat format)
+{
+    return (unsigned)format < FORMATS_COUNT ? formats[format].content_type : NULL;
+}
+
+const char *piechart_format_extension(PieChartFormat format)
+{
+    return (unsigned)format < FORMATS_COUNT ? formats[format].extension : NULL;
+}
+
+const char *piechart_format_name(PieChartFormat format)
+{
+    return (unsigned)format < FORMATS_COUNT ? formats[format].name : NULL;
+}
+
+int piechart_format_from_name(const char *name, PieChartFormat *format)
+{
+    for (int i = 0; i < FORMATS_COUNT; i++)
+    {
+        if (strcmp(name, formats[i].name) == 0)
+        {
+            *format = (PieChartFormat)i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int piechart_format_from_path(const char *path, PieChartFormat *format)
+{
+    const char *slash = strrchr(path, '/'), *dot = strrchr(path, '.');
+    if (dot == NULL || (slash && dot < slash))
+        return 1;
+    for (int i = 0; i < FORMATS_COUNT; i++)
+    {
+        if (strcasecmp(dot + 1, formats[i].extension) == 0)
+        {
+            *format = (PieChartFormat)i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void piechart_assign_random_colors(PieChartSegment *segments, int count, uint64_t *state)
+{
+    assign_segment_colors(segments, count, state);
+}
+
+void piechart_assign_label_colors(PieChartSegment *segments, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const char *label = segments[i].label;
+        uint64_t state = label && *label ? cache_hash(label, strlen(label)) : (uint64_t)i;
+        segments[i].color = generate_random_color(&state);
+    }
+}
+
+int piechart_draw(PieChartRenderer *renderer, const PieChartSegment *segments, int count, const char *title)
+{
+    // A vector chart is only its primitives
+    if (renderer->format == PIECHART_FORMAT_SVG)
+        return display_pie_chart(&renderer->display, segments, count, title, renderer->width, renderer->height);
+
+    // The streaming path draws while encoding
+    if (renderer->streaming && renderer->format == PIECHART_FORMAT_PNG)
+    {
+        renderer->segments = segments;
+        renderer->count = count;
+        renderer->title = title;
+        return 0;
+    }
+
+    if (renderer->canvas == NULL)
+    {
+        renderer->canvas = renderer->antialias ? gdImageCreateTrueColor(renderer->width, renderer->height)
+                                               : gdImageCreate(renderer->width, renderer->height);
+        if (renderer->canvas == NULL)
+            return 1;
+    }
+    renderer->canvas->res_x = renderer->canvas->res_y = renderer->dpi;
+
+    return draw_pie_chart_list(renderer->canvas, &renderer->display, NULL, segments, count, title);
+}
+
+static int append_output(void *context, const unsigned char *bytes, size_t length)
+{
+    return output_buffer_append(context, bytes, length);
+}
+
+/**
+ * @brief Encodes a canvas in the output buffer in the raster format of the renderer.
+ *
+ * PNG goes through libgd, or through the compression settings of the renderer.
+ */
+static int encode_canvas(PieChartRenderer *renderer, gdImagePtr canvas)
+{
+    switch (renderer->format)
+    {
+    case PIECHART_FORMAT_QOI:
+        return qoi_encode(&renderer->output, canvas);
+    case PIECHART_FORMAT_PPM:
+        return ppm_encode(&renderer->output, canvas);
+    case PIECHART_FORMAT_RGBA:
+        return rgba_encode(&renderer->output, canvas);
+    case PIECHART_FORMAT_INDEXED:
+        return indexed_encode(&renderer->output, canvas);
+    default:
+        break;
+    }
+    if (renderer->compressing)
+        return png_encode_image(&renderer->output, canvas, &renderer->compression);
+    return output_buffer_encode_png(&renderer->output, canvas);
+}
+
+/**
+ * @brief Compression settings of the streaming path, NULL for the zlib defaults.
+ */
+static const PngOptions *stream_compression(const PieChartRenderer *renderer)
+{
+    return renderer->compressing ? &renderer->compression : NULL;
+}
+
+/**
+ * @brief Writes the recorded primitives as SVG, displayed at the size of the chart before scaling.
+ */
+static int encode_svg(PieChartRenderer *renderer, int width, int height, int dpi)
+{
+    return svg_encode(&renderer->output, &renderer->display, (width * BASE_DPI + dpi / 2) / dpi,
+                      (height * BASE_DPI + dpi / 2) / dpi);
+}
+
+int piechart_encode(PieChartRenderer *renderer, const unsigned char **bytes, size_t *length)
+{
+    if (renderer->format == PIECHART_FORMAT_SVG)
+    {
+        if (renderer->display.count == 0 || encode_svg(renderer, renderer->width, renderer->height, renderer->dpi))
+            return 1;
+        *bytes = renderer->output.data;
+        *length = renderer->output.length;
+        return 0;
+    }
+    if (renderer->format != PIECHART_FORMAT_PNG)
+    {
+        if (renderer->canvas == NULL || encode_canvas(renderer, renderer->canvas))
+            return 1;
+        *bytes = renderer->output.data;
+        *length = renderer->output.length;
+        return 0;
+    }
+    return piechart_encode_png(renderer, bytes, length);
+}
+
+int piechart_encode_png(PieChartRenderer *renderer, const unsigned char **png, size_t *length)
+{
+    if (renderer->format != PIECHART_FORMAT_PNG)
+        return 1;
+    if (renderer->streaming)
+    {
+        output_buffer_reset(&renderer->output);
+        if (renderer->segments == NULL ||
+            stream_pie_chart(renderer->segments, renderer->count, renderer->title, renderer->width,
+                             renderer->height, renderer->dpi, stream_compression(renderer), append_output,
+                             &renderer->output))
+            return 1;
+    }
+    else if (renderer->canvas == NULL || encode_canvas(renderer, renderer->canvas))
+        return 1;
+
+    *png = renderer->output.data;
+    *length = renderer->output.length;
+    return 0;
+}
+
+int piechart_render_png(PieChartRenderer *renderer, const PieChartSegment *segments, int count,
+                        const char *title, const unsigned char **png, size_t *length)
+{
+    if (piechart_draw(renderer, segments, count, title))
+        return 1;
+    return piechart_encode_png(renderer, png, length);
+}
+
+int piechart_stream_png(const PieChartSegment *segments, int count, const char *title,
+                        PieChartWriteFn write, void *context)
+{
+    return stream_pie_chart(segments, count, title, WIDTH, HEIGHT, BASE_DPI, NULL, write, context);
+}
+
+/**
+ * @brief Returns a canvas of the given size and of the kind of the renderer, reusing the one of the last call.
+ */
+static gdImagePtr sized_canvas(PieChartRenderer *renderer, int index, int width, int height)
+{
+    gdImagePtr canvas = renderer->sized[index];
+    if (canvas && (gdImageSX(canvas) != width || gdImageSY(canvas) != height ||
+                   gdImageTrueColor(canvas) != renderer->antialias))
+    {
+        gdImageDestroy(canvas);
+        canvas = NULL;
+    }
+    if (canvas == NULL)
+        canvas = renderer->antialias ? gdImageCreateTrueColor(width, height) : gdImageCreate(width, height);
+    renderer->sized[index] = canvas;
+    return canvas;
+}
+
+int piechart_render_sizes(PieChartRenderer *renderer, const PieChartSegment *segments, int count, const char *title,
+                          const PieChartSize *sizes, int sizes_count, PieChartSizeFn deliver, void *context)
+{
+    int widths[PIECHART_MAX_SIZES], heights[PIECHART_MAX_SIZES], dpis[PIECHART_MAX_SIZES];
+    if (sizes_count < 1 || sizes_count > PIECHART_MAX_SIZES)
+        return 1;
+    for (int i = 0; i < sizes_count; i++)
+    {
+        if (scale_size(sizes[i].width, sizes[i].height, sizes[i].scale, &widths[i], &heights[i], &dpis[i]))
+            return 1;
+    }
+
+    // The angles of the segments are computed once, then the chart is drawn at each native size
+    double start = profile_start();
+    PieGeometry geometry;
+    int failed = pie_geometry_init(&geometry, segments, count, 0, 0, 0);
+    profile_stop(PROFILE_DRAW, start);
+    if (failed)
+        return 1;
+
+    for (int i = 0; i < sizes_count && !failed; i++)
+    {
+        // Each size is drawn, encoded, then delivered, which times its own write
+        if (renderer->format == PIECHART_FORMAT_SVG)
+        {
+            start = profile_start();
+            failed = display_pie_chart(&renderer->display, segments, count, title, widths[i], heights[i]);
+            profile_stop(PROFILE_DRAW, start);
+            start = profile_start();
+            failed = failed || encode_svg(renderer, widths[i], heights[i], dpis[i]);
+            profile_stop(PROFILE_ENCODE, start);
+        }
+        else if (renderer->streaming && renderer->format == PIECHART_FORMAT_PNG)
+        {
+            // The rows are generated as they are compressed: all of it is encoding
+            start = profile_start();
+            output_buffer_reset(&renderer->output);
+            failed = stream_pie_chart_geometry(&geometry, segments, count, title, widths[i], heights[i], dpis[i],
+                                               stream_compression(renderer), append_output, &renderer->output);
+            profile_stop(PROFILE_ENCODE, start);
+        }
+        else
+        {
+            start = profile_start();
+            gdImagePtr canvas = sized_canvas(renderer, i, widths[i], heights[i]);
+            if (canvas)
+            {
+                canvas->res_x = canvas->res_y = dpis[i];
+                failed = draw_pie_chart_list(canvas, &renderer->display, &geometry, segments, count, title);
+            }
+            profile_stop(PROFILE_DRAW, start);
+            if (canvas == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            start = profile_start();
+            failed = failed || encode_canvas(renderer, canvas);
+            profile_stop(PROFILE_ENCODE, start);
+        }
+        failed = failed || deliver(context, i, renderer->output.data, renderer->output.length);
+    }
+    pie_geometry_free(&geometry);
+    return failed;
+}
+
+PieChartCache *piechart_cache_create(size_t max_bytes, const char *directory)
+{
+    return cache_create(max_bytes, directory);
+}
+
+void piechart_cache_destroy(PieChartCache *cache)
+{
+    cache_destroy(cache);
+}
+
+void piechart_cache_set_disk_limit(PieChartCache *cache, size_t max_bytes)
+{
+    cache_set_disk_limit(cache, max_bytes);
+}
+
+void piechart_cache_get_stats(PieChartCache *cache, PieChartCacheStats *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->disk_hits = cache->disk_hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->entries;
+    stats->bytes = cache->bytes;
+    stats->disk_evictions = cache->disk_evictions;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Serializes everything that determines the pixels of a chart into renderer->key.
+ */
+static int build_cache_key(PieChartRenderer *renderer, const PieChartSegment *segments, int count, const char *title)
+{
+    OutputBuffer *key = &renderer->key;
+    // Key version, format, canvas size and resolution, segment count, rendering path and compression;
+    // the number of threads changes the bytes but not the image, it is left out
+    int png = renderer->format == PIECHART_FORMAT_PNG, streaming = renderer->streaming && png;
+    int canvas = renderer->format != PIECHART_FORMAT_SVG && !streaming;
+    int32_t header[11] = {6, renderer->format, renderer->width, renderer->height, renderer->dpi, count,
+                          streaming, renderer->antialias && canvas,
+                          renderer->compressing && png, renderer->compressing && png ? renderer->compression.level : 0,
+                          renderer->compressing && png ? renderer->compression.strategy : 0};
+    output_buffer_reset(key);
+    int failed = output_buffer_append(key, header, sizeof(header));
+
+    for (int i = 0; i < count && !failed; i++)
+    {
+        const char *label = segments[i].label ? segments[i].label : "";
+        uint32_t label_length = strlen(label);
+        unsigned char color[3] = {segments[i].color.r, segments[i].color.g, segments[i].color.b};
+        failed |= output_buffer_append(key, &segments[i].percentage, sizeof(double));
+        failed |= output_buffer_append(key, color, sizeof(color));
+        failed |= output_buffer_append(key, &label_length, sizeof(label_length));
+        failed |= output_buffer_append(key, label, label_length);
+    }
+
+    // A missing title and an empty one draw the same chart
+    if (!failed && title)
+        failed |= output_buffer_append(key, title, strlen(title));
+    return failed;
+}
+
+int piechart_cache_lookup(PieChartCache *cache, PieChartRenderer *renderer, const PieChartSegment *segments,
+                          int count, const char *title, const unsigned char **png, size_t *length)
+{
+    if (build_cache_key(renderer, segments, count, title) ||
+        !cache_lookup(cache, renderer->key.data, renderer->key.length, &renderer->output))
+        return 0;
+
+    *png = renderer->output.data;
+    *length = renderer->output.length;
+    return 1;
+}
+
+void piechart_cache_store(PieChartCache *cache, PieChartRenderer *renderer, const PieChartSegment *segments,
+                          int count, const char *title)
+{
+    if (renderer->output.length == 0 || build_cache_key(renderer, segments, count, title))
+        return;
+    cache_store(cache, renderer->key.data, renderer->key.length, renderer->output.data, renderer->output.length);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file profile.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Per-chart stage timings and counters, written as one JSON line per chart.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "profile.h"
+#include <string.h>
+
+_Thread_local ChartProfile *profile_current = NULL;
+
+/**
+ * @brief Names of the stages in the JSON line, in the order of ProfileStage.
+ */
+static const char *stage_names[PROFILE_STAGES] = {"parse_ns", "layout_ns", "segments_ns", "text_ns",
+                                                  "draw_ns",  "encode_ns", "write_ns"};
+
+void profile_reset(ChartProfile *profile)
+{
+    bool enabled = profile->enabled;
+    memset(profile, 0, sizeof(ChartProfile));
+    profile->enabled = enabled;
+}
+
+double profile_enter(ChartProfile *profile)
+{
+    if (!profile->enabled)
+        return 0;
+    profile_current = profile;
+    double now = monotonic_seconds();
+    if (!profile->started)
+    {
+        profile->started = true;
+        profile->start = now;
+    }
+    return now;
+}
+
+void profile_leave(ChartProfile *profile, ProfileStage stage, double start)
+{
+    profile_exit(profile);
+    if (profile->enabled)
+        profile->ns[stage] += (long long)((profile->end - start) * 1e9);
+}
+
+void profile_exit(ChartProfile *profile)
+{
+    if (!profile->enabled)
+        return;
+    profile->end = monotonic_seconds();
+    profile_current = NULL;
+}
+
+/**
+ * @brief Appends a JSON string, escaped, to a line; returns the new length.
+ */
+static size_t append_string(char *line, size_t length, size_t size, const char *text)
+{
+    if (length < size)
+        line[length] = '"';
+    length++;
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+    {
+        char escaped[8];
+        int count = 1;
+        if (*c == '"' || *c == '\\')
+            count = snprintf(escaped, sizeof(escaped), "\\%c", *c);
+        else if (*c < 0x20)
+            count = snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+        else
+            escaped[0] = *c;
+        for (int i = 0; i < count; i++, length++)
+        {
+            if (length < size)
+                line[length] = escaped[i];
+        }
+    }
+    if (length < size)
+        line[length] = '"';
+    return length + 1;
+}
+
+int profile_write(FILE *stream, const ChartProfile *profile, const char *chart, const char *format, int segments,
+                  bool cache_hit)
+{
+    char line[4096];
+    size_t size = sizeof(line) - 2, length = 0; // Room for the newline and the terminator
+
+    length += snprintf(line, size, "{\"chart\":");
+    length = append_string(line, length, size, chart ? chart : "");
+    length += snprintf(line + MIN(length, size), size - MIN(length, size),
+                       ",\"format\":\"%s\",\"segments\":%d,\"glyphs\":%d,\"bytes\":%zu,\"cache_hit\":%s", format,
+                       segments, profile->glyphs, profile->bytes, cache_hit ? "true" : "false");
+    for (int i = 0; i < PROFILE_STAGES; i++)
+        length += snprintf(line + MIN(length, size), size - MIN(length, size), ",\"%s\":%lld", stage_names[i],
+                           profile->ns[i]);
+    length += snprintf(line + MIN(length, size), size - MIN(length, size), ",\"total_ns\":%lld}",
+                       (long long)((profile->end - profile->start) * 1e9));
+    if (length >= size)
+        return 1; // An output path too long for a line, not worth a partial record
+    line[length++] = '\n';
+    line[length] = '\0';
+    return fputs(line, stream) == EOF;
+}
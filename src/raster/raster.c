@@ -0,0 +1,258 @@
+/**
+ * @file raster.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Raster encoders without deflate: QOI, binary PPM and raw RGBA or indexed dumps.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "raster.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Longest run of a QOI_OP_RUN.
+ */
+#define QOI_MAX_RUN 62
+
+/**
+ * @brief A pixel as 0xRRGGBBAA.
+ */
+typedef uint32_t Rgba;
+
+/**
+ * @brief Converts the 7-bit alpha of libgd (0 opaque, 127 transparent) to 8 bits, like its PNG writer.
+ */
+static inline unsigned opacity(int alpha)
+{
+    return 255 - ((alpha << 1) + (alpha >> 6));
+}
+
+static inline Rgba truecolor_rgba(int pixel)
+{
+    return (Rgba)gdTrueColorGetRed(pixel) << 24 | (Rgba)gdTrueColorGetGreen(pixel) << 16 |
+           (Rgba)gdTrueColorGetBlue(pixel) << 8 | opacity(gdTrueColorGetAlpha(pixel));
+}
+
+/**
+ * @brief Fills the RGBA of every palette entry, the transparent color with alpha 0.
+ */
+static void palette_rgba(gdImagePtr img, Rgba palette[RASTER_PALETTE_SIZE])
+{
+    memset(palette, 0, RASTER_PALETTE_SIZE * sizeof(Rgba));
+    for (int i = 0; i < gdImageColorsTotal(img); i++)
+    {
+        palette[i] = (Rgba)img->red[i] << 24 | (Rgba)img->green[i] << 16 | (Rgba)img->blue[i] << 8 |
+                     (i == img->transparent ? 0 : opacity(img->alpha[i]));
+    }
+}
+
+static inline unsigned char *put_be32(unsigned char *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+    return out + 4;
+}
+
+int qoi_encode(OutputBuffer *buffer, gdImagePtr img)
+{
+    static const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    int width = gdImageSX(img), height = gdImageSY(img);
+    Rgba palette[RASTER_PALETTE_SIZE], index[64] = {0}, previous = 0x000000FF;
+    int run = 0, truecolor = img->trueColor;
+    palette_rgba(img, palette);
+
+    output_buffer_reset(buffer);
+    if (output_buffer_reserve(buffer, 14))
+        return 1;
+    unsigned char *out = buffer->data;
+    memcpy(out, "qoif", 4);
+    out = put_be32(out + 4, width);
+    out = put_be32(out, height);
+    *out++ = 4; // RGBA
+    *out++ = 0; // sRGB with linear alpha
+    buffer->length = out - buffer->data;
+
+    for (int y = 0; y < height; y++)
+    {
+        // At most 5 bytes per pixel, then the end of a run and the padding: one check per row
+        if (output_buffer_reserve(buffer, buffer->length + (size_t)width * 5 + 1 + sizeof(padding)))
+            return 1;
+        // Locals: the stores through out could alias the image and would reload it for every pixel
+        out = buffer->data + buffer->length;
+        const int *truecolor_row = truecolor ? img->tpixels[y] : NULL;
+        const unsigned char *palette_row = truecolor ? NULL : img->pixels[y];
+        for (int x = 0; x < width; x++)
+        {
+            Rgba pixel = truecolor ? truecolor_rgba(truecolor_row[x]) : palette[palette_row[x]];
+            if (pixel == previous)
+            {
+                if (++run == QOI_MAX_RUN)
+                {
+                    *out++ = 0xC0 | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run)
+            {
+                *out++ = 0xC0 | (run - 1);
+                run = 0;
+            }
+
+            unsigned r = pixel >> 24, g = (pixel >> 16) & 0xFF, b = (pixel >> 8) & 0xFF, a = pixel & 0xFF;
+            unsigned slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+            if (index[slot] == pixel)
+                *out++ = slot;
+            else if (a != (previous & 0xFF))
+            {
+                *out++ = 0xFF;
+                *out++ = r;
+                *out++ = g;
+                *out++ = b;
+                *out++ = a;
+            }
+            else
+            {
+                // Differences wrap around like the decoder does
+                int dr = (signed char)(r - (previous >> 24)), dg = (signed char)(g - ((previous >> 16) & 0xFF));
+                int db = (signed char)(b - ((previous >> 8) & 0xFF));
+                int dr_dg = dr - dg, db_dg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    *out++ = 0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    *out++ = 0x80 | (dg + 32);
+                    *out++ = (dr_dg + 8) << 4 | (db_dg + 8);
+                }
+                else
+                {
+                    *out++ = 0xFE;
+                    *out++ = r;
+                    *out++ = g;
+                    *out++ = b;
+                }
+            }
+            index[slot] = pixel;
+            previous = pixel;
+        }
+        buffer->length = out - buffer->data;
+    }
+
+    if (run)
+        *out++ = 0xC0 | (run - 1);
+    memcpy(out, padding, sizeof(padding));
+    buffer->length = out + sizeof(padding) - buffer->data;
+    return 0;
+}
+
+int ppm_encode(OutputBuffer *buffer, gdImagePtr img)
+{
+    int width = gdImageSX(img), height = gdImageSY(img);
+    Rgba palette[RASTER_PALETTE_SIZE];
+    unsigned char bytes[RASTER_PALETTE_SIZE][4];
+    palette_rgba(img, palette);
+    for (int i = 0; i < RASTER_PALETTE_SIZE; i++)
+        put_be32(bytes[i], palette[i]);
+
+    char header[32];
+    int header_length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    output_buffer_reset(buffer);
+    if (output_buffer_reserve(buffer, header_length + (size_t)width * height * 3 + 1))
+        return 1;
+
+    unsigned char *out = buffer->data;
+    memcpy(out, header, header_length);
+    out += header_length;
+    for (int y = 0; y < height; y++)
+    {
+        // One loop per kind of canvas: the inner loops do not test it for every pixel
+        if (img->trueColor)
+        {
+            const int *row = img->tpixels[y];
+            for (int x = 0; x < width; x++, out += 3)
+            {
+                out[0] = gdTrueColorGetRed(row[x]);
+                out[1] = gdTrueColorGetGreen(row[x]);
+                out[2] = gdTrueColorGetBlue(row[x]);
+            }
+        }
+        else
+        {
+            // 4 bytes copied, 3 kept: the next pixel overwrites the alpha
+            const unsigned char *row = img->pixels[y];
+            for (int x = 0; x < width; x++, out += 3)
+                memcpy(out, bytes[row[x]], 4);
+        }
+    }
+    buffer->length = out - buffer->data;
+    return 0;
+}
+
+int rgba_encode(OutputBuffer *buffer, gdImagePtr img)
+{
+    int width = gdImageSX(img), height = gdImageSY(img);
+    Rgba palette[RASTER_PALETTE_SIZE];
+    palette_rgba(img, palette); // Unused entries of a truecolor image stay zero
+
+    // The palette in the byte order of the output: one 4-byte copy per pixel
+    unsigned char bytes[RASTER_PALETTE_SIZE][4];
+    for (int i = 0; i < RASTER_PALETTE_SIZE; i++)
+        put_be32(bytes[i], palette[i]);
+
+    output_buffer_reset(buffer);
+    if (output_buffer_reserve(buffer, (size_t)width * height * 4))
+        return 1;
+
+    unsigned char *out = buffer->data;
+    for (int y = 0; y < height; y++)
+    {
+        if (img->trueColor)
+        {
+            const int *row = img->tpixels[y];
+            for (int x = 0; x < width; x++, out += 4)
+            {
+                unsigned char pixel[4] = {gdTrueColorGetRed(row[x]), gdTrueColorGetGreen(row[x]),
+                                          gdTrueColorGetBlue(row[x]), opacity(gdTrueColorGetAlpha(row[x]))};
+                memcpy(out, pixel, 4);
+            }
+        }
+        else
+        {
+            const unsigned char *row = img->pixels[y];
+            for (int x = 0; x < width; x++, out += 4)
+                memcpy(out, bytes[row[x]], 4);
+        }
+    }
+    buffer->length = out - buffer->data;
+    return 0;
+}
+
+int indexed_encode(OutputBuffer *buffer, gdImagePtr img)
+{
+    int width = gdImageSX(img), height = gdImageSY(img);
+    Rgba palette[RASTER_PALETTE_SIZE];
+    if (img->trueColor)
+        return 1;
+    palette_rgba(img, palette);
+
+    output_buffer_reset(buffer);
+    if (output_buffer_reserve(buffer, RASTER_PALETTE_SIZE * 4 + (size_t)width * height))
+        return 1;
+
+    unsigned char *out = buffer->data;
+    for (int i = 0; i < RASTER_PALETTE_SIZE; i++)
+        out = put_be32(out, palette[i]);
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(out, img->pixels[y], width);
+        out += width;
+    }
+    buffer->length = out - buffer->data;
+    return 0;
+}
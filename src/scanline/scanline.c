@@ -0,0 +1,618 @@
+/**
+ * @file scanline.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Row by row rasterization of the pie geometry, without a canvas.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "scanline.h"
+#include "utils.h"
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * @brief A full turn in pseudo-angle units: 4 quadrants in 16.16 fixed point.
+ */
+#define FULL_TURN (4u << 16)
+
+/**
+ * @brief Bound of the fixed-point cotangents, which keeps dy * cotangent within 64 bits.
+ */
+#define COTANGENT_LIMIT ((int64_t)1 << 40)
+
+static int compare_lines(const void *a, const void *b)
+{
+    const ScanLine *first = a, *second = b;
+    return (first->ymin > second->ymin) - (first->ymin < second->ymin);
+}
+
+/**
+ * @brief Pseudo-angle of a direction: increases with the angle like it, from 0 to FULL_TURN,
+ * but only needs a division.
+ *
+ * Each quadrant maps to one unit: the position within the quadrant is the share of the
+ * second coordinate in |dx| + |dy|.
+ */
+static uint32_t pseudo_angle(double dx, double dy)
+{
+    double turn;
+    if (dx == 0 && dy == 0)
+        turn = 0;
+    else if (dy >= 0)
+        turn = dx >= 0 ? dy / (dx + dy) : 1 + -dx / (-dx + dy);
+    else
+        turn = dx < 0 ? 2 + -dy / (-dx - dy) : 3 + dx / (dx - dy);
+    uint32_t fixed = (uint32_t)lround(turn * 65536.0);
+    return fixed >= FULL_TURN ? FULL_TURN - 1 : fixed;
+}
+
+/**
+ * @brief Pseudo-angle of a pixel relative to the center, in integer arithmetic.
+ */
+static uint32_t pixel_pseudo_angle(int64_t dx, int64_t dy)
+{
+    if (dx == 0 && dy == 0)
+        return 0;
+    if (dy >= 0)
+        return dx >= 0 ? (uint32_t)((dy << 16) / (dx + dy)) : (1u << 16) + (uint32_t)((-dx << 16) / (-dx + dy));
+    return dx < 0 ? (2u << 16) + (uint32_t)((-dy << 16) / (-dx - dy)) : (3u << 16) + (uint32_t)((dx << 16) / (dx - dy));
+}
+
+static void add_line(PieGeometry *geometry, double x0, double y0, double x1, double y1)
+{
+    ScanLine *line = &geometry->lines[geometry->lines_count++];
+    line->x0 = x0;
+    line->y0 = y0;
+    line->x1 = x1;
+    line->y1 = y1;
+    line->ymin = (int)floor(fmin(y0, y1) - 1); // Anti-aliased lines reach one pixel around them
+    line->ymax = (int)ceil(fmax(y0, y1) + 1);
+}
+
+/**
+ * @brief Index of the first boundary whose angle is greater than angle (or equal, if inclusive).
+ */
+static int first_boundary_after(const PieGeometry *geometry, double angle, int inclusive)
+{
+    int low = 0, high = geometry->count + 1;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (geometry->angles[middle] > angle || (inclusive && geometry->angles[middle] == angle))
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return low;
+}
+
+int pie_geometry_init(PieGeometry *geometry, const PieChartSegment *segments, int count, int cx, int cy, int radius)
+{
+    memset(geometry, 0, sizeof(PieGeometry));
+    geometry->count = count;
+    geometry->angles = malloc((count + 1) * sizeof(double));
+    geometry->bounds = malloc((count + 1) * sizeof(uint32_t));
+    geometry->cosines = malloc((count + 1) * sizeof(double));
+    geometry->sines = malloc((count + 1) * sizeof(double));
+    geometry->medians = malloc((count + 1) * 2 * sizeof(double));
+    geometry->cotangents = malloc((count + 1) * sizeof(int64_t));
+    geometry->inks = malloc((count + 1) * sizeof(int));
+    geometry->lines = malloc((count + 1) * sizeof(ScanLine));
+    geometry->active = malloc((count + 1) * sizeof(int));
+    if (!geometry->angles || !geometry->bounds || !geometry->cosines || !geometry->sines || !geometry->medians ||
+        !geometry->cotangents || !geometry->inks || !geometry->lines || !geometry->active)
+    {
+        pie_geometry_free(geometry);
+        return 1;
+    }
+
+    // Boundary angles, clipped to the full circle
+    double angle = 0;
+    geometry->angles[0] = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (segments[i].percentage > 0)
+            angle = fmin(angle + segments[i].percentage * 3.6, 360.0); // Multiply by 3.6 to convert to degrees
+        geometry->angles[i + 1] = angle;
+        geometry->inks[i] = (segments[i].color.r << 16) | (segments[i].color.g << 8) | segments[i].color.b;
+    }
+    geometry->background = 0xFFFFFF;
+    geometry->border = 0x000000;
+
+    // The only trigonometry: once per boundary and per median, whatever the size the pie is drawn at
+    for (int i = 0; i < count; i++)
+    {
+        double median = (geometry->angles[i] + geometry->angles[i + 1]) / 2.0 * M_PI / 180.0;
+        geometry->medians[2 * i] = cos(median);
+        geometry->medians[2 * i + 1] = sin(median);
+    }
+    for (int i = 0; i <= count; i++)
+    {
+        double rad = geometry->angles[i] * M_PI / 180.0;
+        geometry->cosines[i] = cos(rad);
+        geometry->sines[i] = sin(rad);
+        geometry->bounds[i] = geometry->angles[i] >= 360.0 ? FULL_TURN : pseudo_angle(geometry->cosines[i], geometry->sines[i]);
+        double cotangent = geometry->sines[i] != 0 ? geometry->cosines[i] / geometry->sines[i] * 65536.0 : 0;
+        geometry->cotangents[i] = (int64_t)fmax(fmin(cotangent, COTANGENT_LIMIT), -COTANGENT_LIMIT);
+    }
+
+    // Boundaries crossing the rows below and above the center
+    geometry->lower_first = first_boundary_after(geometry, 0, 0);
+    geometry->lower_last = first_boundary_after(geometry, 180, 1) - 1;
+    geometry->upper_first = first_boundary_after(geometry, 180, 0);
+    geometry->upper_last = first_boundary_after(geometry, 360, 1) - 1;
+
+    pie_geometry_place(geometry, cx, cy, radius);
+    return 0;
+}
+
+void pie_geometry_place(PieGeometry *geometry, int cx, int cy, int radius)
+{
+    geometry->cx = cx;
+    geometry->cy = cy;
+    geometry->radius = radius;
+
+    // The median ticks, the only part that depends on the size
+    geometry->lines_count = 0;
+    for (int i = 0; i < geometry->count; i++)
+    {
+        double cosine = geometry->medians[2 * i], sine = geometry->medians[2 * i + 1];
+        add_line(geometry, cx + radius * cosine, cy + radius * sine, cx + 1.05 * radius * cosine, cy + 1.05 * radius * sine);
+    }
+    qsort(geometry->lines, geometry->lines_count, sizeof(ScanLine), compare_lines);
+    geometry->next_line = 0;
+    geometry->active_count = 0;
+}
+
+void pie_geometry_free(PieGeometry *geometry)
+{
+    free(geometry->angles);
+    free(geometry->bounds);
+    free(geometry->cosines);
+    free(geometry->sines);
+    free(geometry->medians);
+    free(geometry->cotangents);
+    free(geometry->inks);
+    free(geometry->lines);
+    free(geometry->active);
+    memset(geometry, 0, sizeof(PieGeometry));
+}
+
+/**
+ * @brief Returns the segment covering a pseudo-angle, or -1 outside the pie.
+ */
+static int find_segment(const PieGeometry *geometry, uint32_t angle)
+{
+    // First boundary strictly greater than the angle: empty segments are skipped
+    int low = 0, high = geometry->count + 1;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (geometry->bounds[middle] > angle)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return low > 0 && low <= geometry->count ? low - 1 : -1;
+}
+
+/**
+ * @brief A row being rasterized.
+ */
+typedef struct Row
+{
+    PixelFormat format;
+    void *pixels;
+    int width;
+    int antialias; ///< Anti-aliased edges, truecolor rows only.
+} Row;
+
+/**
+ * @brief Paints the pixels x0 to x1 included, clipped to the row, as one color run.
+ */
+static void paint_span(const Row *row, int x0, int x1, int ink)
+{
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= row->width)
+        x1 = row->width - 1;
+    if (x0 > x1)
+        return;
+
+    switch (row->format)
+    {
+    case PIXELS_PALETTE:
+        memset((unsigned char *)row->pixels + x0, ink, x1 - x0 + 1);
+        break;
+    case PIXELS_TRUECOLOR:
+        fill_span((uint32_t *)row->pixels + x0, (uint32_t)ink, x1 - x0 + 1);
+        break;
+    case PIXELS_RGB:
+        for (unsigned char *pixel = (unsigned char *)row->pixels + 3 * x0, *end = pixel + 3 * (x1 - x0 + 1); pixel < end; pixel += 3)
+        {
+            pixel[0] = ink >> 16;
+            pixel[1] = ink >> 8;
+            pixel[2] = ink;
+        }
+        break;
+    }
+}
+
+static void paint_segment(const PieGeometry *geometry, const Row *row, int x0, int x1, int segment)
+{
+    if (segment >= 0 && segment < geometry->count)
+        paint_span(row, x0, x1, geometry->inks[segment]);
+}
+
+/**
+ * @brief Column where boundary k crosses row dy: the last pixel on its side below the center,
+ * the first pixel on its side above.
+ */
+static int64_t crossing(const PieGeometry *geometry, int k, int64_t dy)
+{
+    return dy > 0 ? geometry->cx + ((dy * geometry->cotangents[k]) >> 16)
+                  : geometry->cx - ((-dy * geometry->cotangents[k]) >> 16);
+}
+
+/**
+ * @brief Tells whether pixel x of row dy has passed boundary k, i.e. lies at its angle or beyond.
+ */
+static int passed(const PieGeometry *geometry, int k, int64_t dy, int64_t x)
+{
+    return dy > 0 ? crossing(geometry, k, dy) >= x : crossing(geometry, k, dy) <= x;
+}
+
+/**
+ * @brief First boundary in [first, last] not passed by pixel x, or last + 1.
+ *
+ * Galloping search from the answer for the previous run: moving right, the answer grows
+ * above the center and shrinks below it. It usually moves by one, but thousands of
+ * boundaries may fall within one pixel of a dense chart.
+ */
+static int first_not_passed(const PieGeometry *geometry, int first, int last, int previous, int64_t dy, int64_t x)
+{
+    int low = previous, high = previous, step = 1;
+    if (dy < 0)
+    {
+        // Boundaries before previous stay passed
+        while (high <= last && passed(geometry, high, dy, x))
+        {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        high = MIN(high, last + 1);
+    }
+    else
+    {
+        // Boundaries from previous on stay not passed
+        while (low > first && !passed(geometry, low - 1, dy, x))
+        {
+            high = low - 1;
+            low = MAX(low - step, first);
+            step *= 2;
+        }
+    }
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (passed(geometry, middle, dy, x))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/**
+ * @brief Fills the part of row y inside the pie, one color run after the other.
+ *
+ * The segment of a pixel is the one of the last boundary it has passed. Below the center
+ * the crossings move left when the angle grows, above they move right: either way, the
+ * first boundary not yet passed by a pixel is found by a binary search.
+ */
+static void fill_segments(PieGeometry *geometry, int y, const Row *row)
+{
+    int64_t dy = y - geometry->cy;
+    int half = (int)sqrt((double)geometry->radius * geometry->radius - (double)(dy * dy));
+    int left = geometry->cx - half, right = geometry->cx + half;
+
+    if (dy == 0)
+    {
+        // On the center row the left half is at 180 degrees, the right half at 0
+        paint_segment(geometry, row, left, geometry->cx - 1, find_segment(geometry, 2u << 16));
+        paint_segment(geometry, row, geometry->cx, right, find_segment(geometry, 0));
+        return;
+    }
+
+    int first = dy > 0 ? geometry->lower_first : geometry->upper_first;
+    int last = dy > 0 ? geometry->lower_last : geometry->upper_last;
+    int low = dy > 0 ? last + 1 : first;
+    for (int x = left; x <= right;)
+    {
+        // First boundary of the half not yet passed by pixel x, searched from the previous one
+        low = first_not_passed(geometry, first, last, low, dy, x);
+        int segment = low - 1;
+
+        // The run ends where the next boundary is passed
+        int64_t end = right;
+        if (dy > 0 && segment >= first)
+            end = crossing(geometry, segment, dy);
+        else if (dy < 0 && low <= last)
+            end = crossing(geometry, low, dy) - 1;
+        if (end > right)
+            end = right;
+        paint_segment(geometry, row, x, (int)end, segment);
+        x = (int)end + 1;
+    }
+}
+
+/**
+ * @brief Draws the pixels of row y on the outline of the pie.
+ */
+static void draw_outline(PieGeometry *geometry, int y, const Row *row)
+{
+    int dy = y - geometry->cy, radius = geometry->radius;
+    int outer = (int)sqrt((double)radius * radius - (double)dy * dy);
+    int inner = abs(dy) <= radius - 1 ? (int)sqrt((double)(radius - 1) * (radius - 1) - (double)dy * dy) : -1;
+    int full = geometry->angles[geometry->count] - geometry->angles[0] >= 360.0;
+
+    for (int side = -1; side <= 1; side += 2)
+    {
+        int first = geometry->cx + side * (inner + 1), last = geometry->cx + side * outer;
+        if (full)
+        {
+            paint_span(row, side < 0 ? last : first, side < 0 ? first : last, geometry->border);
+            continue;
+        }
+        for (int offset = inner + 1; offset <= outer; offset++)
+        {
+            int x = geometry->cx + side * offset;
+            if (find_segment(geometry, pixel_pseudo_angle(x - geometry->cx, dy)) >= 0)
+                paint_span(row, x, x, geometry->border);
+        }
+    }
+}
+
+/**
+ * @brief Draws the part of a line from (x0, y0) to (x1, y1) within the band of row y.
+ */
+static void draw_line_band(const PieGeometry *geometry, const Row *row, int y, double x0, double y0, double x1, double y1)
+{
+    double t0 = 0, t1 = 1;
+    if (fabs(y1 - y0) < 1e-9)
+    {
+        if (fabs(y - y0) > 0.5)
+            return;
+    }
+    else
+    {
+        t0 = (y - 0.5 - y0) / (y1 - y0);
+        t1 = (y + 0.5 - y0) / (y1 - y0);
+        if (t0 > t1)
+        {
+            double swap = t0;
+            t0 = t1;
+            t1 = swap;
+        }
+        t0 = fmax(t0, 0.0);
+        t1 = fmin(t1, 1.0);
+        if (t0 > t1)
+            return;
+    }
+    double from = x0 + t0 * (x1 - x0), to = x0 + t1 * (x1 - x0);
+    paint_span(row, (int)floor(fmin(from, to) + 0.5), (int)floor(fmax(from, to) + 0.5), geometry->border);
+}
+
+/**
+ * @brief Blends an ink over one truecolor pixel, coverage going from 0 to 1.
+ */
+static void blend_pixel(const Row *row, int x, int ink, double coverage)
+{
+    if (x < 0 || x >= row->width || coverage <= 0)
+        return;
+    unsigned char weight = coverage >= 1 ? 255 : (unsigned char)(coverage * 255 + 0.5);
+    blend_span((uint32_t *)row->pixels + x, &weight, (uint32_t)ink, 1);
+}
+
+/**
+ * @brief Draws the part of an anti-aliased line of width 1 within row y.
+ *
+ * The coverage of a pixel is 1 minus the distance of its center to the segment: only the
+ * pixels closer than 1 are visited, found from where the line crosses the row.
+ */
+static void draw_line_antialiased(const PieGeometry *geometry, const Row *row, int y, double x0, double y0,
+                                  double x1, double y1)
+{
+    if (y < fmin(y0, y1) - 1 || y > fmax(y0, y1) + 1)
+        return;
+
+    double lx = x1 - x0, ly = y1 - y0, length2 = lx * lx + ly * ly;
+    double inverse = length2 > 0 ? 1 / sqrt(length2) : 0;
+    double from = fmin(x0, x1) - 1, to = fmax(x0, x1) + 1;
+    if (fabs(ly) > 1e-9)
+    {
+        // Perpendicular distance below 1: |x - crossing| < length / |ly|
+        double crossing = x0 + (y - y0) * lx / ly, reach = 1 / (inverse * fabs(ly));
+        from = fmax(from, crossing - reach);
+        to = fmin(to, crossing + reach);
+    }
+
+    unsigned char coverage[256];
+    int left = MAX((int)ceil(from), 0), right = MIN((int)floor(to), row->width - 1);
+    for (int start = left; start <= right; start += (int)sizeof(coverage))
+    {
+        int count = MIN(right - start + 1, (int)sizeof(coverage));
+        for (int i = 0; i < count; i++)
+        {
+            // Distance to the line beside the segment, to the nearest end beyond it
+            double px = start + i - x0, py = y - y0, along = px * lx + py * ly, distance;
+            if (along > 0 && along < length2)
+                distance = fabs(px * ly - py * lx) * inverse;
+            else
+            {
+                double ex = along <= 0 ? px : px - lx, ey = along <= 0 ? py : py - ly;
+                distance = sqrt(ex * ex + ey * ey);
+            }
+            coverage[i] = distance >= 1 ? 0 : (unsigned char)((1 - distance) * 255 + 0.5);
+        }
+        blend_span((uint32_t *)row->pixels + start, coverage, (uint32_t)geometry->border, count);
+    }
+}
+
+/**
+ * @brief Draws a line within row y, anti-aliased or not depending on the row.
+ */
+static void draw_line(const PieGeometry *geometry, const Row *row, int y, double x0, double y0, double x1, double y1)
+{
+    if (row->antialias)
+        draw_line_antialiased(geometry, row, y, x0, y0, x1, y1);
+    else
+        draw_line_band(geometry, row, y, x0, y0, x1, y1);
+}
+
+static void draw_separation(const PieGeometry *geometry, const Row *row, int y, int k)
+{
+    draw_line(geometry, row, y, geometry->cx, geometry->cy, geometry->cx + geometry->radius * geometry->cosines[k],
+              geometry->cy + geometry->radius * geometry->sines[k]);
+}
+
+/**
+ * @brief Draws the anti-aliased edge of the disc and its outline on row y.
+ *
+ * Only the pixels whose center lies within 1.5 pixels of the circle are visited, the
+ * interior keeps its color runs. The disc covers r + 0.5 - d of a pixel at distance d
+ * from the center, and the outline, a ring of width 1 centered on r - 0.5, 1 - |d - (r - 0.5)|.
+ */
+static void draw_rim_antialiased(const PieGeometry *geometry, int y, const Row *row)
+{
+    double dy = y - geometry->cy, radius = geometry->radius;
+    double outer2 = (radius + 0.5) * (radius + 0.5) - dy * dy;
+    double inner2 = (radius - 1.5) * (radius - 1.5) - dy * dy;
+    if (outer2 < 0)
+        return;
+    int outer = (int)sqrt(outer2), inner = inner2 > 0 && radius > 1.5 ? (int)ceil(sqrt(inner2)) : 0;
+
+    for (int side = -1; side <= 1; side += 2)
+    {
+        // The column of the center belongs to the right side
+        for (int offset = side < 0 ? MAX(inner, 1) : inner; offset <= outer; offset++)
+        {
+            int dx = side * offset, x = geometry->cx + dx;
+            int segment = find_segment(geometry, pixel_pseudo_angle(dx, (int64_t)dy));
+            if (x < 0 || x >= row->width || segment < 0 || segment >= geometry->count)
+                continue;
+
+            double distance = sqrt((double)dx * dx + dy * dy);
+            ((uint32_t *)row->pixels)[x] = (uint32_t)geometry->background;
+            blend_pixel(row, x, geometry->inks[segment], radius + 0.5 - distance);
+            blend_pixel(row, x, geometry->border, 1 - fabs(distance - (radius - 0.5)));
+        }
+    }
+}
+
+/**
+ * @brief Draws the pixels of row y covered by the separation lines.
+ *
+ * Only the boundaries steep enough to reach the row are visited: a contiguous range of
+ * the half, found from the angles. Within it, the lines crossing the row on an already
+ * painted pixel are skipped.
+ */
+static void draw_separations(PieGeometry *geometry, int y, const Row *row)
+{
+    int dy = y - geometry->cy;
+    if (row->antialias ? abs(dy) <= 1 : dy == 0)
+    {
+        // Every line starts on the center row. Anti-aliased lines reach the rows around it too,
+        // those closer than half a pixel at the edge of the pie are drawn once
+        double step = row->antialias ? 0.5 / geometry->radius * 180.0 / M_PI : 0;
+        for (int k = 0; k <= geometry->count;)
+        {
+            draw_separation(geometry, row, y, k);
+            k = MAX(k + 1, first_boundary_after(geometry, geometry->angles[k] + step, 1));
+        }
+        return;
+    }
+
+    // The line of angle a reaches the band of the row when radius * |sin(a)| >= |dy| - 0.5,
+    // or |dy| - 1 anti-aliased
+    double band = row->antialias ? 1.0 : 0.5;
+    double reach = asin(fmin((abs(dy) - band) / geometry->radius, 1.0)) * 180.0 / M_PI;
+    double from = dy > 0 ? reach : 180.0 + reach, to = dy > 0 ? 180.0 - reach : 360.0 - reach;
+    int first = first_boundary_after(geometry, from, 1);
+    int last = first_boundary_after(geometry, to, 0) - 1;
+
+    // From left to right: lines landing on pixels already painted are skipped
+    for (int k = dy > 0 ? last : first; dy > 0 ? k >= first : k <= last;)
+    {
+        draw_separation(geometry, row, y, k);
+        int64_t painted = crossing(geometry, k, dy);
+
+        // Next line crossing the row beyond the painted pixel
+        int low = dy > 0 ? first : k + 1, high = dy > 0 ? k : last + 1;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            int beyond = crossing(geometry, middle, dy) > painted;
+            if (dy > 0 ? !beyond : beyond)
+                high = middle;
+            else
+                low = middle + 1;
+        }
+        k = dy > 0 ? low - 1 : low;
+    }
+}
+
+/**
+ * @brief Updates the list of ticks crossing row y.
+ */
+static void update_active_lines(PieGeometry *geometry, int y)
+{
+    int kept = 0;
+    for (int i = 0; i < geometry->active_count; i++)
+    {
+        if (geometry->lines[geometry->active[i]].ymax >= y)
+            geometry->active[kept++] = geometry->active[i];
+    }
+    geometry->active_count = kept;
+
+    while (geometry->next_line < geometry->lines_count && geometry->lines[geometry->next_line].ymin <= y)
+    {
+        if (geometry->lines[geometry->next_line].ymax >= y)
+            geometry->active[geometry->active_count++] = geometry->next_line;
+        geometry->next_line++;
+    }
+}
+
+void pie_geometry_fill_row(PieGeometry *geometry, int y, PixelFormat format, void *pixels, int width)
+{
+    Row row = {format, pixels, width, geometry->antialias && format == PIXELS_TRUECOLOR};
+    paint_span(&row, 0, width - 1, geometry->background);
+    update_active_lines(geometry, y);
+
+    int dy = abs(y - geometry->cy);
+    if (dy <= geometry->radius && geometry->count > 0)
+        fill_segments(geometry, y, &row);
+    if (row.antialias && dy <= geometry->radius + 1 && geometry->count > 0)
+    {
+        draw_rim_antialiased(geometry, y, &row);
+        draw_separations(geometry, y, &row);
+    }
+    else if (dy <= geometry->radius && geometry->count > 0)
+    {
+        draw_outline(geometry, y, &row);
+        draw_separations(geometry, y, &row);
+    }
+    for (int i = 0; i < geometry->active_count; i++)
+    {
+        const ScanLine *line = &geometry->lines[geometry->active[i]];
+        draw_line(geometry, &row, y, line->x0, line->y0, line->x1, line->y1);
+    }
+}
@@ -0,0 +1,695 @@
+/**
+ * @file server.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Persistent HTTP render server with an epoll event loop and a worker pool.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#define _GNU_SOURCE // accept4()
+#include "server.h"
+#include "batch.h"
+#include "queue.h"
+#include "output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
+
+#define MAX_EVENTS 64
+#define MAX_HEADER_SIZE (16 * 1024)
+#define MAX_BODY_SIZE (1024 * 1024)
+
+/**
+ * @brief State of one client connection, owned by the event loop.
+ */
+typedef struct Connection
+{
+    int fd;
+    char *in;              ///< Bytes received and not yet consumed.
+    size_t in_len;
+    size_t in_capacity;
+    size_t request_len;    ///< Length of the request being answered (header and body).
+    char header[256];      ///< Response header.
+    size_t header_len;
+    const char *body;      ///< Response body.
+    size_t body_len;
+    OutputBuffer output;   ///< Rendered image used as response body.
+    size_t sent;           ///< Bytes of header and body already sent.
+    bool writing;          ///< A response is being sent.
+    bool waiting_output;   ///< EPOLLOUT is registered.
+    bool keep_alive;
+    bool in_flight;        ///< The request is being rendered by a worker.
+    bool draining;         ///< The peer has shut down its side: answer what was received, then close.
+    bool closed;           ///< The socket is closed, free once the worker is done.
+    struct Connection *next_closed; ///< Next connection to free after the current batch of events.
+} Connection;
+
+/**
+ * @brief A request handed to the worker pool.
+ */
+typedef struct ServerJob
+{
+    Connection *connection;
+    char *spec;            ///< Chart specification taken from the request body.
+    OutputBuffer output;   ///< Rendered image, empty if the specification was invalid.
+    PieChartFormat format; ///< Format of the rendered image.
+    struct ServerJob *next;
+} ServerJob;
+
+/**
+ * @brief Shared state of the server.
+ */
+typedef struct Server
+{
+    const ServerOptions *options;
+    int epoll_fd;
+    int listen_fd;
+    int wakeup_fd;                ///< eventfd signalled by the workers when a job is done.
+    int signal_fd;
+    BoundedQueue jobs;            ///< Requests waiting for a worker.
+    pthread_mutex_t done_lock;
+    ServerJob *done;              ///< Jobs completed by the workers, for the event loop.
+    Connection *closed;           ///< Closed connections, freed once no event of the batch can refer to them.
+    long served;
+    long rejected;
+} Server;
+
+// Markers stored in epoll_data for the descriptors that are not connections
+static char listen_tag, wakeup_tag, signal_tag;
+
+int parse_server_options(int argc, char **argv, ServerOptions *options)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options->program_name = argv[0];
+    options->port = 8080;
+    options->jobs = cpus > 0 ? (int)cpus : 1;
+    options->queue_depth = 64;
+
+    if (argc < 2 || strcmp(argv[1], "--serve") != 0)
+        return 1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        int value = i + 1 < argc && is_number(argv[i + 1]) ? atoi(argv[i + 1]) : 0;
+        if (strcmp(argv[i], "--port") == 0 && value > 0 && value < 65536)
+            options->port = value;
+        else if (strcmp(argv[i], "--jobs") == 0 && value > 0)
+            options->jobs = value;
+        else if (strcmp(argv[i], "--queue-depth") == 0 && value > 0)
+            options->queue_depth = value;
+        else
+        {
+            fprintf(stderr, "Unknown server option: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Registers or updates a descriptor in the epoll set.
+ */
+static int watch(Server *server, int op, int fd, uint32_t events, void *tag)
+{
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = tag;
+    return epoll_ctl(server->epoll_fd, op, fd, &event);
+}
+
+static void free_connection(Connection *connection)
+{
+    output_buffer_free(&connection->output);
+    free(connection->in);
+    free(connection);
+}
+
+/**
+ * @brief Queues a closed connection to be freed by free_closed_connections().
+ */
+static void retire_connection(Server *server, Connection *connection)
+{
+    connection->next_closed = server->closed;
+    server->closed = connection;
+}
+
+/**
+ * @brief Frees the connections closed while handling a batch of events.
+ *
+ * A later event of the same batch may still point to a connection closed by an
+ * earlier one, so connections are only freed once the whole batch has been handled.
+ */
+static void free_closed_connections(Server *server)
+{
+    while (server->closed)
+    {
+        Connection *next = server->closed->next_closed;
+        free_connection(server->closed);
+        server->closed = next;
+    }
+}
+
+static void close_connection(Server *server, Connection *connection)
+{
+    if (connection->closed)
+        return;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    connection->closed = true;
+
+    // A worker still refers to the connection, it is retired when its job comes back
+    if (!connection->in_flight)
+        retire_connection(server, connection);
+}
+
+/**
+ * @brief Events a connection waits for: no input once the peer has shut down its side.
+ */
+static uint32_t connection_events(const Connection *connection)
+{
+    return (connection->draining ? 0 : EPOLLIN | EPOLLRDHUP) | (connection->waiting_output ? EPOLLOUT : 0);
+}
+
+/**
+ * @brief Closes a draining connection once nothing is left to answer.
+ */
+static void close_if_drained(Server *server, Connection *connection)
+{
+    if (connection->draining && !connection->closed && !connection->in_flight && !connection->writing)
+        close_connection(server, connection);
+}
+
+static void process_request(Server *server, Connection *connection);
+
+/**
+ * @brief Sends as much of the pending response as the socket accepts.
+ */
+static void flush_connection(Server *server, Connection *connection)
+{
+    size_t total = connection->header_len + connection->body_len;
+
+    while (connection->sent < total)
+    {
+        struct iovec iov[2];
+        int count = 0;
+        if (connection->sent < connection->header_len)
+        {
+            iov[count].iov_base = connection->header + connection->sent;
+            iov[count++].iov_len = connection->header_len - connection->sent;
+        }
+        size_t body_offset = connection->sent > connection->header_len ? connection->sent - connection->header_len : 0;
+        if (connection->body_len > body_offset)
+        {
+            iov[count].iov_base = (char *)connection->body + body_offset;
+            iov[count++].iov_len = connection->body_len - body_offset;
+        }
+
+        struct msghdr message = {0};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t written = sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!connection->waiting_output)
+                {
+                    connection->waiting_output = true;
+                    watch(server, EPOLL_CTL_MOD, connection->fd, connection_events(connection), connection);
+                }
+                return;
+            }
+            close_connection(server, connection);
+            return;
+        }
+        connection->sent += written;
+    }
+
+    // Response complete: drop the request from the input buffer
+    output_buffer_reset(&connection->output);
+    connection->writing = false;
+    connection->in_len -= connection->request_len;
+    memmove(connection->in, connection->in + connection->request_len, connection->in_len);
+    connection->request_len = 0;
+
+    if (!connection->keep_alive)
+    {
+        close_connection(server, connection);
+        return;
+    }
+    if (connection->waiting_output)
+    {
+        connection->waiting_output = false;
+        watch(server, EPOLL_CTL_MOD, connection->fd, connection_events(connection), connection);
+    }
+
+    // A pipelined request may already be buffered
+    process_request(server, connection);
+    close_if_drained(server, connection);
+}
+
+/**
+ * @brief Starts sending a response on a connection.
+ */
+static void respond(Server *server, Connection *connection, int status, const char *reason,
+                    const char *content_type, const char *body, size_t body_len)
+{
+    connection->header_len = snprintf(connection->header, sizeof(connection->header),
+                                      "HTTP/1.1 %d %s\r\n"
+                                      "Content-Type: %s\r\n"
+                                      "Content-Length: %zu\r\n"
+                                      "Connection: %s\r\n\r\n",
+                                      status, reason, content_type, body_len,
+                                      connection->keep_alive ? "keep-alive" : "close");
+    connection->body = body;
+    connection->body_len = body_len;
+    connection->sent = 0;
+    connection->writing = true;
+    flush_connection(server, connection);
+}
+
+static void respond_text(Server *server, Connection *connection, int status, const char *reason, const char *text)
+{
+    respond(server, connection, status, reason, "text/plain", text, strlen(text));
+}
+
+/**
+ * @brief Returns the value of a header in the header block, or NULL. The value ends at "\r\n".
+ */
+static const char *find_header(const char *headers, const char *end, const char *name)
+{
+    size_t name_len = strlen(name);
+    for (const char *line = headers; line < end; )
+    {
+        const char *next = strstr(line, "\r\n");
+        if (next == NULL || next > end)
+            break;
+        if ((size_t)(next - line) > name_len && strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char *value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t')
+                value++;
+            return value;
+        }
+        line = next + 2;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses the buffered request, if complete, and dispatches it to the workers.
+ */
+static void process_request(Server *server, Connection *connection)
+{
+    if (connection->closed || connection->writing || connection->in_flight || connection->in_len == 0)
+        return;
+
+    // The buffer always keeps a spare byte so it can be searched as a string
+    connection->in[connection->in_len] = '\0';
+    char *header_end = strstr(connection->in, "\r\n\r\n");
+    if (header_end == NULL)
+    {
+        if (connection->in_len > MAX_HEADER_SIZE)
+        {
+            connection->keep_alive = false;
+            connection->request_len = connection->in_len;
+            respond_text(server, connection, 431, "Request Header Fields Too Large", "Header too large\n");
+        }
+        return;
+    }
+    size_t header_len = header_end + 4 - connection->in;
+
+    char method[16] = "";
+    char version[16] = "";
+    sscanf(connection->in, "%15s %*s %15s", method, version);
+
+    const char *length_value = find_header(connection->in, header_end + 2, "Content-Length");
+    const char *connection_value = find_header(connection->in, header_end + 2, "Connection");
+    long body_len = length_value ? strtol(length_value, NULL, 10) : 0;
+
+    connection->keep_alive = strcmp(version, "HTTP/1.1") == 0;
+    if (connection_value && strncasecmp(connection_value, "close", 5) == 0)
+        connection->keep_alive = false;
+    else if (connection_value && strncasecmp(connection_value, "keep-alive", 10) == 0)
+        connection->keep_alive = true;
+
+    if (body_len < 0 || body_len > MAX_BODY_SIZE)
+    {
+        connection->keep_alive = false;
+        connection->request_len = connection->in_len;
+        respond_text(server, connection, 413, "Payload Too Large", "Chart specification too large\n");
+        return;
+    }
+    if (connection->in_len < header_len + body_len)
+        return; // Wait for the rest of the body
+
+    connection->request_len = header_len + body_len;
+    if (strcmp(method, "POST") != 0)
+    {
+        respond_text(server, connection, 405, "Method Not Allowed", "POST a chart specification\n");
+        return;
+    }
+
+    ServerJob *job = calloc(1, sizeof(ServerJob));
+    if (job)
+        job->spec = strndup(connection->in + header_len, body_len);
+    if (job == NULL || job->spec == NULL)
+    {
+        free(job);
+        respond_text(server, connection, 500, "Internal Server Error", "Out of memory\n");
+        return;
+    }
+    job->connection = connection;
+
+    // Backpressure: refuse the request rather than queueing without bound
+    connection->in_flight = true;
+    if (!queue_try_push(&server->jobs, job))
+    {
+        connection->in_flight = false;
+        server->rejected++;
+        free(job->spec);
+        free(job);
+        respond_text(server, connection, 429, "Too Many Requests", "Render queue full, retry later\n");
+    }
+}
+
+/**
+ * @brief Reads everything available on a connection.
+ */
+static void read_connection(Server *server, Connection *connection)
+{
+    while (true)
+    {
+        if (connection->in_len + 1 >= connection->in_capacity)
+        {
+            // Never buffer more than one maximal request ahead
+            if (connection->in_capacity >= 2 * (MAX_HEADER_SIZE + MAX_BODY_SIZE))
+            {
+                close_connection(server, connection);
+                return;
+            }
+            size_t capacity = connection->in_capacity ? connection->in_capacity * 2 : 4096;
+            char *grown = realloc(connection->in, capacity);
+            if (grown == NULL)
+            {
+                close_connection(server, connection);
+                return;
+            }
+            connection->in = grown;
+            connection->in_capacity = capacity;
+        }
+
+        ssize_t received = recv(connection->fd, connection->in + connection->in_len,
+                                connection->in_capacity - connection->in_len - 1, 0);
+        if (received > 0)
+        {
+            connection->in_len += received;
+            continue;
+        }
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        if (received < 0)
+        {
+            close_connection(server, connection);
+            return;
+        }
+
+        // The peer shut down its side: stop reading, but still answer the requests it sent
+        connection->draining = true;
+        watch(server, EPOLL_CTL_MOD, connection->fd, connection_events(connection), connection);
+        break;
+    }
+
+    process_request(server, connection);
+    close_if_drained(server, connection);
+}
+
+static void accept_connections(Server *server)
+{
+    while (true)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (connection == NULL || watch(server, EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLRDHUP, connection) < 0)
+        {
+            free(connection);
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+    }
+}
+
+/**
+ * @brief Sends the responses of the jobs finished by the workers.
+ */
+static void complete_jobs(Server *server)
+{
+    uint64_t count;
+    if (read(server->wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd");
+
+    pthread_mutex_lock(&server->done_lock);
+    ServerJob *job = server->done;
+    server->done = NULL;
+    pthread_mutex_unlock(&server->done_lock);
+
+    while (job)
+    {
+        ServerJob *next = job->next;
+        Connection *connection = job->connection;
+        connection->in_flight = false;
+
+        if (connection->closed)
+        {
+            output_buffer_free(&job->output);
+            retire_connection(server, connection);
+        }
+        else if (job->output.length > 0)
+        {
+            // The connection takes over the image until it has been sent
+            server->served++;
+            OutputBuffer previous = connection->output;
+            connection->output = job->output;
+            output_buffer_free(&previous);
+            respond(server, connection, 200, "OK", piechart_format_content_type(job->format),
+                    (const char *)connection->output.data, connection->output.length);
+        }
+        else
+        {
+            respond_text(server, connection, 400, "Bad Request", "Invalid chart specification\n");
+        }
+
+        if (!connection->closed)
+            close_if_drained(server, connection);
+        free(job->spec);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * @brief Worker thread: renders queued requests with its own ControllerData.
+ */
+static void *server_worker_main(void *arg)
+{
+    Server *server = arg;
+    ControllerData data;
+    controller_init(&data);
+    char **argv = NULL;
+    int capacity = 0;
+    ServerJob *job;
+
+    while ((job = queue_pop(&server->jobs)) != NULL)
+    {
+        int argc = split_spec_line(job->spec, server->options->program_name, &argv, &capacity);
+        if (argc >= 0 && parse_chart(argc, argv, &data) == 0 && draw_chart(&data) == 0 && encode_chart(&data) == 0)
+        {
+            // The renderer reuses its buffer for the next chart, hand a copy over to the event loop
+            output_buffer_append(&job->output, data.png, data.png_size);
+            job->format = data.format;
+        }
+        controller_reset(&data);
+
+        pthread_mutex_lock(&server->done_lock);
+        job->next = server->done;
+        server->done = job;
+        pthread_mutex_unlock(&server->done_lock);
+
+        uint64_t one = 1;
+        if (write(server->wakeup_fd, &one, sizeof(one)) < 0)
+            perror("eventfd");
+    }
+
+    free(argv);
+    controller_cleanup(&data);
+    return NULL;
+}
+
+/**
+ * @brief Opens the listening socket on 127.0.0.1.
+ */
+static int open_listener(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Closes the descriptors of the server that were opened and destroys its queue.
+ */
+static void release_server(Server *server)
+{
+    int fds[] = {server->epoll_fd, server->signal_fd, server->wakeup_fd, server->listen_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+    {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    queue_destroy(&server->jobs);
+    pthread_mutex_destroy(&server->done_lock);
+}
+
+int run_server(int argc, char **argv)
+{
+    ServerOptions options;
+    if (parse_server_options(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s --serve [--port P] [--jobs N] [--queue-depth N]\n", argv[0]);
+        return 1;
+    }
+
+    Server server = {0};
+    server.options = &options;
+    server.epoll_fd = server.listen_fd = server.wakeup_fd = server.signal_fd = -1;
+    if (!queue_init(&server.jobs, options.queue_depth))
+        return 1;
+    pthread_mutex_init(&server.done_lock, NULL);
+
+    // SIGINT and SIGTERM are read from the event loop for a clean shutdown
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    server.listen_fd = open_listener(options.port);
+    server.wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.listen_fd < 0 || server.wakeup_fd < 0 || server.signal_fd < 0 || server.epoll_fd < 0 ||
+        watch(&server, EPOLL_CTL_ADD, server.listen_fd, EPOLLIN, &listen_tag) < 0 ||
+        watch(&server, EPOLL_CTL_ADD, server.wakeup_fd, EPOLLIN, &wakeup_tag) < 0 ||
+        watch(&server, EPOLL_CTL_ADD, server.signal_fd, EPOLLIN, &signal_tag) < 0)
+    {
+        perror("Error starting the render server");
+        release_server(&server);
+        return 1;
+    }
+
+    // Workers inherit the blocked signal mask, only the event loop sees them
+    pthread_t *workers = calloc(options.jobs, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < options.jobs &&
+           pthread_create(&workers[started], NULL, server_worker_main, &server) == 0)
+        started++;
+    if (started == 0)
+    {
+        fprintf(stderr, "Could not start any render worker\n");
+        free(workers);
+        release_server(&server);
+        return 1;
+    }
+
+    fprintf(stderr, "Serving charts on http://127.0.0.1:%d/ with %d worker(s)\n", options.port, started);
+
+    bool running = true;
+    struct epoll_event events[MAX_EVENTS];
+    while (running)
+    {
+        int count = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            void *tag = events[i].data.ptr;
+            if (tag == &listen_tag)
+                accept_connections(&server);
+            else if (tag == &wakeup_tag)
+                complete_jobs(&server);
+            else if (tag == &signal_tag)
+                running = false;
+            else
+            {
+                Connection *connection = tag;
+                if (connection->closed)
+                    continue;
+                // Either call may close the connection, so only one of them runs per event
+                if (events[i].events & (EPOLLHUP | EPOLLERR))
+                    close_connection(&server, connection); // Nothing can be sent anymore
+                else if (events[i].events & EPOLLOUT && connection->writing)
+                    flush_connection(&server, connection);
+                else if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+                    read_connection(&server, connection);
+            }
+        }
+        free_closed_connections(&server);
+    }
+
+    // Let the workers finish what is queued, then stop them
+    queue_close(&server.jobs);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    complete_jobs(&server);
+    free_closed_connections(&server);
+
+    fprintf(stderr, "Render server stopped: %ld charts served, %ld requests rejected (429)\n",
+            server.served, server.rejected);
+
+    free(workers);
+    release_server(&server);
+    return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file simd.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Span fill and coverage blending kernels for truecolor pixel rows.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "simd.h"
+#include <string.h>
+#include <pthread.h>
+
+// The vector kernels are compiled for their instruction set only, and chosen at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Blends one byte: round((pixel * (255 - alpha) + color * alpha) / 255).
+ *
+ * The division by 255 is exact with a shift and an add, the vector kernels do the same
+ * on 16 bits lanes.
+ */
+static inline uint32_t blend_byte(uint32_t pixel, uint32_t color, uint32_t alpha)
+{
+    uint32_t sum = pixel * (255 - alpha) + color * alpha + 128;
+    return (sum + (sum >> 8)) >> 8;
+}
+
+static void fill_span_scalar(uint32_t *pixels, uint32_t color, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        pixels[i] = color;
+}
+
+static void blend_span_scalar(uint32_t *pixels, const unsigned char *coverage, uint32_t color, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t alpha = coverage[i], pixel = pixels[i], blended = 0;
+        if (alpha == 0)
+            continue;
+        if (alpha == 255)
+        {
+            pixels[i] = color;
+            continue;
+        }
+        for (int shift = 0; shift < 32; shift += 8)
+            blended |= blend_byte((pixel >> shift) & 0xFF, (color >> shift) & 0xFF, alpha) << shift;
+        pixels[i] = blended;
+    }
+}
+
+static const SimdKernels scalar_kernels = {"scalar", fill_span_scalar, blend_span_scalar};
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse2"))) static void fill_span_sse2(uint32_t *pixels, uint32_t color, size_t count)
+{
+    __m128i value = _mm_set1_epi32((int)color);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(pixels + i), value);
+    fill_span_scalar(pixels + i, color, count - i);
+}
+
+/**
+ * @brief blend_byte() on 8 lanes of 16 bits.
+ */
+__attribute__((target("sse2"))) static inline __m128i blend_lanes_sse2(__m128i pixel, __m128i color, __m128i alpha)
+{
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(pixel, _mm_sub_epi16(_mm_set1_epi16(255), alpha)),
+                                _mm_mullo_epi16(color, alpha));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 8)), 8);
+}
+
+__attribute__((target("sse2"))) static void blend_span_sse2(uint32_t *pixels, const unsigned char *coverage,
+                                                            uint32_t color, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32((int)color);
+    const __m128i ink = _mm_unpacklo_epi8(opaque, zero);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // Uncovered and fully covered pixels are frequent: text interiors and surroundings
+        uint32_t weights;
+        memcpy(&weights, coverage + i, sizeof(weights));
+        if (weights == 0)
+            continue;
+        if (weights == UINT32_MAX)
+        {
+            _mm_storeu_si128((__m128i *)(pixels + i), opaque);
+            continue;
+        }
+
+        // Each weight repeated on the 4 bytes of its pixel
+        __m128i alpha = _mm_cvtsi32_si128((int)weights);
+        alpha = _mm_unpacklo_epi8(alpha, alpha);
+        alpha = _mm_unpacklo_epi16(alpha, alpha);
+
+        __m128i pixel = _mm_loadu_si128((const __m128i *)(pixels + i));
+        __m128i low = blend_lanes_sse2(_mm_unpacklo_epi8(pixel, zero), ink, _mm_unpacklo_epi8(alpha, zero));
+        __m128i high = blend_lanes_sse2(_mm_unpackhi_epi8(pixel, zero), ink, _mm_unpackhi_epi8(alpha, zero));
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_packus_epi16(low, high));
+    }
+    blend_span_scalar(pixels + i, coverage + i, color, count - i);
+}
+
+static const SimdKernels sse2_kernels = {"sse2", fill_span_sse2, blend_span_sse2};
+
+__attribute__((target("avx2"))) static void fill_span_avx2(uint32_t *pixels, uint32_t color, size_t count)
+{
+    __m256i value = _mm256_set1_epi32((int)color);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_si256((__m256i *)(pixels + i), value);
+        _mm256_storeu_si256((__m256i *)(pixels + i + 8), value);
+    }
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(pixels + i), value);
+    _mm256_zeroupper(); // The tail runs SSE code, which would stall on the dirty upper halves
+    fill_span_scalar(pixels + i, color, count - i);
+}
+
+/**
+ * @brief blend_byte() on 16 lanes of 16 bits.
+ */
+__attribute__((target("avx2"))) static inline __m256i blend_lanes_avx2(__m256i pixel, __m256i color, __m256i alpha)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(pixel, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)),
+                                   _mm256_mullo_epi16(color, alpha));
+    sum = _mm256_add_epi16(sum, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_srli_epi16(sum, 8)), 8);
+}
+
+__attribute__((target("avx2"))) static void blend_span_avx2(uint32_t *pixels, const unsigned char *coverage,
+                                                            uint32_t color, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32((int)color);
+    const __m256i ink = _mm256_unpacklo_epi8(opaque, zero);
+    // Weights 0-3 to the pixels of the low 128 bits lane, 4-7 to the high one
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                            4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint64_t weights;
+        memcpy(&weights, coverage + i, sizeof(weights));
+        if (weights == 0)
+            continue;
+        if (weights == UINT64_MAX)
+        {
+            _mm256_storeu_si256((__m256i *)(pixels + i), opaque);
+            continue;
+        }
+
+        __m256i alpha = _mm256_shuffle_epi8(_mm256_set1_epi64x((long long)weights), spread);
+        __m256i pixel = _mm256_loadu_si256((const __m256i *)(pixels + i));
+        __m256i low = blend_lanes_avx2(_mm256_unpacklo_epi8(pixel, zero), ink, _mm256_unpacklo_epi8(alpha, zero));
+        __m256i high = blend_lanes_avx2(_mm256_unpackhi_epi8(pixel, zero), ink, _mm256_unpackhi_epi8(alpha, zero));
+        _mm256_storeu_si256((__m256i *)(pixels + i), _mm256_packus_epi16(low, high));
+    }
+    _mm256_zeroupper();
+    blend_span_sse2(pixels + i, coverage + i, color, count - i);
+}
+
+static const SimdKernels avx2_kernels = {"avx2", fill_span_avx2, blend_span_avx2};
+
+#endif // SIMD_X86
+
+const SimdKernels *simd_kernels_for(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_SCALAR:
+        return &scalar_kernels;
+#ifdef SIMD_X86
+    case SIMD_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+    case SIMD_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const SimdKernels *best_kernels = &scalar_kernels;
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+
+static void detect_kernels(void)
+{
+    for (int level = SIMD_LEVELS - 1; level > SIMD_SCALAR; level--)
+    {
+        const SimdKernels *kernels = simd_kernels_for(level);
+        if (kernels)
+        {
+            best_kernels = kernels;
+            return;
+        }
+    }
+}
+
+const SimdKernels *simd_kernels(void)
+{
+    pthread_once(&detect_once, detect_kernels);
+    return best_kernels;
+}
+
+void fill_span(uint32_t *pixels, uint32_t color, size_t count)
+{
+    simd_kernels()->fill_span(pixels, color, count);
+}
+
+void blend_span(uint32_t *pixels, const unsigned char *coverage, uint32_t color, size_t count)
+{
+    simd_kernels()->blend_span(pixels, coverage, color, count);
+}
@@ -0,0 +1,192 @@
+/**
+ * @file stream.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Streaming PNG encoder generating the rows of a chart from its geometry.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "stream.h"
+#include "scanline.h"
+#include "view.h"
+#include "encoder.h"
+#include "profile.h"
+#include <gd.h>
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief State of a PNG being written: the deflate stream and the pending IDAT chunk.
+ */
+typedef struct PngWriter
+{
+    z_stream deflate;
+    PieChartWriteFn write;
+    void *context;
+    unsigned char chunk[STREAM_CHUNK_SIZE];
+} PngWriter;
+
+/**
+ * @brief Compresses bytes, writing an IDAT chunk every time the chunk buffer is full.
+ */
+static int deflate_bytes(PngWriter *writer, unsigned char *bytes, size_t length, int flush)
+{
+    writer->deflate.next_in = bytes;
+    writer->deflate.avail_in = length;
+    for (;;)
+    {
+        int result = deflate(&writer->deflate, flush);
+        if (result == Z_STREAM_ERROR)
+            return 1;
+
+        size_t pending = sizeof(writer->chunk) - writer->deflate.avail_out;
+        if (writer->deflate.avail_out == 0 || (result == Z_STREAM_END && pending))
+        {
+            if (png_write_chunk(writer->write, writer->context, "IDAT", writer->chunk, pending))
+                return 1;
+            writer->deflate.next_out = writer->chunk;
+            writer->deflate.avail_out = sizeof(writer->chunk);
+            continue;
+        }
+        if (result == Z_STREAM_END || (flush == Z_NO_FLUSH && writer->deflate.avail_in == 0))
+            return 0;
+    }
+}
+
+/**
+ * @brief Renders the text runs of a display list, the labels and the title of the chart.
+ *
+ * @return The number of masks, or -1 on error.
+ */
+static int render_text_masks(TextMask *masks, const DisplayList *list)
+{
+    double start = profile_start();
+    int masks_count = 0;
+    for (int i = 0; i < list->count && masks_count >= 0; i++)
+    {
+        const DisplayItem *item = &list->items[i];
+        if (item->kind == DISPLAY_TEXT &&
+            render_text_mask(&masks[masks_count++], display_item_text(list, item), item->text.size, item->text.x, item->text.y))
+            masks_count = -1;
+    }
+    profile_stop(PROFILE_TEXT, start);
+    return masks_count;
+}
+
+/**
+ * @brief Darkens the pixels of row y covered by a text mask.
+ */
+static void composite_mask(const TextMask *mask, int y, unsigned char *rgb, int width)
+{
+    const unsigned char *coverage = mask->coverage + (size_t)(y - mask->y) * mask->width;
+    for (int column = 0; column < mask->width; column++)
+    {
+        int x = mask->x + column, alpha = coverage[column];
+        if (alpha == 0 || x < 0 || x >= width)
+            continue;
+        for (int channel = 0; channel < 3; channel++)
+            rgb[3 * x + channel] = (rgb[3 * x + channel] * (255 - alpha) + 127) / 255;
+    }
+}
+
+static int compare_masks(const void *a, const void *b)
+{
+    const TextMask *first = a, *second = b;
+    return (first->y > second->y) - (first->y < second->y);
+}
+
+/**
+ * @brief Writes the PNG: signature, header, the rows compressed as soon as they are ready, end.
+ */
+static int write_png(PngWriter *writer, PieGeometry *geometry, const TextMask *masks, int masks_count,
+                     unsigned char *row, int width, int height, int dpi)
+{
+    // 8 bits RGB
+    if (png_write_header(writer->write, writer->context, width, height, 8, PNG_COLOR_RGB, dpi))
+        return 1;
+
+    // Rows: the pie, then the texts crossing the row
+    int first_mask = 0;
+    row[0] = 0; // Filter: none
+    for (int y = 0; y < height; y++)
+    {
+        pie_geometry_fill_row(geometry, y, PIXELS_RGB, row + 1, width);
+        while (first_mask < masks_count && masks[first_mask].y + masks[first_mask].height <= y)
+            first_mask++;
+        for (int i = first_mask; i < masks_count && masks[i].y <= y; i++)
+        {
+            if (y < masks[i].y + masks[i].height)
+                composite_mask(&masks[i], y, row + 1, width);
+        }
+        if (deflate_bytes(writer, row, 1 + 3 * (size_t)width, Z_NO_FLUSH))
+            return 1;
+    }
+    return deflate_bytes(writer, NULL, 0, Z_FINISH) || png_write_chunk(writer->write, writer->context, "IEND", NULL, 0);
+}
+
+int stream_pie_chart_geometry(PieGeometry *geometry, const PieChartSegment *segments, int count, const char *title,
+                              int width, int height, int dpi, const PngOptions *compression, PieChartWriteFn write,
+                              void *context)
+{
+    ChartLayout layout;
+    chart_layout_init(&layout, width, height);
+    pie_geometry_place(geometry, layout.cx, layout.cy, layout.radius);
+
+    // RGB inks, the geometry may have been drawn on a canvas before
+    for (int i = 0; i < count; i++)
+        geometry->inks[i] = (segments[i].color.r << 16) | (segments[i].color.g << 8) | segments[i].color.b;
+    geometry->background = 0xFFFFFF;
+    geometry->border = 0x000000;
+    geometry->antialias = 0;
+
+    // The texts are placed like on a canvas; the pie itself comes from the geometry
+    DisplayList list;
+    display_list_init(&list);
+    int failed = 1, masks_count = -1;
+    PngWriter *writer = malloc(sizeof(PngWriter));
+    unsigned char *row = malloc(1 + 3 * (size_t)width);
+    TextMask *masks = calloc(count + 1, sizeof(TextMask));
+    if (writer && row && masks && display_pie_chart(&list, segments, count, title, width, height) == 0)
+        masks_count = render_text_masks(masks, &list);
+    display_list_free(&list);
+
+    if (masks_count >= 0)
+    {
+        qsort(masks, masks_count, sizeof(TextMask), compare_masks);
+        writer->write = write;
+        writer->context = context;
+        memset(&writer->deflate, 0, sizeof(z_stream));
+        int level = compression ? compression->level : Z_DEFAULT_COMPRESSION;
+        int strategy = compression ? compression->strategy : Z_DEFAULT_STRATEGY;
+        if (deflateInit2(&writer->deflate, level, Z_DEFLATED, 15, 8, strategy) == Z_OK)
+        {
+            writer->deflate.next_out = writer->chunk;
+            writer->deflate.avail_out = sizeof(writer->chunk);
+            failed = write_png(writer, geometry, masks, masks_count, row, width, height, dpi);
+            deflateEnd(&writer->deflate);
+        }
+    }
+
+    for (int i = 0; masks && i <= count; i++)
+        free(masks[i].coverage);
+    free(masks);
+    free(row);
+    free(writer);
+    return failed;
+}
+
+int stream_pie_chart(const PieChartSegment *segments, int count, const char *title, int width, int height, int dpi,
+                     const PngOptions *compression, PieChartWriteFn write, void *context)
+{
+    PieGeometry geometry;
+    if (pie_geometry_init(&geometry, segments, count, 0, 0, 0))
+        return 1;
+    int failed = stream_pie_chart_geometry(&geometry, segments, count, title, width, height, dpi, compression, write,
+                                           context);
+    pie_geometry_free(&geometry);
+    return failed;
+}
@@ -0,0 +1,280 @@
+/**
+ * @file svg.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief SVG backend: a display list written as a vector document.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "svg.h"
+#include "font.h"
+#include "utils.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Copies a string literal, returns the position after it.
+ */
+static char *put_string(char *out, const char *string)
+{
+    size_t length = strlen(string);
+    memcpy(out, string, length);
+    return out + length;
+}
+
+static char *put_unsigned(char *out, unsigned long long value)
+{
+    char digits[24];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (count)
+        *out++ = digits[--count];
+    return out;
+}
+
+/**
+ * @brief Writes a number rounded to the hundredth, without trailing zeros.
+ *
+ * Written by hand rather than with printf: it is the hot path of the document, and the
+ * output must not depend on the locale. Values are clamped to a billion, which bounds
+ * the length of a number to 14 bytes.
+ */
+static char *put_number(char *out, double value)
+{
+    long long hundredths = llround(fmax(fmin(value, 1e9), -1e9) * 100);
+    if (hundredths < 0)
+    {
+        *out++ = '-';
+        hundredths = -hundredths;
+    }
+    out = put_unsigned(out, hundredths / 100);
+    int fraction = hundredths % 100;
+    if (fraction)
+    {
+        *out++ = '.';
+        *out++ = '0' + fraction / 10;
+        if (fraction % 10)
+            *out++ = '0' + fraction % 10;
+    }
+    return out;
+}
+
+static char *put_color(char *out, PieChartColor color)
+{
+    static const char hex[] = "0123456789abcdef";
+    int channels[3] = {color.r, color.g, color.b};
+    *out++ = '#';
+    for (int i = 0; i < 3; i++)
+    {
+        int channel = channels[i] < 0 ? 0 : channels[i] > 255 ? 255 : channels[i];
+        *out++ = hex[channel >> 4];
+        *out++ = hex[channel & 0xF];
+    }
+    return out;
+}
+
+/**
+ * @brief Writes name="value" for a number, preceded by a space.
+ */
+static char *put_attribute(char *out, const char *name, double value)
+{
+    *out++ = ' ';
+    out = put_string(out, name);
+    *out++ = '=';
+    *out++ = '"';
+    out = put_number(out, value);
+    *out++ = '"';
+    return out;
+}
+
+static char *put_point(char *out, double x, double y)
+{
+    out = put_number(out, x);
+    *out++ = ' ';
+    return put_number(out, y);
+}
+
+/**
+ * @brief Writes a code point in UTF-8, dropping the ones XML does not allow.
+ */
+static char *put_code(char *out, uint32_t code)
+{
+    if ((code < 0x20 && code != '\t' && code != '\n' && code != '\r') || (code >= 0xD800 && code < 0xE000) ||
+        code == 0xFFFE || code == 0xFFFF || code > 0x10FFFF)
+        return out;
+    if (code < 0x80)
+        *out++ = code;
+    else if (code < 0x800)
+    {
+        *out++ = 0xC0 | (code >> 6);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = 0xE0 | (code >> 12);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    else
+    {
+        *out++ = 0xF0 | (code >> 18);
+        *out++ = 0x80 | ((code >> 12) & 0x3F);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    return out;
+}
+
+/**
+ * @brief Writes a text escaped for XML, at most SVG_TEXT_BYTE_BOUND bytes per byte of the text.
+ *
+ * The code points are decoded like the font decodes them, with utf8_next(), and escaped
+ * once decoded: the document shows the characters of the PNG, and an overlong sequence
+ * cannot smuggle markup into it.
+ */
+static char *put_text(char *out, const unsigned char *text, size_t length)
+{
+    const unsigned char *end = text + length;
+    while (text < end)
+    {
+        uint32_t code = utf8_next(&text, end);
+        switch (code)
+        {
+        case '&':
+            out = put_string(out, "&amp;");
+            break;
+        case '<':
+            out = put_string(out, "&lt;");
+            break;
+        case '>':
+            out = put_string(out, "&gt;");
+            break;
+        case '"':
+            out = put_string(out, "&quot;");
+            break;
+        default:
+            out = put_code(out, code);
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Writes a wedge as a path: both radii and the arc, filled and outlined.
+ *
+ * The shapes are shifted by half a pixel, the center of the pixels libgd draws on.
+ */
+static char *put_wedge(char *out, const DisplayItem *item)
+{
+    double cx = item->wedge.cx + 0.5, cy = item->wedge.cy + 0.5, radius = item->wedge.radius;
+    double start = item->wedge.start * M_PI / 180.0, end = item->wedge.end * M_PI / 180.0;
+    double sweep = item->wedge.end - item->wedge.start;
+
+    out = put_string(out, "<path d=\"M");
+    out = put_point(out, cx, cy);
+    out = put_string(out, "L");
+    out = put_point(out, cx + radius * cos(start), cy + radius * sin(start));
+    if (sweep >= 360.0)
+    {
+        // A full turn, in two halves: an arc cannot end where it starts
+        for (int half = 1; half <= 2; half++)
+        {
+            double angle = start + half * M_PI;
+            out = put_string(out, "A");
+            out = put_point(out, radius, radius);
+            out = put_string(out, " 0 0 1 ");
+            out = put_point(out, cx + radius * cos(angle), cy + radius * sin(angle));
+        }
+    }
+    else if (sweep > 0)
+    {
+        out = put_string(out, "A");
+        out = put_point(out, radius, radius);
+        out = put_string(out, sweep > 180.0 ? " 0 1 1 " : " 0 0 1 ");
+        out = put_point(out, cx + radius * cos(end), cy + radius * sin(end));
+    }
+    out = put_string(out, "Z\" fill=\"");
+    out = put_color(out, item->color);
+    out = put_string(out, "\" stroke=\"");
+    out = put_color(out, item->stroke);
+    return put_string(out, "\"/>\n");
+}
+
+static char *put_line(char *out, const DisplayItem *item)
+{
+    out = put_string(out, "<line");
+    out = put_attribute(out, "x1", item->line.x0 + 0.5);
+    out = put_attribute(out, "y1", item->line.y0 + 0.5);
+    out = put_attribute(out, "x2", item->line.x1 + 0.5);
+    out = put_attribute(out, "y2", item->line.y1 + 0.5);
+    out = put_string(out, " stroke=\"");
+    out = put_color(out, item->color);
+    return put_string(out, "\"/>\n");
+}
+
+static char *put_text_run(char *out, const DisplayList *list, const DisplayItem *item)
+{
+    out = put_string(out, "<text");
+    out = put_attribute(out, "x", item->text.x);
+    out = put_attribute(out, "y", item->text.y);
+    out = put_attribute(out, "font-size", item->text.size * FONT_DPI / 72.0); // Points to pixels
+    out = put_string(out, " fill=\"");
+    out = put_color(out, item->color);
+    out = put_string(out, "\">");
+    out = put_text(out, (const unsigned char *)display_item_text(list, item), item->text.length);
+    return put_string(out, "</text>\n");
+}
+
+int svg_encode(OutputBuffer *buffer, const DisplayList *list, int width, int height)
+{
+    // The whole document is bounded before writing: one allocation at most, no check per primitive
+    size_t bound = SVG_HEADER_BOUND;
+    for (int i = 0; i < list->count; i++)
+    {
+        bound += SVG_ITEM_BOUND;
+        if (list->items[i].kind == DISPLAY_TEXT)
+            bound += SVG_TEXT_BYTE_BOUND * list->items[i].text.length;
+    }
+    output_buffer_reset(buffer);
+    if (output_buffer_reserve(buffer, bound))
+        return 1;
+
+    char *out = (char *)buffer->data;
+    out = put_string(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\"");
+    out = put_attribute(out, "width", width);
+    out = put_attribute(out, "height", height);
+    out = put_string(out, " viewBox=\"0 0 ");
+    out = put_point(out, list->width, list->height);
+    out = put_string(out, "\" font-family=\"DejaVu Sans, sans-serif\" font-weight=\"bold\" stroke-linejoin=\"round\">\n");
+    out = put_string(out, "<rect width=\"100%\" height=\"100%\" fill=\"");
+    out = put_color(out, list->background);
+    out = put_string(out, "\"/>\n");
+
+    for (int i = 0; i < list->count; i++)
+    {
+        const DisplayItem *item = &list->items[i];
+        switch (item->kind)
+        {
+        case DISPLAY_WEDGE:
+            out = put_wedge(out, item);
+            break;
+        case DISPLAY_LINE:
+            out = put_line(out, item);
+            break;
+        case DISPLAY_TEXT:
+            out = put_text_run(out, list, item);
+            break;
+        }
+    }
+    out = put_string(out, "</svg>\n");
+
+    buffer->length = (unsigned char *)out - buffer->data;
+    return 0;
+}
@@ -1 +1,41 @@
+/**
+ * @file utils.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Small helpers shared by the other modules.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
 #include "utils.h"
+#include <time.h>
+
+double monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint32_t utf8_next(const unsigned char **text, const unsigned char *end)
+{
+    static const uint32_t smallest[4] = {0, 0x80, 0x800, 0x10000}; // Below, the form is overlong
+    const unsigned char *bytes = *text;
+    uint32_t code = *bytes++;
+    *text = bytes;
+    int extra = code >= 0xF8 ? -1 : code >= 0xF0 ? 3 : code >= 0xE0 ? 2 : code >= 0xC0 ? 1 : 0;
+    if (extra <= 0 || end - bytes < extra)
+        return code;
+
+    uint32_t decoded = code & (0x3F >> extra);
+    for (int i = 0; i < extra; i++)
+    {
+        if ((bytes[i] & 0xC0) != 0x80)
+            return code;
+        decoded = (decoded << 6) | (bytes[i] & 0x3F);
+    }
+    if (decoded < smallest[extra] || (decoded >= 0xD800 && decoded < 0xE000) || decoded > 0x10FFFF)
+        return code;
+    *text = bytes + extra;
+    return decoded;
+}
@@ -8,6 +8,11 @@
  * @copyright Copyright (c) 2023
  */
 #include "view.h"
+#include "scanline.h"
+#include "simd.h"
+#include "font.h"
+#include "profile.h"
+#include "probes.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -17,27 +22,186 @@
 
 
 
-gdImagePtr create_pie_chart_image(PieChartSegment *segments, int segments_count, char *title) {
-    // Create a new image with predefined dimensions
-    gdImagePtr img = gdImageCreate(WIDTH, HEIGHT);
-    
-    // Set a background color (adjust as required)
-    int backgroundColor = gdImageColorAllocate(img, 255, 255, 255);  // Blanc
-    gdImageFill(img, 0, 0, backgroundColor);
+/**
+ * @brief Paints the whole canvas with one color, writing the pixel rows directly.
+ *
+ * Much cheaper than gdImageFill's flood fill or gdImageFilledRectangle's per-pixel path.
+ */
+static void clear_canvas(gdImagePtr img, int color)
+{
+    for (int y = 0; y < gdImageSY(img); y++)
+    {
+        if (gdImageTrueColor(img))
+            fill_span((uint32_t *)img->tpixels[y], (uint32_t)color, gdImageSX(img));
+        else
+        {
+            memset(img->pixels[y], color, gdImageSX(img));
+        }
+    }
+}
 
-    //futur develloper border function
+/**
+ * @brief Coverage levels of a text on a palette image, like libgd.
+ */
+#define PALETTE_TEXT_LEVELS 8
 
-    // Draw the segments of the pie chart
-    int black = gdImageColorAllocate(img, 0, 0, 0);  // Noir pour les bordures
-    draw_pie_segments(img, segments, segments_count, WIDTH / 2, HEIGHT / 2, 0, MIN(WIDTH, HEIGHT) / 3, black);
+/**
+ * @brief Blits the glyphs of a text on a palette image.
+ *
+ * A partly covered pixel gets the palette color closest to the blend of its color and
+ * the text color, at one of PALETTE_TEXT_LEVELS levels; each blend is resolved once.
+ */
+static void blit_palette_text(gdImagePtr img, const TextLayout *layout, int color)
+{
+    int tween[gdMaxColors][PALETTE_TEXT_LEVELS];
+    memset(tween, -1, sizeof(tween));
+    for (int i = 0; i < layout->count; i++)
+    {
+        const PlacedGlyph *glyph = &layout->glyphs[i];
+        int left = MAX(glyph->x, 0), right = MIN(glyph->x + glyph->width, gdImageSX(img));
+        int top = MAX(glyph->y, 0), bottom = MIN(glyph->y + glyph->height, gdImageSY(img));
+        for (int y = top; y < bottom; y++)
+        {
+            const unsigned char *coverage = glyph->coverage + (size_t)(y - glyph->y) * glyph->width - glyph->x;
+            unsigned char *pixels = img->pixels[y];
+            for (int x = left; x < right; x++)
+            {
+                int level = (coverage[x] * PALETTE_TEXT_LEVELS + 127) / 255, under = pixels[x];
+                if (level == 0 || under == color)
+                    continue;
+                if (level == PALETTE_TEXT_LEVELS)
+                {
+                    pixels[x] = color;
+                    continue;
+                }
+                if (tween[under][level] < 0)
+                {
+                    int r = (img->red[color] * level + img->red[under] * (PALETTE_TEXT_LEVELS - level)) / PALETTE_TEXT_LEVELS;
+                    int g = (img->green[color] * level + img->green[under] * (PALETTE_TEXT_LEVELS - level)) / PALETTE_TEXT_LEVELS;
+                    int b = (img->blue[color] * level + img->blue[under] * (PALETTE_TEXT_LEVELS - level)) / PALETTE_TEXT_LEVELS;
+                    tween[under][level] = gdImageColorResolve(img, r, g, b);
+                }
+                pixels[x] = tween[under][level];
+            }
+        }
+    }
+}
 
-   // Draw labels for the segments
-    draw_label(img, segments, segments_count, WIDTH / 2, HEIGHT / 2, 0, MIN(WIDTH, HEIGHT) / 3, black);
+/**
+ * @brief Writes a text from the glyph atlas: on truecolor images the coverage of each glyph
+ * row is blended with the SIMD kernels.
+ */
+static void draw_text(gdImagePtr img, const char *text, double size, int x, int y, int color)
+{
+    TextLayout layout;
+    if (font_layout_text(&layout, text, size, x, y))
+        return;
+    profile_count_glyphs(layout.count);
+    PIECHART_PROBE3(text_draw, layout.count, x, y);
+    if (!gdImageTrueColor(img))
+    {
+        blit_palette_text(img, &layout, color);
+        return;
+    }
 
-    // Drawn the title
-    draw_title(img, title, WIDTH / 2, HEIGHT / 10, black);
+    for (int i = 0; i < layout.count; i++)
+    {
+        const PlacedGlyph *glyph = &layout.glyphs[i];
+        int left = MAX(glyph->x, 0), right = MIN(glyph->x + glyph->width, gdImageSX(img));
+        int top = MAX(glyph->y, 0), bottom = MIN(glyph->y + glyph->height, gdImageSY(img));
+        for (int row = top; row < bottom && left < right; row++)
+        {
+            const unsigned char *coverage = glyph->coverage + (size_t)(row - glyph->y) * glyph->width + (left - glyph->x);
+            blend_span((uint32_t *)img->tpixels[row] + left, coverage, (uint32_t)color, right - left);
+        }
+    }
+}
+
+void chart_layout_init(ChartLayout *layout, int width, int height)
+{
+    layout->cx = width / 2;
+    layout->cy = height / 2;
+    layout->radius = MIN(width, height) / 3;
+    layout->label_size = layout->radius * LABEL_SIZE_RATIO;
+    layout->title_size = SIZE_TITLE * (double)MIN(width, height) / MIN(WIDTH, HEIGHT);
+    layout->title_x = width / 2;
+    layout->title_y = height / 10;
+}
+
+int draw_pie_chart(gdImagePtr img, const PieChartSegment *segments, int segments_count, const char *title)
+{
+    DisplayList list;
+    display_list_init(&list);
+    int failed = draw_pie_chart_list(img, &list, NULL, segments, segments_count, title);
+    display_list_free(&list);
+    return failed;
+}
+
+int draw_pie_chart_list(gdImagePtr img, DisplayList *list, PieGeometry *geometry, const PieChartSegment *segments,
+                        int segments_count, const char *title)
+{
+    if (display_pie_chart(list, segments, segments_count, title, gdImageSX(img), gdImageSY(img)))
+        return 1;
+
+    // Without a geometry from the caller, one is computed for this chart
+    PieGeometry own;
+    if (geometry == NULL && pie_geometry_init(&own, segments, segments_count, 0, 0, 0) == 0)
+    {
+        draw_display_list(img, list, &own);
+        pie_geometry_free(&own);
+    }
+    else
+        draw_display_list(img, list, geometry); // Not enough memory for a geometry: drawn with libgd
+    return 0;
+}
+
+int display_pie_chart(DisplayList *list, const PieChartSegment *segments, int segments_count, const char *title,
+                      int width, int height)
+{
+    double start = profile_start();
+    ChartLayout layout;
+    chart_layout_init(&layout, width, height);
+
+    PieChartColor white = {255, 255, 255}, black = {0, 0, 0};
+    display_list_reset(list, width, height, white);
+
+    // The segments with their borders, then their labels and the title over them
+    int failed = display_pie_segments(list, segments, segments_count, layout.cx, layout.cy, layout.radius, black) ||
+                 display_labels(list, segments, segments_count, layout.cx, layout.cy, layout.radius, black) ||
+                 (title && display_title(list, title, layout.title_size, layout.title_x, layout.title_y, black));
+    profile_stop(PROFILE_LAYOUT, start);
+    return failed;
+}
+
+int display_pie_segments(DisplayList *list, const PieChartSegment *segments, int length, int x, int y, int radius,
+                         PieChartColor border)
+{
+    // Angles accumulated and clipped like pie_geometry_init(), so both describe the same pie
+    double start_angle = 0;
+    for (int i = 0; i < length; i++)
+    {
+        double end_angle = start_angle;
+        if (segments[i].percentage > 0)
+            end_angle = fmin(start_angle + segments[i].percentage * 3.6, 360.0); // Multiply by 3.6 to convert to degrees
+        if (display_list_add_wedge(list, x, y, radius, start_angle, end_angle, segments[i].color, border))
+            return 1;
+        list->items[list->count - 1].pie = true;
+        start_angle = end_angle;
+    }
 
-    return img;
+    // The median ticks, from the edge of the circle to 5% beyond it
+    int first = list->count - length;
+    for (int i = 0; i < length; i++)
+    {
+        const DisplayItem *wedge = &list->items[first + i];
+        double median = (wedge->wedge.start + wedge->wedge.end) / 2.0 * M_PI / 180.0;
+        double cosine = cos(median), sine = sin(median);
+        if (display_list_add_line(list, x + radius * cosine, y + radius * sine, x + 1.05 * radius * cosine,
+                                  y + 1.05 * radius * sine, border))
+            return 1;
+        list->items[list->count - 1].pie = true;
+    }
+    return 0;
 }
 
 void calculate_coordinates(int x, int y, int radius, int angle, int *coord_x, int *coord_y)
@@ -46,107 +210,230 @@ void calculate_coordinates(int x, int y, int radius, int angle, int *coord_x, in
     *coord_y = y + radius * sin(angle * M_PI / 180);
 }
 
-void draw_label(gdImagePtr img, PieChartSegment *segments, int length, int x, int y, int start_angle, int radius, int color)
+void place_label(const char *label, double font_size, int x, int y, int radius, int angle, int *text_x, int *text_y)
+{
+    // Calculate the text position
+    int label_x, label_y;
+    calculate_coordinates(x, y, radius * 1.10, angle, &label_x, &label_y);
+
+    // Measure the text
+    int brect[8]; // Bounding rectangle of the text
+    font_measure_text(label, font_size, 0, 0, brect);
+    PIECHART_PROBE3(label_measure, strlen(label), brect[2] - brect[0], brect[3] - brect[5]);
+
+    // If the text is on the left part of the diagram, align to the end of the string
+    if (label_x > x)
+    {
+        label_x += (brect[2] - brect[0]);
+    }
+    // Adjust the position of the text according to the size of the bounding box
+    label_x -= (brect[2] - brect[0]) / 2;
+    label_y += (brect[3] - brect[5]) / 2;
+
+    *text_x = label_x - (brect[2] - brect[0]) / 2;
+    *text_y = label_y + (brect[3] - brect[7]) / 2;
+}
+
+int display_labels(DisplayList *list, const PieChartSegment *segments, int length, int x, int y, int radius, PieChartColor color)
 {
     // Define the font parameters
-    char *fontPath = FONT_PATH;      // Path to the font file, adjust for your system
-    double fontSize = radius * 0.05; // Font size in points
+    double fontSize = radius * LABEL_SIZE_RATIO; // Font size in points
+    int start_angle = 0;
 
     for (int i = 0; i < length; i++)
     {
         int end_angle = start_angle + segments[i].percentage * 3.6; // Multiply by 3.6 to convert to degrees
         char *label = segments[i].label;
 
-        // Calculate the text position
-        int label_x, label_y;
-        calculate_coordinates(x, y, radius * 1.10, start_angle + (end_angle - start_angle) / 2, &label_x, &label_y);
-
-        // Write the text
-        int brect[8]; // Bounding rectangle of the text
-        gdImageStringFT(NULL, brect, color, fontPath, fontSize, 0, 0, 0, label);
-
-        // If the text is on the left part of the diagram, align to the end of the string
-        if (label_x > x)
+        // Place the text; without a label nothing is measured and the font is not even loaded
+        if (label != NULL && *label != '\0')
         {
-            label_x += (brect[2] - brect[0]);
+            int text_x, text_y;
+            place_label(label, fontSize, x, y, radius, start_angle + (end_angle - start_angle) / 2, &text_x, &text_y);
+            if (display_list_add_text(list, label, fontSize, text_x, text_y, color))
+                return 1;
         }
-        // Adjust the position of the text according to the size of the bounding box
-        int text_width = brect[2] - brect[0];
-        int text_height = brect[3] - brect[5];
-        label_x -= (brect[2] - brect[0]) / 2;
-        label_y += (brect[3] - brect[5]) / 2;
-
-        gdImageStringFT(img, brect, color, fontPath, fontSize, 0, label_x - (brect[2] - brect[0]) / 2, label_y + (brect[3] - brect[7]) / 2, label);
         start_angle = end_angle;
     }
+    return 0;
 }
 
-void draw_pie_segments(gdImagePtr img, PieChartSegment *segments, int length, int x, int y, double start_angle, int radius, int black)
+int allocate_ink(gdImagePtr img, PieChartColor color)
 {
-    for (int i = 0; i < length; i++)
-    {
-        double end_angle = start_angle + segments[i].percentage * 3.6; // Multiply by 3.6 to convert to degrees
-
-        // Generate a random color
-        Color color = generate_random_color();
-
-        // Allocate the color in the image
-        int img_color = gdImageColorAllocate(img, color.r, color.g, color.b);
+    int ink = gdImageColorAllocate(img, color.r, color.g, color.b);
+    if (ink < 0)
+        ink = gdImageColorResolve(img, color.r, color.g, color.b); // Palette full: closest color
+    return ink;
+}
 
-        // Draw the pie chart segment
-        gdImageFilledArc(img, x, y, 2 * radius, 2 * radius, start_angle, end_angle, img_color, gdPie);
+void paint_pie_geometry(gdImagePtr img, PieGeometry *geometry, int background, int black, bool antialias)
+{
+    geometry->background = background;
+    geometry->border = black;
+    geometry->antialias = antialias && gdImageTrueColor(img);
 
-        // Draw a black border around the segment
-        gdImageArc(img, x, y, 2 * radius, 2 * radius, start_angle, end_angle, black);
+    // One pass over the rows: background, segments, outline and lines
+    for (int row = 0; row < gdImageSY(img); row++)
+    {
+        if (gdImageTrueColor(img))
+            pie_geometry_fill_row(geometry, row, PIXELS_TRUECOLOR, img->tpixels[row], gdImageSX(img));
+        else
+            pie_geometry_fill_row(geometry, row, PIXELS_PALETTE, img->pixels[row], gdImageSX(img));
+    }
+}
 
-        // Calculate the coordinates of the start and end of the separation lines
-        double rad_start = start_angle * M_PI / 180.0;
-        double rad_end = end_angle * M_PI / 180.0;
-        double median = (end_angle + start_angle) / 2.0 * M_PI / 180.0;
-        int x_start, y_start, x_end, y_end;
-        calculate_coordinates(x, y, radius, start_angle, &x_start, &y_start);
-        calculate_coordinates(x, y, radius, end_angle, &x_end, &y_end);
+/**
+ * @brief Draws a wedge with libgd: the filled slice, its arc and both radii.
+ */
+static void draw_wedge(gdImagePtr img, const DisplayItem *item)
+{
+    int x = item->wedge.cx, y = item->wedge.cy, radius = item->wedge.radius;
+    // The outline is shared by every wedge, each fill is allocated like the segment inks
+    int stroke = gdImageColorResolve(img, item->stroke.r, item->stroke.g, item->stroke.b);
+    int fill = allocate_ink(img, item->color);
+    int x_start, y_start, x_end, y_end;
+    calculate_coordinates(x, y, radius, item->wedge.start, &x_start, &y_start);
+    calculate_coordinates(x, y, radius, item->wedge.end, &x_end, &y_end);
+    PIECHART_PROBE3(wedge_draw, item->wedge.start, item->wedge.end, radius);
 
-        // Calculate the coordinates of the start of the median, at the edge of the circle
-        int x_med_start = x + radius * cos(median);
-        int y_med_start = y + radius * sin(median);
+    gdImageFilledArc(img, x, y, 2 * radius, 2 * radius, item->wedge.start, item->wedge.end, fill, gdPie);
+    gdImageArc(img, x, y, 2 * radius, 2 * radius, item->wedge.start, item->wedge.end, stroke);
+    gdImageLine(img, x, y, x_start, y_start, stroke);
+    gdImageLine(img, x, y, x_end, y_end, stroke);
+}
 
-        // Calculate the coordinates of the end of the median, 10% beyond the edge of the circle
-        int x_med_end = x + 1.05 * radius * cos(median);
-        int y_med_end = y + 1.05 * radius * sin(median);
+void draw_display_list(gdImagePtr img, const DisplayList *list, PieGeometry *geometry)
+{
+    double start = profile_start();
+    PIECHART_PROBE3(draw_start, gdImageSX(img), gdImageSY(img), list->count);
+    // Release the colors of a previous chart so the canvas can be reused: the palette
+    // is emptied completely, a reused canvas then encodes exactly like a new one
+    for (int i = 0; i < gdImageColorsTotal(img); i++)
+        gdImageColorDeallocate(img, i);
+    img->colorsTotal = 0;
+    int background = allocate_ink(img, list->background);
 
-        // Draw the median
-        gdImageLine(img, x_med_start, y_med_start, x_med_end, y_med_end, black);
+    // The wedges of the pie, in the order of the segments of the geometry
+    const DisplayItem *pie = NULL;
+    int wedges = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (list->items[i].pie && list->items[i].kind == DISPLAY_WEDGE)
+        {
+            pie = pie ? pie : &list->items[i];
+            wedges++;
+        }
+    }
 
-        // Draw the separation lines
-        gdImageLine(img, x, y, x_start, y_start, black);
-        gdImageLine(img, x, y, x_end, y_end, black);
+    // The pie, its outline, lines and ticks in one pass over the rows, the background with them
+    bool painted = pie && geometry && geometry->count == wedges;
+    PIECHART_PROBE3(segments_start, wedges, pie ? pie->wedge.radius : 0, painted);
+    if (painted)
+    {
+        int black = allocate_ink(img, pie->stroke), wedge = 0;
+        for (int i = 0; i < list->count; i++)
+        {
+            if (list->items[i].pie && list->items[i].kind == DISPLAY_WEDGE)
+                geometry->inks[wedge++] = allocate_ink(img, list->items[i].color);
+        }
+        pie_geometry_place(geometry, pie->wedge.cx, pie->wedge.cy, pie->wedge.radius);
+        paint_pie_geometry(img, geometry, background, black, gdImageTrueColor(img)); // Smooth edges whenever the canvas can hold them
+    }
+    else
+        clear_canvas(img, background);
+    PIECHART_PROBE1(segments_done, wedges);
+    profile_stop(PROFILE_SEGMENTS, start);
 
-        start_angle = end_angle;
+    // Everything else, and the pie itself when it could not be rasterized
+    for (int i = 0; i < list->count; i++)
+    {
+        const DisplayItem *item = &list->items[i];
+        if (item->pie && painted)
+            continue;
+        double item_start = profile_start();
+        int color = item->kind == DISPLAY_WEDGE ? 0 : gdImageColorResolve(img, item->color.r, item->color.g, item->color.b);
+        switch (item->kind)
+        {
+        case DISPLAY_WEDGE:
+            draw_wedge(img, item);
+            break;
+        case DISPLAY_LINE:
+            gdImageLine(img, item->line.x0, item->line.y0, item->line.x1, item->line.y1, color);
+            break;
+        case DISPLAY_TEXT:
+            draw_text(img, display_item_text(list, item), item->text.size, item->text.x, item->text.y, color);
+            break;
+        }
+        profile_stop(item->kind == DISPLAY_TEXT ? PROFILE_TEXT : PROFILE_SEGMENTS, item_start);
     }
+    PIECHART_PROBE2(draw_done, gdImageSX(img), gdImageSY(img));
 }
 
-void draw_title(gdImagePtr img, char *title, int x, int y, int color)
+int place_title(const char *title, char *upper, double size, int x, int y, int *text_x, int *text_y)
 {
     int brect[8];
-    double size = SIZE_TITLE;
-    char *err;
-    double angle = 0.0;
     int len = strlen(title);
-    char string[len + 1];
     for (int i = 0; i < len; i++)
     {
-        string[i] = toupper(title[i]);
+        upper[i] = toupper(title[i]);
     }
-    string[len] = '\0';
+    upper[len] = '\0';
 
-    err = gdImageStringFT(NULL, &brect[0], color, FONT_PATH, size, angle, 0, 0, string);
-    if (err)
-    {
-        fprintf(stderr, "Impossible de rendre le titre: %s\n", err);
-        return;
-    }
+    if (font_measure_text(upper, size, 0, 0, brect))
+        return 1; // A missing font is reported once by the font module
+    PIECHART_PROBE3(title_measure, len, brect[2] - brect[0], brect[3] - brect[5]);
+
+    *text_x = x - brect[2] / 2;
+    *text_y = y;
+    return 0;
+}
 
-    gdImageStringFT(img, &brect[0], color, FONT_PATH, size, angle, x - brect[2] / 2, y, string);
+int display_title(DisplayList *list, const char *title, double size, int x, int y, PieChartColor color)
+{
+    // On the heap: a title from a co-process frame can be megabytes long
+    int text_x, text_y;
+    char *string = malloc(strlen(title) + 1);
+    if (string == NULL)
+        return 1;
+    int failed = 0;
+    if (place_title(title, string, size, x, y, &text_x, &text_y) == 0) // Otherwise reported, drawn without its title
+        failed = display_list_add_text(list, string, size, text_x, text_y, color);
+    free(string);
+    return failed;
 }
 
+int render_text_mask(TextMask *mask, const char *text, double size, int x, int y)
+{
+    memset(mask, 0, sizeof(TextMask));
+    if (text == NULL || *text == '\0')
+        return 0;
+
+    TextLayout layout;
+    if (font_layout_text(&layout, text, size, x, y) || layout.count == 0)
+        return 0; // Not drawn on the canvas either
+    profile_count_glyphs(layout.count);
+
+    // Bounding box of the glyphs at their final position
+    int left = layout.brect[6], top = layout.brect[7];
+    mask->width = layout.brect[2] - left;
+    mask->height = layout.brect[3] - top;
+    mask->coverage = calloc((size_t)mask->width * mask->height, 1);
+    if (mask->coverage == NULL)
+        return 1;
+    mask->x = left;
+    mask->y = top;
+
+    // Overlapping glyphs keep the larger coverage
+    for (int i = 0; i < layout.count; i++)
+    {
+        const PlacedGlyph *glyph = &layout.glyphs[i];
+        for (int row = 0; row < glyph->height; row++)
+        {
+            unsigned char *coverage = mask->coverage + (size_t)(glyph->y - top + row) * mask->width + (glyph->x - left);
+            const unsigned char *source = glyph->coverage + (size_t)row * glyph->width;
+            for (int column = 0; column < glyph->width; column++)
+                coverage[column] = MAX(coverage[column], source[column]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file test_font.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Checks that the glyph atlas rasterizes each character once, malformed UTF-8 included.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "font.h"
+#include <stdio.h>
+
+int main(void)
+{
+    // Plain, accented, overlong NUL and '<', truncated and invalid sequences
+    const char *texts[] = {"Ventes", "Été \xE2\x82\xAC", "\xC0\x80", "a\xC0\x80" "b", "\xC0\xBC", "\xE2\x82", "\xFF\xFE"};
+    int count = sizeof(texts) / sizeof(texts[0]);
+    TextLayout layout;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (font_layout_text(&layout, texts[i], 12, 0, 0))
+        {
+            fprintf(stderr, "FAIL: \"%s\" could not be laid out\n", texts[i]);
+            return 1;
+        }
+    }
+    int glyphs = font_cached_glyphs();
+
+    // Every character is in the atlas now: laying the texts out again adds nothing
+    for (int run = 0; run < 1000; run++)
+    {
+        for (int i = 0; i < count; i++)
+            font_layout_text(&layout, texts[i], 12, 0, 0);
+    }
+    if (font_cached_glyphs() != glyphs)
+    {
+        fprintf(stderr, "FAIL: the atlas grew from %d to %d glyphs\n", glyphs, font_cached_glyphs());
+        return 1;
+    }
+    return 0;
+}
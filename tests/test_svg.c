@@ -0,0 +1,75 @@
+/**
+ * @file test_svg.c
+ * @author Antony COCO (antony.coco.pro@gmail.com)
+ * @brief Checks that labels and titles are escaped in SVG charts, malformed UTF-8 included.
+ * @version 0.1
+ * @date 2023-08-06
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#include "piechart.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+/**
+ * @brief Renders a two-segment chart as SVG, the first segment labelled, and checks its document.
+ *
+ * @param label The label of the first segment.
+ * @param expected A text the document must contain.
+ * @param forbidden A text the document must not contain.
+ */
+static void check_label(PieChartRenderer *renderer, const char *label, const char *expected, const char *forbidden)
+{
+    PieChartSegment segments[2] = {
+        {.percentage = 60, .label = (char *)label},
+        {.percentage = 40, .label = "b"},
+    };
+    piechart_assign_label_colors(segments, 2);
+
+    const unsigned char *bytes;
+    size_t length;
+    if (piechart_draw(renderer, segments, 2, label) || piechart_encode(renderer, &bytes, &length))
+    {
+        fprintf(stderr, "FAIL %s: the chart could not be rendered\n", expected);
+        failures++;
+        return;
+    }
+    char document[65536];
+    snprintf(document, sizeof(document), "%.*s", (int)length, (const char *)bytes);
+    if (strstr(document, expected) == NULL)
+    {
+        fprintf(stderr, "FAIL: \"%s\" is missing\n", expected);
+        failures++;
+    }
+    if (strstr(document, forbidden))
+    {
+        fprintf(stderr, "FAIL: \"%s\" is present\n", forbidden);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    PieChartRenderer *renderer = piechart_renderer_create();
+    if (renderer == NULL || piechart_renderer_set_format(renderer, PIECHART_FORMAT_SVG))
+        return 1;
+
+    // Plain markup characters are escaped
+    check_label(renderer, "<&\">", "&lt;&amp;&quot;&gt;", "<&");
+
+    // Overlong forms of '<', '&', '"' and '>' are read as Latin-1, never as the ASCII characters
+    check_label(renderer, "a\xC0\xBCscript\xC0\xBE", "a\xC3\x80\xC2\xBCscript\xC3\x80\xC2\xBE", "<script");
+    check_label(renderer, "x\xC0\xA6y", "x\xC3\x80\xC2\xA6y", "x&y");
+    check_label(renderer, "q\xC0\xA2r", "q\xC3\x80\xC2\xA2r", "q\"r");
+    check_label(renderer, "\xE0\x80\xBC\xF0\x80\x80\xBC", "\xC3\xA0\xC2\x80\xC2\xBC\xC3\xB0\xC2\x80\xC2\x80\xC2\xBC",
+                "<<");
+
+    // Well-formed UTF-8 is kept as is
+    check_label(renderer, "Été \xE2\x82\xAC", "Été \xE2\x82\xAC", "\xC3\x83");
+
+    piechart_renderer_destroy(renderer);
+    return failures ? 1 : 0;
+}